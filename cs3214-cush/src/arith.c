@@ -0,0 +1,749 @@
+/*
+ * Arithmetic expansion, see arith.h.
+ *
+ * The compiler is a recursive descent parser with one level per group of
+ * operators of equal precedence.  It emits postfix code for a stack
+ * machine; &&, || and ?: become forward jumps, so the operand that is not
+ * evaluated has no side effects, and no instruction runs twice, which
+ * bounds the depth of the stack by the length of the code.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "arith.h"
+#include "variables.h"
+
+/* how deeply variables whose values are expressions may refer to others */
+#define ARITH_MAX_DEPTH 64
+
+enum arith_op {
+    OP_PUSH,                    /* push 'arg' */
+    OP_LOAD,                    /* push the value of variable 'arg' */
+    OP_STORE,                   /* assign the top to variable 'arg' */
+    OP_PREINC, OP_PREDEC,       /* ++var, --var of variable 'arg' */
+    OP_POSTINC, OP_POSTDEC,     /* var++, var-- of variable 'arg' */
+    OP_POP,
+    OP_BOOL,                    /* replace the top by 0 or 1 */
+    OP_JZ, OP_JNZ,              /* pop, jump to 'arg' if zero / not zero */
+    OP_JMP,                     /* jump to 'arg' */
+    OP_NEG, OP_NOT, OP_COMPL,   /* unary -, !, ~ */
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_POW,
+    OP_SHL, OP_SHR, OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_AND, OP_XOR, OP_OR,
+};
+
+struct insn {
+    enum arith_op op;
+    int64_t arg;
+};
+
+struct arith_expr {
+    struct insn *code;
+    size_t n, cap;
+    char **names;               /* the variables 'arg' refers to */
+    size_t nnames;
+};
+
+struct cache_entry {
+    char *text;
+    size_t len;
+    struct arith_expr *expr;
+};
+
+struct arith_cache {
+    int refs;
+    struct cache_entry *entries;
+    size_t n, cap;
+};
+
+/* Operators, longer ones first so that the longest one matches */
+static const char *const operators[] = {
+    "<<=", ">>=",
+    "**", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+    "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=",
+    "+", "-", "*", "/", "%", "<", ">", "&", "^", "|", "!", "~",
+    "=", "?", ":", ",", "(", ")",
+};
+
+/* Binary operators from the lowest precedence up; ** is the only one
+ * that is right associative.  && and || are compiled to jumps. */
+static const struct binop {
+    const char *token;
+    int prec;
+    enum arith_op op;
+} binops[] = {
+    { "||", 1, OP_JNZ }, { "&&", 2, OP_JZ },
+    { "|", 3, OP_OR }, { "^", 4, OP_XOR }, { "&", 5, OP_AND },
+    { "==", 6, OP_EQ }, { "!=", 6, OP_NE },
+    { "<", 7, OP_LT }, { "<=", 7, OP_LE }, { ">", 7, OP_GT }, { ">=", 7, OP_GE },
+    { "<<", 8, OP_SHL }, { ">>", 8, OP_SHR },
+    { "+", 9, OP_ADD }, { "-", 9, OP_SUB },
+    { "*", 10, OP_MUL }, { "/", 10, OP_DIV }, { "%", 10, OP_MOD },
+    { "**", 11, OP_POW },
+};
+
+/* Assignment operators; OP_STORE stands for a plain = */
+static const struct assignop {
+    const char *token;
+    enum arith_op op;
+} assignops[] = {
+    { "=", OP_STORE }, { "+=", OP_ADD }, { "-=", OP_SUB }, { "*=", OP_MUL },
+    { "/=", OP_DIV }, { "%=", OP_MOD }, { "<<=", OP_SHL }, { ">>=", OP_SHR },
+    { "&=", OP_AND }, { "^=", OP_XOR }, { "|=", OP_OR },
+};
+
+enum token_kind { T_END, T_NUM, T_NAME, T_OP };
+
+struct token {
+    enum token_kind kind;
+    int64_t value;              /* T_NUM */
+    const char *name;           /* T_NAME: not terminated */
+    size_t len;                 /* T_NAME */
+    bool dollar;                /* T_NAME: written as $name, not assignable */
+    const char *op;             /* T_OP: an entry of 'operators' */
+};
+
+struct parser {
+    const char *p, *end;        /* the text not tokenized yet */
+    struct token tok;           /* the current token */
+    struct arith_expr *expr;
+    const char *error;
+};
+
+/* The value of digit 'c' in a number of base 'base', or -1 */
+static int
+digit_value(char c, int base)
+{
+    int d = -1;
+    if (isdigit((unsigned char) c))
+        d = c - '0';
+    else if (islower((unsigned char) c))
+        d = c - 'a' + 10;
+    else if (isupper((unsigned char) c))
+        d = c - 'A' + (base <= 36 ? 10 : 36);
+    else if (c == '@')
+        d = 62;
+    else if (c == '_')
+        d = 63;
+    return d;
+}
+
+static bool
+is_digit_char(char c)
+{
+    return isalnum((unsigned char) c) || c == '@' || c == '_';
+}
+
+/* Parse the number at '*p' as bash does: 0x1f is hexadecimal, 017 octal
+ * and 36#z in base 36.  Values wrap around at 64 bits.  Advances '*p'
+ * past the number and returns NULL, or an error message. */
+static const char *
+parse_number(const char **p, const char *end, int64_t *value)
+{
+    const char *s = *p;
+    int base = 10;
+
+    if (end - s > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    } else if (s[0] == '0') {
+        base = 8;
+    }
+
+    const char *digits = s;
+    while (s < end && is_digit_char(*s))
+        s++;
+    if (base == 10 && s < end && *s == '#') {
+        base = 0;
+        for (const char *d = digits; d < s; d++) {
+            if (!isdigit((unsigned char) *d) || base > 64)
+                return "invalid arithmetic base";
+            base = base * 10 + (*d - '0');
+        }
+        if (base < 2 || base > 64)
+            return "invalid arithmetic base";
+        digits = ++s;
+        while (s < end && is_digit_char(*s))
+            s++;
+    }
+
+    uint64_t v = 0;
+    for (const char *d = digits; d < s; d++) {
+        int dv = digit_value(*d, base);
+        if (dv < 0 || dv >= base)
+            return "value too great for base";
+        v = v * base + dv;
+    }
+    *p = s;
+    *value = (int64_t) v;
+    return NULL;
+}
+
+static void
+fail(struct parser *ps, const char *error)
+{
+    if (ps->error == NULL)
+        ps->error = error;
+}
+
+/* Read the next token into ps->tok; after an error there are no more */
+static void
+next(struct parser *ps)
+{
+    struct token *t = &ps->tok;
+
+    while (ps->p < ps->end && isspace((unsigned char) *ps->p))
+        ps->p++;
+    t->kind = T_END;
+    if (ps->p == ps->end || ps->error != NULL)
+        return;
+
+    const char *s = ps->p;
+    if (isdigit((unsigned char) *s)) {
+        const char *error = parse_number(&ps->p, ps->end, &t->value);
+        if (error != NULL)
+            fail(ps, error);
+        t->kind = T_NUM;
+        return;
+    }
+
+    /* a variable, possibly written as $name, ${name}, $? or $$ */
+    t->dollar = *s == '$';
+    if (t->dollar) {
+        s++;
+        if (s < ps->end && (*s == '?' || *s == '$')) {
+            t->kind = T_NAME;
+            t->name = s;
+            t->len = 1;
+            ps->p = s + 1;
+            return;
+        }
+    }
+    bool braced = t->dollar && s < ps->end && *s == '{';
+    const char *name = s + braced;
+    const char *e = name;
+    while (e < ps->end && (isalnum((unsigned char) *e) || *e == '_'))
+        e++;
+    if (e > name && (t->dollar || !isdigit((unsigned char) *name))) {
+        if (braced && (e == ps->end || *e != '}')) {
+            fail(ps, "bad substitution");
+            return;
+        }
+        t->kind = T_NAME;
+        t->name = name;
+        t->len = e - name;
+        ps->p = e + braced;
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof operators / sizeof *operators; i++) {
+        size_t len = strlen(operators[i]);
+        if ((size_t) (ps->end - ps->p) >= len && strncmp(ps->p, operators[i], len) == 0) {
+            t->kind = T_OP;
+            t->op = operators[i];
+            ps->p += len;
+            return;
+        }
+    }
+    fail(ps, "syntax error: invalid arithmetic operator");
+}
+
+static bool
+is_op(struct parser *ps, const char *op)
+{
+    return ps->tok.kind == T_OP && strcmp(ps->tok.op, op) == 0;
+}
+
+static bool
+accept(struct parser *ps, const char *op)
+{
+    if (!is_op(ps, op))
+        return false;
+    next(ps);
+    return true;
+}
+
+/* Append an instruction, returning its index */
+static size_t
+emit(struct parser *ps, enum arith_op op, int64_t arg)
+{
+    struct arith_expr *e = ps->expr;
+    if (e->n == e->cap) {
+        e->cap = e->cap ? 2 * e->cap : 16;
+        e->code = realloc(e->code, e->cap * sizeof *e->code);
+    }
+    e->code[e->n] = (struct insn) { op, arg };
+    return e->n++;
+}
+
+/* Point the jump at 'insn' to the next instruction */
+static void
+patch(struct parser *ps, size_t insn)
+{
+    ps->expr->code[insn].arg = ps->expr->n;
+}
+
+/* The index of variable 'name' in the names of the expression */
+static int64_t
+intern(struct arith_expr *e, const char *name, size_t len)
+{
+    for (size_t i = 0; i < e->nnames; i++)
+        if (strncmp(e->names[i], name, len) == 0 && e->names[i][len] == '\0')
+            return i;
+    e->names = realloc(e->names, (e->nnames + 1) * sizeof *e->names);
+    e->names[e->nnames] = strndup(name, len);
+    return e->nnames++;
+}
+
+/* The parse functions return the variable an operand consists of, which
+ * it may be assigned to, or -1 for any other operand.  A variable was
+ * compiled to a single OP_LOAD that the caller may take back. */
+static int64_t parse_comma(struct parser *ps);
+static int64_t parse_assign(struct parser *ps);
+
+static int64_t
+parse_primary(struct parser *ps)
+{
+    struct token t = ps->tok;
+
+    if (t.kind == T_NUM) {
+        next(ps);
+        emit(ps, OP_PUSH, t.value);
+        return -1;
+    }
+    if (t.kind == T_NAME) {
+        next(ps);
+        int64_t var = intern(ps->expr, t.name, t.len);
+        if (is_op(ps, "++") || is_op(ps, "--")) {
+            if (t.dollar) {
+                fail(ps, "attempted assignment to non-variable");
+                return -1;
+            }
+            emit(ps, is_op(ps, "++") ? OP_POSTINC : OP_POSTDEC, var);
+            next(ps);
+            return -1;
+        }
+        emit(ps, OP_LOAD, var);
+        return t.dollar ? -1 : var;
+    }
+    if (accept(ps, "(")) {
+        parse_comma(ps);
+        if (!accept(ps, ")"))
+            fail(ps, "missing `)'");
+        return -1;
+    }
+    fail(ps, "syntax error: operand expected");
+    return -1;
+}
+
+static int64_t
+parse_unary(struct parser *ps)
+{
+    if (is_op(ps, "++") || is_op(ps, "--")) {
+        bool inc = is_op(ps, "++");
+        next(ps);
+        size_t start = ps->expr->n;
+        int64_t var = parse_unary(ps);
+        /* ++5 and --5 are taken for two signs, as bash does */
+        if (var >= 0) {
+            ps->expr->n = start;
+            emit(ps, inc ? OP_PREINC : OP_PREDEC, var);
+        }
+        return -1;
+    }
+
+    enum arith_op op;
+    if (is_op(ps, "-"))
+        op = OP_NEG;
+    else if (is_op(ps, "!"))
+        op = OP_NOT;
+    else if (is_op(ps, "~"))
+        op = OP_COMPL;
+    else if (is_op(ps, "+"))
+        op = OP_PUSH;           /* nothing to do */
+    else
+        return parse_primary(ps);
+
+    next(ps);
+    parse_unary(ps);
+    if (op != OP_PUSH)
+        emit(ps, op, 0);
+    return -1;
+}
+
+static const struct binop *
+find_binop(struct parser *ps)
+{
+    if (ps->tok.kind != T_OP)
+        return NULL;
+    for (size_t i = 0; i < sizeof binops / sizeof *binops; i++)
+        if (strcmp(binops[i].token, ps->tok.op) == 0)
+            return &binops[i];
+    return NULL;
+}
+
+/* Binary operators of precedence 'min' and higher */
+static int64_t
+parse_binary(struct parser *ps, int min)
+{
+    int64_t var = parse_unary(ps);
+    const struct binop *b;
+
+    while ((b = find_binop(ps)) != NULL && b->prec >= min) {
+        next(ps);
+        var = -1;
+        if (b->op == OP_JZ || b->op == OP_JNZ) {
+            /* a && b: a; JZ f; b; BOOL; JMP end; f: PUSH 0; end: */
+            size_t skip = emit(ps, b->op, 0);
+            parse_binary(ps, b->prec + 1);
+            emit(ps, OP_BOOL, 0);
+            size_t done = emit(ps, OP_JMP, 0);
+            patch(ps, skip);
+            emit(ps, OP_PUSH, b->op == OP_JNZ);
+            patch(ps, done);
+        } else {
+            parse_binary(ps, b->op == OP_POW ? b->prec : b->prec + 1);
+            emit(ps, b->op, 0);
+        }
+    }
+    return var;
+}
+
+static int64_t
+parse_cond(struct parser *ps)
+{
+    int64_t var = parse_binary(ps, 1);
+    if (!accept(ps, "?"))
+        return var;
+
+    size_t other = emit(ps, OP_JZ, 0);
+    parse_comma(ps);
+    size_t done = emit(ps, OP_JMP, 0);
+    if (!accept(ps, ":"))
+        fail(ps, "`:' expected for conditional expression");
+    patch(ps, other);
+    parse_cond(ps);
+    patch(ps, done);
+    return -1;
+}
+
+static int64_t
+parse_assign(struct parser *ps)
+{
+    size_t start = ps->expr->n;
+    int64_t var = parse_cond(ps);
+
+    const struct assignop *a = NULL;
+    for (size_t i = 0; i < sizeof assignops / sizeof *assignops; i++)
+        if (is_op(ps, assignops[i].token))
+            a = &assignops[i];
+    if (a == NULL)
+        return var;
+    if (var < 0) {
+        fail(ps, "attempted assignment to non-variable");
+        return -1;
+    }
+
+    next(ps);
+    /* a plain assignment does not read the variable */
+    if (a->op == OP_STORE)
+        ps->expr->n = start;
+    parse_assign(ps);
+    if (a->op != OP_STORE)
+        emit(ps, a->op, 0);
+    emit(ps, OP_STORE, var);
+    return -1;
+}
+
+static int64_t
+parse_comma(struct parser *ps)
+{
+    int64_t var = parse_assign(ps);
+    while (accept(ps, ",")) {
+        emit(ps, OP_POP, 0);
+        var = parse_assign(ps);
+    }
+    return var;
+}
+
+struct arith_expr *
+arith_compile(const char *text, size_t len, const char **error)
+{
+    struct parser ps = { .p = text, .end = text + len };
+
+    ps.expr = calloc(1, sizeof *ps.expr);
+    next(&ps);
+    /* $(()) is 0 */
+    if (ps.tok.kind == T_END && ps.error == NULL)
+        emit(&ps, OP_PUSH, 0);
+    else
+        parse_comma(&ps);
+    if (ps.tok.kind != T_END)
+        fail(&ps, "syntax error in expression");
+
+    if (ps.error != NULL) {
+        *error = ps.error;
+        arith_free(ps.expr);
+        return NULL;
+    }
+    return ps.expr;
+}
+
+void
+arith_free(struct arith_expr *expr)
+{
+    for (size_t i = 0; i < expr->nnames; i++)
+        free(expr->names[i]);
+    free(expr->names);
+    free(expr->code);
+    free(expr);
+}
+
+static bool run(const struct arith_expr *e, int64_t *result, int depth, const char **error);
+
+/* The value of variable 'name'.  Unset and empty variables are 0, and a
+ * value that is not a number is evaluated as an expression. */
+static bool
+value_of(const char *name, int64_t *result, int depth, const char **error)
+{
+    const char *s = var_get(name);
+    *result = 0;
+    if (s == NULL)
+        return true;
+
+    /* most values are plain numbers */
+    const char *p = s, *end = s + strlen(s);
+    while (isspace((unsigned char) *p))
+        p++;
+    bool neg = *p == '-';
+    if (*p == '-' || *p == '+')
+        p++;
+    if (p == end)
+        return true;
+    if (isdigit((unsigned char) *p) && parse_number(&p, end, result) == NULL) {
+        while (isspace((unsigned char) *p))
+            p++;
+        if (p == end) {
+            if (neg)
+                *result = (int64_t) -(uint64_t) *result;
+            return true;
+        }
+    }
+
+    if (depth >= ARITH_MAX_DEPTH) {
+        *error = "expression recursion level exceeded";
+        return false;
+    }
+    struct arith_expr *e = arith_compile(s, end - s, error);
+    if (e == NULL)
+        return false;
+    bool ok = run(e, result, depth + 1, error);
+    arith_free(e);
+    return ok;
+}
+
+static void
+assign(const char *name, int64_t value)
+{
+    char buf[24];
+    snprintf(buf, sizeof buf, "%" PRId64, value);
+    var_set(name, buf, false);
+}
+
+/* Apply binary operator 'op' to 'a' and 'b', wrapping around on overflow */
+static bool
+binary(enum arith_op op, int64_t *a, int64_t b, const char **error)
+{
+    uint64_t ua = (uint64_t) *a, ub = (uint64_t) b;
+
+    switch (op) {
+    case OP_ADD: *a = (int64_t) (ua + ub); break;
+    case OP_SUB: *a = (int64_t) (ua - ub); break;
+    case OP_MUL: *a = (int64_t) (ua * ub); break;
+    case OP_DIV:
+    case OP_MOD:
+        if (b == 0) {
+            *error = "division by 0";
+            return false;
+        }
+        /* INT64_MIN / -1 overflows */
+        if (b == -1)
+            *a = op == OP_DIV ? (int64_t) -ua : 0;
+        else
+            *a = op == OP_DIV ? *a / b : *a % b;
+        break;
+    case OP_POW:
+        if (b < 0) {
+            *error = "exponent less than 0";
+            return false;
+        }
+        for (uint64_t r = 1;; ua *= ua) {
+            if (ub & 1)
+                r *= ua;
+            ub >>= 1;
+            if (ub == 0) {
+                *a = (int64_t) r;
+                break;
+            }
+        }
+        break;
+    case OP_SHL: *a = (int64_t) (ua << (ub & 63)); break;
+    case OP_SHR: *a >>= ub & 63; break;
+    case OP_LT: *a = *a < b; break;
+    case OP_LE: *a = *a <= b; break;
+    case OP_GT: *a = *a > b; break;
+    case OP_GE: *a = *a >= b; break;
+    case OP_EQ: *a = *a == b; break;
+    case OP_NE: *a = *a != b; break;
+    case OP_AND: *a &= b; break;
+    case OP_XOR: *a ^= b; break;
+    case OP_OR: *a |= b; break;
+    default: abort();
+    }
+    return true;
+}
+
+static bool
+run(const struct arith_expr *e, int64_t *result, int depth, const char **error)
+{
+    /* no instruction runs twice, so the code length bounds the stack */
+    int64_t small[32];
+    int64_t *stack = e->n <= 32 ? small : malloc(e->n * sizeof *stack);
+    size_t sp = 0, pc = 0;
+    bool ok = true;
+
+    while (ok && pc < e->n) {
+        const struct insn *in = &e->code[pc++];
+        int64_t v, updated;
+
+        switch (in->op) {
+        case OP_PUSH:
+            stack[sp++] = in->arg;
+            break;
+        case OP_LOAD:
+            ok = value_of(e->names[in->arg], &stack[sp++], depth, error);
+            break;
+        case OP_STORE:
+            assign(e->names[in->arg], stack[sp - 1]);
+            break;
+        case OP_PREINC:
+        case OP_PREDEC:
+        case OP_POSTINC:
+        case OP_POSTDEC:
+            ok = value_of(e->names[in->arg], &v, depth, error);
+            if (!ok)
+                break;
+            updated = (int64_t) ((uint64_t) v +
+                (in->op == OP_PREINC || in->op == OP_POSTINC ? 1 : -1));
+            assign(e->names[in->arg], updated);
+            stack[sp++] = in->op == OP_PREINC || in->op == OP_PREDEC ? updated : v;
+            break;
+        case OP_POP:
+            sp--;
+            break;
+        case OP_BOOL:
+            stack[sp - 1] = stack[sp - 1] != 0;
+            break;
+        case OP_JZ:
+        case OP_JNZ:
+            v = stack[--sp];
+            if ((v == 0) == (in->op == OP_JZ))
+                pc = in->arg;
+            break;
+        case OP_JMP:
+            pc = in->arg;
+            break;
+        case OP_NEG:
+            stack[sp - 1] = (int64_t) -(uint64_t) stack[sp - 1];
+            break;
+        case OP_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+        case OP_COMPL:
+            stack[sp - 1] = ~stack[sp - 1];
+            break;
+        default:
+            sp--;
+            ok = binary(in->op, &stack[sp - 1], stack[sp], error);
+            break;
+        }
+    }
+
+    if (ok)
+        *result = stack[0];
+    if (stack != small)
+        free(stack);
+    return ok;
+}
+
+bool
+arith_eval(const struct arith_expr *expr, int64_t *result, const char **error)
+{
+    return run(expr, result, 0, error);
+}
+
+/* '*cache', created with one reference if it does not exist yet */
+static struct arith_cache *
+cache_get(struct arith_cache **cache)
+{
+    if (*cache == NULL) {
+        *cache = calloc(1, sizeof **cache);
+        (*cache)->refs = 1;
+    }
+    return *cache;
+}
+
+bool
+arith_evaluate(struct arith_cache **cache, const char *text, size_t len,
+               int64_t *result, const char **error)
+{
+    if (cache == NULL) {
+        struct arith_expr *e = arith_compile(text, len, error);
+        if (e == NULL)
+            return false;
+        bool ok = arith_eval(e, result, error);
+        arith_free(e);
+        return ok;
+    }
+
+    struct arith_cache *c = cache_get(cache);
+    for (size_t i = 0; i < c->n; i++) {
+        struct cache_entry *ce = &c->entries[i];
+        if (ce->len == len && memcmp(ce->text, text, len) == 0)
+            return arith_eval(ce->expr, result, error);
+    }
+
+    /* expressions that do not compile are not cached */
+    struct arith_expr *e = arith_compile(text, len, error);
+    if (e == NULL)
+        return false;
+    if (c->n == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 4;
+        c->entries = realloc(c->entries, c->cap * sizeof *c->entries);
+    }
+    c->entries[c->n++] = (struct cache_entry) { strndup(text, len), len, e };
+    return arith_eval(e, result, error);
+}
+
+struct arith_cache *
+arith_cache_share(struct arith_cache **cache)
+{
+    cache_get(cache)->refs++;
+    return *cache;
+}
+
+void
+arith_cache_release(struct arith_cache *cache)
+{
+    if (cache == NULL || --cache->refs > 0)
+        return;
+    for (size_t i = 0; i < cache->n; i++) {
+        free(cache->entries[i].text);
+        arith_free(cache->entries[i].expr);
+    }
+    free(cache->entries);
+    free(cache);
+}
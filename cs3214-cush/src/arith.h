@@ -0,0 +1,49 @@
+#ifndef __ARITH_H
+#define __ARITH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Arithmetic expansion, $((...)).
+ *
+ * An expression is compiled once into a small program for a stack
+ * machine and then evaluated as often as needed.  Arithmetic is done on
+ * 64-bit signed integers that wrap around, with the operators, the
+ * precedence and the number syntax (0x1f, 017, 2#1010) of bash.
+ * Variables are read from and assigned to the shell's variable table;
+ * a variable whose value is not a number is evaluated as an expression.
+ *
+ * The compiled expressions of a command are kept in an arith_cache that
+ * hangs off its AST node, so that a loop body running the same command
+ * again does not parse its expressions again.
+ */
+
+/* A compiled expression */
+struct arith_expr;
+
+/* The compiled expressions of one AST node, looked up by their text */
+struct arith_cache;
+
+/* Compile the 'len' bytes of 'text'.  Returns NULL and sets '*error' to
+ * a message if the expression is not valid. */
+struct arith_expr *arith_compile(const char *text, size_t len, const char **error);
+void arith_free(struct arith_expr *expr);
+
+/* Evaluate 'expr', assigning to variables as it says.  Returns false and
+ * sets '*error' on an error such as a division by 0. */
+bool arith_eval(const struct arith_expr *expr, int64_t *result, const char **error);
+
+/* Evaluate the 'len' bytes of 'text', taking the compiled expression
+ * from '*cache' or compiling it and adding it there.  The cache is
+ * created on first use; 'cache' may be NULL to not cache at all. */
+bool arith_evaluate(struct arith_cache **cache, const char *text, size_t len,
+                    int64_t *result, const char **error);
+
+/* Return '*cache', creating it if needed, with one more reference, for a
+ * copy of the AST node to share it.  The cache is freed when the last
+ * reference is released. */
+struct arith_cache *arith_cache_share(struct arith_cache **cache);
+void arith_cache_release(struct arith_cache *cache);
+
+#endif /* __ARITH_H */
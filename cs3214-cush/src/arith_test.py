@@ -0,0 +1,70 @@
+#!/usr/bin/python
+#
+# arith_test: tests arithmetic expansion with $((...))
+#
+# Test that expressions follow the precedence and 64-bit arithmetic of
+# bash, that they read and assign shell variables, that && and || do not
+# evaluate their right side when they need not, and that errors keep the
+# command from running
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("echo $((1 + 2 * 3)) $(( (1 + 2) * 3 )) $((-2 ** 2)) $((7 / 2)) $((-7 % 3))")
+expect("7 9 4 3 -1\r\n", "operators did not follow their precedence")
+expect_prompt("Shell did not print expected prompt ")
+
+# numbers in other bases, and 64-bit integers that wrap around
+sendline("echo $((0x1f)) $((017)) $((2#1010)) $((9223372036854775807 + 1))")
+expect("31 15 10 -9223372036854775808\r\n", "numbers were not read as bash reads them")
+expect_prompt("Shell did not print expected prompt ")
+
+# variables are read and assigned, with or without $
+sendline("x=5")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $((x++)) $((++x)) $((x += 10)) $(($x * 2)) $x")
+expect("5 7 17 34 17\r\n", "expressions did not use the shell variables")
+expect_prompt("Shell did not print expected prompt ")
+
+# a value that is an expression is evaluated, unset variables are 0
+sendline("e=x+1")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $((e * 2)) $((unset_variable + 1))")
+expect("36 1\r\n", "variable values were not evaluated")
+expect_prompt("Shell did not print expected prompt ")
+
+# the side not needed is not evaluated
+sendline("y=0")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $((0 && (y = 1))) $((1 || (y = 2))) $((y ? 10 : 20)) $y")
+expect("0 1 20 0\r\n", "&&, || or ?: evaluated the side they should skip")
+expect_prompt("Shell did not print expected prompt ")
+
+# an expression in a loop body is compiled once and evaluated each time
+sendline("n=0; for i in 1 2 3 4; do n=$((n + i * i)); done; echo sum-$n")
+expect("sum-30\r\n", "expression in a loop did not see the new values")
+expect_prompt("Shell did not print expected prompt ")
+
+# an error is reported, and the command does not run
+sendline("z=7; z=$((1 / 0)); echo z-$z-$?")
+expect("division by 0", "division by 0 was not reported")
+expect("z-7-1\r\n", "failed assignment changed the variable or succeeded")
+expect_prompt("Shell did not print expected prompt ")
+sendline("/bin/echo ran-$((1 + 1)) $((1 +)); echo status-$?")
+expect("syntax error", "syntax error was not reported")
+expect("status-1\r\n", "command with a failed expansion did not fail")
+assert "ran-2" not in testutil.console.before, "command with a failed expansion ran"
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,602 @@
+/*
+ * On-disk cache of parsed scripts, see astcache.h.
+ *
+ * A cache file holds a header, the node array and the string table.
+ * Nodes are written in preorder, each followed directly by its children:
+ *
+ *   LINE      count = number of pipelines
+ *   PIPELINE  count = number of commands,
+ *             str = input redirection, output redirection, here body
+ *   COMMAND   count = number of words, str[0] = number of procsubs
+ *   WORD      str[0] = the word
+ *   PROCSUB   str[0] = index of its word, followed by its PIPELINE
+ *   LOOP      flags = enum ast_loop_kind, count = number of words,
+ *             str[0] = variable, followed by the WORDs, the LINE of
+ *             the condition (empty for a for loop) and the LINE of the
+ *             body.  It follows a PIPELINE with PIPE_LOOP and no commands.
+ *   FUNCTION  str[0] = name, followed by the LINE of the body.  It follows
+ *             a PIPELINE with PIPE_FUNCTION and no commands.
+ *
+ * The WORDs of a command come before its PROCSUBs.  Loading maps the
+ * file, checks every count and offset against the sizes in the header,
+ * and rebuilds the command lines without running the lexer or parser.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "astcache.h"
+
+#define ASTCACHE_MAGIC   "CUSHAST"
+#define ASTCACHE_VERSION 3
+#define NOSTR            UINT32_MAX     /* offset of a NULL string */
+
+enum node_kind { NODE_LINE, NODE_PIPELINE, NODE_COMMAND, NODE_WORD, NODE_PROCSUB,
+                 NODE_LOOP, NODE_FUNCTION };
+
+/* node flags */
+#define PIPE_APPEND          1
+#define PIPE_BG              2
+#define PIPE_CONNECTOR_SHIFT 2          /* enum ast_connector, two bits */
+#define PIPE_LOOP            16
+#define PIPE_FUNCTION        32
+#define CMD_DUP_STDERR       1
+#define PROCSUB_OUTPUT       1
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nlines;
+    uint64_t dev;               /* the script this entry was made from */
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t nnodes;
+    uint32_t strtab_size;
+    uint32_t path;              /* the script's real path */
+    uint32_t unused;
+};
+
+struct node {
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t unused;
+    uint32_t count;
+    uint32_t str[3];
+};
+
+/* ------------------------------------------------------------------ */
+/* cache file names */
+
+/* FNV-1a */
+static uint64_t
+hash_path(const char *s)
+{
+    uint64_t h = 14695981039346656037ull;
+    while (*s)
+        h = (h ^ (unsigned char) *s++) * 1099511628211ull;
+    return h;
+}
+
+/* Put the cache directory into 'dir' */
+static bool
+cache_dir(char *dir, size_t len)
+{
+    const char *base;
+    int n;
+
+    if ((base = getenv("CUSH_CACHE_DIR")) && *base)
+        n = snprintf(dir, len, "%s", base);
+    else if ((base = getenv("XDG_CACHE_HOME")) && *base)
+        n = snprintf(dir, len, "%s/cush", base);
+    else if ((base = getenv("HOME")) && *base)
+        n = snprintf(dir, len, "%s/.cache/cush", base);
+    else
+        return false;
+    return n > 0 && (size_t) n < len;
+}
+
+/* Put the real path of 'script' into 'real' and the name of its cache
+ * file into 'file', both PATH_MAX bytes */
+static bool
+cache_file(const char *script, char *real, char *file)
+{
+    char dir[PATH_MAX];
+
+    if (realpath(script, real) == NULL || !cache_dir(dir, sizeof dir))
+        return false;
+    int n = snprintf(file, PATH_MAX, "%s/%016llx.ast", dir,
+                     (unsigned long long) hash_path(real));
+    return n > 0 && n < PATH_MAX;
+}
+
+static bool
+key_matches(const struct header *h, const struct stat *st)
+{
+    return h->dev == (uint64_t) st->st_dev && h->ino == (uint64_t) st->st_ino
+        && h->size == (uint64_t) st->st_size
+        && h->mtime_sec == (int64_t) st->st_mtim.tv_sec
+        && h->mtime_nsec == (int64_t) st->st_mtim.tv_nsec;
+}
+
+/* ------------------------------------------------------------------ */
+/* loading */
+
+struct reader {
+    const struct node *nodes;
+    uint32_t nnodes;
+    uint32_t next;              /* index of the next node to read */
+    const char *strtab;
+    uint32_t strtab_size;
+    bool bad;                   /* set on the first inconsistency */
+};
+
+static const struct node *
+next_node(struct reader *r, enum node_kind kind)
+{
+    if (r->bad || r->next >= r->nnodes || r->nodes[r->next].kind != kind) {
+        r->bad = true;
+        return NULL;
+    }
+    return &r->nodes[r->next++];
+}
+
+/* Return a malloc'd copy of the string at 'off', or NULL for NOSTR */
+static char *
+get_string(struct reader *r, uint32_t off)
+{
+    if (off == NOSTR)
+        return NULL;
+    if (off >= r->strtab_size) {
+        r->bad = true;
+        return NULL;
+    }
+    return strdup(r->strtab + off);
+}
+
+static struct ast_pipeline *read_pipeline(struct reader *r);
+static struct ast_command_line *read_line(struct reader *r);
+
+/* Read 'count' WORDs into a NULL terminated array */
+static char **
+read_words(struct reader *r, uint32_t count)
+{
+    char **argv = calloc(count + 1, sizeof *argv);
+    for (uint32_t i = 0; i < count; i++) {
+        const struct node *w = next_node(r, NODE_WORD);
+        if (w != NULL)
+            argv[i] = get_string(r, w->str[0]);
+        if (argv[i] == NULL) {
+            r->bad = true;
+            for (uint32_t j = 0; j < i; j++)
+                free(argv[j]);
+            free(argv);
+            return NULL;
+        }
+    }
+    return argv;
+}
+
+static void
+free_words(char **words)
+{
+    if (words == NULL)
+        return;
+    for (char **p = words; *p; p++)
+        free(*p);
+    free(words);
+}
+
+static struct ast_loop *
+read_loop(struct reader *r)
+{
+    const struct node *n = next_node(r, NODE_LOOP);
+    if (n == NULL || n->count > r->nnodes || n->flags > AST_UNTIL) {
+        r->bad = true;
+        return NULL;
+    }
+
+    enum ast_loop_kind kind = n->flags;
+    char *var = get_string(r, n->str[0]);
+    char **words = read_words(r, n->count);
+    struct ast_command_line *cond = read_line(r);
+    struct ast_command_line *body = read_line(r);
+    /* only a for loop has a variable */
+    if ((kind == AST_FOR) != (var != NULL))
+        r->bad = true;
+    if (r->bad) {
+        free(var);
+        free_words(words);
+        if (cond)
+            ast_command_line_free(cond);
+        if (body)
+            ast_command_line_free(body);
+        return NULL;
+    }
+    if (kind == AST_FOR) {
+        ast_command_line_free(cond);
+        cond = NULL;
+    } else {
+        free_words(words);
+        words = NULL;
+    }
+    return ast_loop_create(kind, var, words, cond, body);
+}
+
+static struct ast_function *
+read_function(struct reader *r)
+{
+    const struct node *n = next_node(r, NODE_FUNCTION);
+    char *name = n ? get_string(r, n->str[0]) : NULL;
+    struct ast_command_line *body = name ? read_line(r) : NULL;
+    if (body == NULL) {
+        r->bad = true;
+        free(name);
+        return NULL;
+    }
+    return ast_function_create(name, body);
+}
+
+static struct ast_command *
+read_command(struct reader *r)
+{
+    const struct node *n = next_node(r, NODE_COMMAND);
+    /* every node takes one slot, which bounds the counts */
+    if (n == NULL || n->count == 0 || n->count > r->nnodes || n->str[0] > r->nnodes) {
+        r->bad = true;
+        return NULL;
+    }
+
+    char **argv = read_words(r, n->count);
+    if (argv == NULL)
+        return NULL;
+
+    struct ast_command *cmd = ast_command_create(argv, n->flags & CMD_DUP_STDERR);
+    for (uint32_t i = 0; i < n->str[0]; i++) {
+        const struct node *p = next_node(r, NODE_PROCSUB);
+        struct ast_pipeline *pipe = p ? read_pipeline(r) : NULL;
+        if (pipe == NULL) {
+            ast_command_free(cmd);
+            return NULL;
+        }
+        struct ast_procsub *ps = ast_procsub_create(pipe, p->flags & PROCSUB_OUTPUT);
+        ps->argidx = p->str[0];
+        list_push_back(&cmd->procsubs, &ps->elem);
+    }
+    return cmd;
+}
+
+static struct ast_pipeline *
+read_pipeline(struct reader *r)
+{
+    const struct node *n = next_node(r, NODE_PIPELINE);
+    /* a loop or function has no commands, anything else at least one */
+    if (n == NULL || (n->count == 0) != !!(n->flags & (PIPE_LOOP | PIPE_FUNCTION))
+        || (n->flags & PIPE_LOOP && n->flags & PIPE_FUNCTION) || n->count > r->nnodes) {
+        r->bad = true;
+        return NULL;
+    }
+
+    struct ast_pipeline *pipe = ast_pipeline_create(get_string(r, n->str[0]),
+                                                    get_string(r, n->str[1]),
+                                                    n->flags & PIPE_APPEND);
+    pipe->here_body = get_string(r, n->str[2]);
+    pipe->bg_job = n->flags & PIPE_BG;
+    pipe->connector = (n->flags >> PIPE_CONNECTOR_SHIFT) & 3;
+    if (n->flags & PIPE_LOOP)
+        pipe->loop = read_loop(r);
+    if (n->flags & PIPE_FUNCTION)
+        pipe->func = read_function(r);
+
+    for (uint32_t i = 0; i < n->count && !r->bad; i++) {
+        struct ast_command *cmd = read_command(r);
+        if (cmd != NULL)
+            ast_pipeline_add_command(pipe, cmd);
+    }
+    if (r->bad) {
+        ast_pipeline_free(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+static struct ast_command_line *
+read_line(struct reader *r)
+{
+    const struct node *n = next_node(r, NODE_LINE);
+    if (n == NULL)
+        return NULL;
+
+    struct ast_command_line *line = ast_command_line_create_empty();
+    for (uint32_t i = 0; i < n->count && !r->bad; i++) {
+        struct ast_pipeline *pipe = read_pipeline(r);
+        if (pipe != NULL)
+            list_push_back(&line->pipes, &pipe->elem);
+    }
+    if (r->bad) {
+        ast_command_line_free(line);
+        return NULL;
+    }
+    return line;
+}
+
+/* Rebuild the command lines from a mapped cache file of 'len' bytes */
+static struct ast_command_line **
+decode(const char *map, size_t len, const char *real, const struct stat *st,
+       size_t *count)
+{
+    const struct header *h = (const struct header *) map;
+    if (memcmp(h->magic, ASTCACHE_MAGIC, sizeof h->magic) != 0
+        || h->version != ASTCACHE_VERSION || !key_matches(h, st)
+        || h->strtab_size == 0
+        || len != sizeof *h + (size_t) h->nnodes * sizeof(struct node) + h->strtab_size
+        || h->nlines > h->nnodes)
+        return NULL;
+
+    struct reader r = {
+        .nodes = (const struct node *) (map + sizeof *h),
+        .nnodes = h->nnodes,
+        .strtab = map + sizeof *h + (size_t) h->nnodes * sizeof(struct node),
+        .strtab_size = h->strtab_size,
+    };
+    /* every string ends inside the table, and an entry for a different
+     * script whose path hashes the same is not used */
+    if (r.strtab[r.strtab_size - 1] != '\0' || h->path >= r.strtab_size
+        || strcmp(r.strtab + h->path, real) != 0)
+        return NULL;
+
+    struct ast_command_line **lines = malloc((h->nlines + 1) * sizeof *lines);
+    uint32_t i;
+    for (i = 0; i < h->nlines; i++) {
+        if ((lines[i] = read_line(&r)) == NULL)
+            break;
+    }
+    if (r.bad || i < h->nlines || r.next != r.nnodes) {
+        while (i > 0)
+            ast_command_line_free(lines[--i]);
+        free(lines);
+        return NULL;
+    }
+    *count = h->nlines;
+    return lines;
+}
+
+struct ast_command_line **
+astcache_load(const char *path, const struct stat *st, size_t *count)
+{
+    char real[PATH_MAX], file[PATH_MAX];
+    if (!cache_file(path, real, file))
+        return NULL;
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct stat cst;
+    if (fstat(fd, &cst) < 0 || (size_t) cst.st_size < sizeof(struct header)) {
+        close(fd);
+        return NULL;
+    }
+    char *map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    struct ast_command_line **lines = decode(map, cst.st_size, real, st, count);
+    munmap(map, cst.st_size);
+    return lines;
+}
+
+/* ------------------------------------------------------------------ */
+/* storing */
+
+struct writer {
+    struct node *nodes;
+    size_t nnodes, nodes_cap;
+    char *strtab;
+    size_t strtab_size, strtab_cap;
+};
+
+/* Append a node and return its index; the array may move */
+static size_t
+add_node(struct writer *w, enum node_kind kind, int flags, uint32_t count)
+{
+    if (w->nnodes == w->nodes_cap) {
+        w->nodes_cap = 2 * w->nodes_cap + 64;
+        w->nodes = realloc(w->nodes, w->nodes_cap * sizeof *w->nodes);
+    }
+    struct node *n = &w->nodes[w->nnodes];
+    memset(n, 0, sizeof *n);
+    n->kind = kind;
+    n->flags = flags;
+    n->count = count;
+    n->str[0] = n->str[1] = n->str[2] = NOSTR;
+    return w->nnodes++;
+}
+
+static uint32_t
+add_string(struct writer *w, const char *s)
+{
+    if (s == NULL)
+        return NOSTR;
+
+    size_t len = strlen(s) + 1;
+    if (w->strtab_size + len > w->strtab_cap) {
+        w->strtab_cap = 2 * (w->strtab_size + len) + 256;
+        w->strtab = realloc(w->strtab, w->strtab_cap);
+    }
+    memcpy(w->strtab + w->strtab_size, s, len);
+    w->strtab_size += len;
+    return w->strtab_size - len;
+}
+
+static void write_line(struct writer *w, struct ast_command_line *line);
+
+static void
+write_words(struct writer *w, char **words, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        size_t n = add_node(w, NODE_WORD, 0, 0);
+        w->nodes[n].str[0] = add_string(w, words[i]);
+    }
+}
+
+static uint32_t
+count_words(char **words)
+{
+    uint32_t n = 0;
+    while (words && words[n])
+        n++;
+    return n;
+}
+
+static void
+write_loop(struct writer *w, struct ast_loop *loop)
+{
+    uint32_t nwords = count_words(loop->words);
+    size_t n = add_node(w, NODE_LOOP, loop->kind, nwords);
+    w->nodes[n].str[0] = add_string(w, loop->var);
+    write_words(w, loop->words, nwords);
+    if (loop->cond)
+        write_line(w, loop->cond);
+    else
+        add_node(w, NODE_LINE, 0, 0);
+    write_line(w, loop->body);
+}
+
+static void
+write_pipeline(struct writer *w, struct ast_pipeline *pipe)
+{
+    int flags = (pipe->append_to_output ? PIPE_APPEND : 0)
+              | (pipe->bg_job ? PIPE_BG : 0)
+              | (pipe->loop ? PIPE_LOOP : 0)
+              | (pipe->func ? PIPE_FUNCTION : 0)
+              | pipe->connector << PIPE_CONNECTOR_SHIFT;
+    size_t p = add_node(w, NODE_PIPELINE, flags, list_size(&pipe->commands));
+    w->nodes[p].str[0] = add_string(w, pipe->iored_input);
+    w->nodes[p].str[1] = add_string(w, pipe->iored_output);
+    w->nodes[p].str[2] = add_string(w, pipe->here_body);
+    if (pipe->loop)
+        write_loop(w, pipe->loop);
+    if (pipe->func) {
+        size_t n = add_node(w, NODE_FUNCTION, 0, 0);
+        w->nodes[n].str[0] = add_string(w, pipe->func->name);
+        write_line(w, pipe->func->body);
+    }
+
+    for (struct list_elem * e = list_begin(&pipe->commands);
+         e != list_end(&pipe->commands);
+         e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        uint32_t nwords = count_words(cmd->argv);
+
+        size_t c = add_node(w, NODE_COMMAND,
+                            cmd->dup_stderr_to_stdout ? CMD_DUP_STDERR : 0, nwords);
+        w->nodes[c].str[0] = list_size(&cmd->procsubs);
+        write_words(w, cmd->argv, nwords);
+        for (struct list_elem * f = list_begin(&cmd->procsubs);
+             f != list_end(&cmd->procsubs);
+             f = list_next(f)) {
+            struct ast_procsub *ps = list_entry(f, struct ast_procsub, elem);
+            size_t n = add_node(w, NODE_PROCSUB, ps->is_output ? PROCSUB_OUTPUT : 0, 0);
+            w->nodes[n].str[0] = ps->argidx;
+            write_pipeline(w, ps->pipe);
+        }
+    }
+}
+
+static void
+write_line(struct writer *w, struct ast_command_line *line)
+{
+    add_node(w, NODE_LINE, 0, list_size(&line->pipes));
+    for (struct list_elem * e = list_begin(&line->pipes);
+         e != list_end(&line->pipes);
+         e = list_next(e))
+        write_pipeline(w, list_entry(e, struct ast_pipeline, elem));
+}
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* mkdir -p */
+static void
+make_dirs(char *dir)
+{
+    for (char *s = strchr(dir + 1, '/'); s != NULL; s = strchr(s + 1, '/')) {
+        *s = '\0';
+        mkdir(dir, 0700);
+        *s = '/';
+    }
+    mkdir(dir, 0700);
+}
+
+void
+astcache_store(const char *path, const struct stat *st,
+               struct ast_command_line **lines, size_t count)
+{
+    char real[PATH_MAX], file[PATH_MAX], dir[PATH_MAX], tmp[PATH_MAX + 32];
+    if (!cache_file(path, real, file) || !cache_dir(dir, sizeof dir))
+        return;
+
+    struct writer w = { 0 };
+    uint32_t real_off = add_string(&w, real);
+    for (size_t i = 0; i < count; i++)
+        write_line(&w, lines[i]);
+
+    struct header h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, ASTCACHE_MAGIC, sizeof h.magic);
+    h.version = ASTCACHE_VERSION;
+    h.nlines = count;
+    h.dev = st->st_dev;
+    h.ino = st->st_ino;
+    h.size = st->st_size;
+    h.mtime_sec = st->st_mtim.tv_sec;
+    h.mtime_nsec = st->st_mtim.tv_nsec;
+    h.nnodes = w.nnodes;
+    h.strtab_size = w.strtab_size;
+    h.path = real_off;
+
+    /* offsets are 32 bits */
+    if (count >= UINT32_MAX || w.nnodes >= UINT32_MAX || w.strtab_size >= UINT32_MAX)
+        goto out;
+
+    /* write a private file and rename it, so readers never see a
+     * partial entry */
+    make_dirs(dir);
+    snprintf(tmp, sizeof tmp, "%s.%d.tmp", file, (int) getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        goto out;
+    bool ok = write_all(fd, &h, sizeof h)
+           && write_all(fd, w.nodes, w.nnodes * sizeof *w.nodes)
+           && write_all(fd, w.strtab, w.strtab_size);
+    close(fd);
+    if (!ok || rename(tmp, file) < 0)
+        unlink(tmp);
+out:
+    free(w.nodes);
+    free(w.strtab);
+}
@@ -0,0 +1,31 @@
+#ifndef __ASTCACHE_H
+#define __ASTCACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "shell-ast.h"
+
+/* On-disk cache of parsed scripts.
+ *
+ * The command lines of a script are stored as a flat array of nodes in
+ * preorder plus a string table, with strings referred to by offset, so
+ * a cache file can be used wherever it is mapped.  Entries live in the
+ * cache directory ($CUSH_CACHE_DIR, else $XDG_CACHE_HOME/cush, else
+ * ~/.cache/cush) under a name derived from the script's path, and are
+ * only used if the script's device, inode, mtime and size still match.
+ */
+
+/* Load the command lines of script 'path', whose current status is 'st',
+ * with a single mmap of its cache entry.  Returns a malloc'd array of
+ * '*count' command lines, or NULL if there is no valid entry. */
+struct ast_command_line **astcache_load(const char *path, const struct stat *st,
+                                        size_t *count);
+
+/* Store the 'count' command lines of script 'path' in the cache.
+ * Here-document bodies must have been read already.  Failures are
+ * silently ignored, the cache is only an optimization. */
+void astcache_store(const char *path, const struct stat *st,
+                    struct ast_command_line **lines, size_t count);
+
+#endif /* __ASTCACHE_H */
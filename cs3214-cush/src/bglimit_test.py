@@ -0,0 +1,63 @@
+#!/usr/bin/python
+#
+# bglimit_test: tests the bglimit command
+# 
+# Test that background jobs over the limit are queued, started
+# when a running job is reaped, and promoted by fg
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# allow only one background job at a time
+sendline("bglimit 1")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("sleep 1 &")
+bg = parse_bg_status()
+expect_prompt("Shell did not print expected prompt ")
+
+# the second job has to wait for the first one
+sendline("sleep 1 &")
+expect("\[(\d+)\] queued", "job over the limit was not queued")
+expect_prompt("Shell did not print expected prompt ")
+
+run_builtin('jobs')
+expect("Running", "first job is not running")
+expect("Queued", "second job is not shown as queued")
+expect_prompt("Shell did not print expected prompt ")
+
+# once the first job is reaped the queued one is started
+time.sleep(1.5)
+run_builtin('jobs')
+expect("Running\s+\(sleep 1\)", "queued job was not started")
+expect_prompt("Shell did not print expected prompt ")
+
+# fg promotes a queued job and runs it right away
+time.sleep(1)
+sendline("sleep 30 &")
+parse_bg_status()
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo promoted &")
+jid = expect_regex("\[(\d+)\] queued")[0]
+expect_prompt("Shell did not print expected prompt ")
+run_builtin('fg', jid)
+expect("promoted", "queued job was not promoted by fg")
+expect_prompt("Shell did not print expected prompt ")
+
+# fg and bg without a job, or with one that does not exist, fail
+for cmd in ["fg", "fg %99", "bg", "bg 99"]:
+    sendline(cmd + "; echo status $?")
+    expect(cmd.split()[0] + ": no such job\r\nstatus 1\r\n", cmd + " did not fail")
+    expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,260 @@
+/*
+ * Completion index.
+ *
+ * Each kind of word has its own trie.  A node records, as a bit mask,
+ * which sources contain the word ending at it: bit i stands for the
+ * i-th PATH directory and OWNER_BUILTIN for the builtins, so a command
+ * removed from one directory stays known while another still has it.
+ * Nodes are never freed; removing a word only clears its bit.
+ *
+ * The tries are shared between the main thread, which completes, and
+ * the indexer thread, which scans and watches PATH, under one mutex.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "completion.h"
+#include "utils.h"
+
+#define MAX_PATH_DIRS   63
+#define OWNER_BUILTIN   (1ull << 63)
+#define OWNER_HISTORY   1ull
+
+struct trie_node {
+    uint64_t owners;                /* sources of the word ending here */
+    unsigned char nchildren;
+    unsigned char capacity;
+    unsigned char *keys;            /* sorted */
+    struct trie_node **children;
+};
+
+static struct trie_node roots[COMPLETE_NKINDS];
+static pthread_mutex_t trie_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the directories of PATH, indexed by their owner bit */
+static char *path_dirs[MAX_PATH_DIRS];
+static int path_wds[MAX_PATH_DIRS];
+static int npath_dirs;
+
+/* Return the child of 'node' for 'key', creating it if 'create' is set */
+static struct trie_node *
+child(struct trie_node *node, unsigned char key, bool create)
+{
+    int lo = 0, hi = node->nchildren;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < node->nchildren && node->keys[lo] == key)
+        return node->children[lo];
+    if (!create)
+        return NULL;
+
+    if (node->nchildren == node->capacity) {
+        /* a node has at most 255 children since keys are never NUL */
+        int cap = node->capacity ? node->capacity * 2 : 2;
+        node->capacity = cap > 255 ? 255 : cap;
+        node->keys = realloc(node->keys, node->capacity);
+        node->children = realloc(node->children, node->capacity * sizeof *node->children);
+    }
+    memmove(node->keys + lo + 1, node->keys + lo, node->nchildren - lo);
+    memmove(node->children + lo + 1, node->children + lo,
+            (node->nchildren - lo) * sizeof *node->children);
+    node->keys[lo] = key;
+    node->children[lo] = calloc(1, sizeof (struct trie_node));
+    node->nchildren++;
+    return node->children[lo];
+}
+
+/* Set or clear 'owner' for 'word'.  Caller holds trie_lock. */
+static void
+trie_update(struct trie_node *root, const char *word, uint64_t owner, bool present)
+{
+    struct trie_node *node = root;
+    for (const unsigned char *p = (const unsigned char *) word; *p && node; p++)
+        node = child(node, *p, present);
+    if (node == NULL)
+        return;
+    if (present)
+        node->owners |= owner;
+    else
+        node->owners &= ~owner;
+}
+
+struct match_list {
+    char **words;
+    size_t count, capacity;
+};
+
+/* Append every word below 'node', whose prefix is buf[0..len), to 'out' */
+static void
+collect(struct trie_node *node, char *buf, size_t len, size_t bufsize, struct match_list *out)
+{
+    if (node->owners) {
+        if (out->count + 1 >= out->capacity) {
+            out->capacity *= 2;
+            out->words = realloc(out->words, out->capacity * sizeof *out->words);
+        }
+        out->words[out->count++] = strndup(buf, len);
+    }
+    if (len + 1 >= bufsize)
+        return;
+    for (int i = 0; i < node->nchildren; i++) {
+        buf[len] = node->keys[i];
+        collect(node->children[i], buf, len + 1, bufsize, out);
+    }
+}
+
+char **
+complete_matches(enum complete_kind kind, const char *prefix, size_t *count)
+{
+    struct match_list out = { malloc(16 * sizeof (char *)), 0, 16 };
+    char buf[NAME_MAX + 1];
+    size_t len = strlen(prefix);
+
+    pthread_mutex_lock(&trie_lock);
+    struct trie_node *node = &roots[kind];
+    for (const unsigned char *p = (const unsigned char *) prefix; *p && node; p++)
+        node = child(node, *p, false);
+    if (node && len < sizeof buf) {
+        memcpy(buf, prefix, len);
+        collect(node, buf, len, sizeof buf, &out);
+    }
+    pthread_mutex_unlock(&trie_lock);
+
+    out.words[out.count] = NULL;
+    if (count)
+        *count = out.count;
+    return out.words;
+}
+
+void
+complete_add(enum complete_kind kind, const char *word)
+{
+    pthread_mutex_lock(&trie_lock);
+    trie_update(&roots[kind], word,
+                kind == COMPLETE_COMMAND ? OWNER_BUILTIN : OWNER_HISTORY, true);
+    pthread_mutex_unlock(&trie_lock);
+}
+
+/* Return true if 'name' in the directory open at 'dirfd' is an
+ * executable file */
+static bool
+is_executable(int dirfd, const char *name)
+{
+    struct stat st;
+    return fstatat(dirfd, name, &st, 0) == 0 && !S_ISDIR(st.st_mode)
+        && faccessat(dirfd, name, X_OK, 0) == 0;
+}
+
+/* Index the executables in PATH directory 'i' */
+static void
+scan_dir(int i)
+{
+    DIR *dir = opendir(path_dirs[i]);
+    if (dir == NULL)
+        return;
+
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL) {
+        if (d->d_name[0] == '.' || d->d_type == DT_DIR)
+            continue;
+        if (!is_executable(dirfd(dir), d->d_name))
+            continue;
+        pthread_mutex_lock(&trie_lock);
+        trie_update(&roots[COMPLETE_COMMAND], d->d_name, 1ull << i, true);
+        pthread_mutex_unlock(&trie_lock);
+    }
+    closedir(dir);
+}
+
+/* Apply one inotify event to the index */
+static void
+handle_event(const struct inotify_event *ev)
+{
+    int i;
+    for (i = 0; i < npath_dirs; i++)
+        if (path_wds[i] == ev->wd)
+            break;
+    if (i == npath_dirs || ev->len == 0)
+        return;
+
+    bool present = false;
+    if (ev->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE)) {
+        int fd = open(path_dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd != -1) {
+            present = is_executable(fd, ev->name);
+            close(fd);
+        }
+    }
+    pthread_mutex_lock(&trie_lock);
+    trie_update(&roots[COMPLETE_COMMAND], ev->name, 1ull << i, present);
+    pthread_mutex_unlock(&trie_lock);
+}
+
+/* Body of the indexer thread: watch, then scan, then follow changes */
+static void *
+indexer(void *arg)
+{
+    (void) arg;
+    int ifd = inotify_init1(IN_CLOEXEC);
+
+    /* watch before scanning so nothing created in between is missed */
+    for (int i = 0; i < npath_dirs; i++) {
+        path_wds[i] = ifd == -1 ? -1 :
+            inotify_add_watch(ifd, path_dirs[i], IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                              | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | IN_ONLYDIR);
+        scan_dir(i);
+    }
+    if (ifd == -1)
+        return NULL;
+
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(ifd, buf, sizeof buf);
+        if (n <= 0)
+            break;
+        for (char *p = buf; p < buf + n;) {
+            struct inotify_event *ev = (struct inotify_event *) p;
+            handle_event(ev);
+            p += sizeof *ev + ev->len;
+        }
+    }
+    close(ifd);
+    return NULL;
+}
+
+void
+complete_start(const char *path, const char *const *builtins)
+{
+    for (const char *const *b = builtins; *b; b++)
+        complete_add(COMPLETE_COMMAND, *b);
+
+    /* split PATH; an empty entry means the current directory, which
+     * changes too often to be worth indexing */
+    char *copy = strdup(path ? path : "");
+    for (char *dir = strtok(copy, ":"); dir && npath_dirs < MAX_PATH_DIRS; dir = strtok(NULL, ":")) {
+        bool seen = false;
+        for (int i = 0; i < npath_dirs; i++)
+            seen |= strcmp(path_dirs[i], dir) == 0;
+        if (!seen && dir[0] == '/')
+            path_dirs[npath_dirs++] = strdup(dir);
+    }
+    free(copy);
+
+    utils_start_thread(indexer, NULL);
+}
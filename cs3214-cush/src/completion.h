@@ -0,0 +1,33 @@
+#ifndef __COMPLETION_H
+#define __COMPLETION_H
+
+#include <stddef.h>
+
+/* An index of words for tab completion.
+ *
+ * Command names (the executables found in PATH and the builtins) and
+ * words seen in the history are kept in prefix tries.  The executables
+ * are indexed by a background thread, which then keeps the index up to
+ * date with inotify, so a completion never scans a directory.
+ */
+
+enum complete_kind {
+    COMPLETE_COMMAND,       /* executables in PATH and builtins */
+    COMPLETE_HISTORY,       /* words from earlier command lines */
+    COMPLETE_NKINDS
+};
+
+/* Index the builtin names in the NULL terminated array 'builtins' and
+ * start the thread that indexes and watches the directories in 'path'
+ * (a PATH-style list).  Returns immediately. */
+void complete_start(const char *path, const char *const *builtins);
+
+/* Add 'word' to the index for 'kind' */
+void complete_add(enum complete_kind kind, const char *word);
+
+/* Return a malloc'd, NULL terminated array of malloc'd copies of the
+ * words of 'kind' that start with 'prefix', in sorted order.
+ * The number of words is stored in 'count' if it is not NULL. */
+char **complete_matches(enum complete_kind kind, const char *prefix, size_t *count);
+
+#endif /* __COMPLETION_H */
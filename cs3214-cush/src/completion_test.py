@@ -0,0 +1,57 @@
+#!/usr/bin/python
+#
+# completion_test: tests tab completion
+# 
+# Test that Tab completes builtins, executables in PATH including ones
+# created after the shell started, job specs and words from the history
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutil import *
+
+# a PATH directory the test adds a command to while the shell runs
+bindir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, bindir)
+os.environ["PATH"] = bindir + ":" + os.environ["PATH"]
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# builtins
+sendline("bglim\t")
+expect("unlimited", "builtin name was not completed")
+expect_prompt("Shell did not print expected prompt ")
+
+# a command created after the shell started
+cmd = os.path.join(bindir, "cushcompletiontestcmd")
+f = open(cmd, "w")
+f.write("#!/bin/sh\necho new command ran\n")
+f.close()
+os.chmod(cmd, 0755)
+time.sleep(0.5)
+sendline("cushcompletiontest\t")
+expect("new command ran", "new executable in PATH was not completed")
+expect_prompt("Shell did not print expected prompt ")
+
+# job specs
+sendline("sleep 30 &")
+expect("\[1\] [0-9]+", "background job was not started")
+expect_prompt("Shell did not print expected prompt ")
+sendline("kill %\t")
+expect("killed", "job spec was not completed")
+
+# words from the history
+sendline("echo distinctivehistoryword")
+expect("distinctivehistoryword", "echo did not run")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo distinctivehist\t| tr a-z A-Z")
+expect("DISTINCTIVEHISTORYWORD", "history word was not completed")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,78 @@
+#!/usr/bin/python
+#
+# cond_test: tests the && and || operators
+# 
+# Test that a pipeline after && runs only if the one before succeeded,
+# a pipeline after || only if it failed, that skipped pipelines are
+# never started, and that builtins take part in the chain
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("true && echo and-ran")
+expect("and-ran\r\n", "&& did not run after success")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("false || echo or-ran")
+expect("or-ran\r\n", "|| did not run after failure")
+expect_prompt("Shell did not print expected prompt ")
+
+# a skipped pipeline keeps the status, so the || runs
+sendline("false && echo wrong || echo chain-ran")
+expect("chain-ran\r\n", "a && b || c did not run c")
+expect_prompt("Shell did not print expected prompt ")
+assert "wrong" not in testutil.console.before, "&& ran after failure"
+
+# skipped pipelines are not started at all
+start = time.time()
+sendline("true || sleep 5")
+expect_prompt("Shell did not print expected prompt ")
+sendline("false && sleep 5")
+expect_prompt("Shell did not print expected prompt ")
+assert time.time() - start < 2, "skipped pipeline was run"
+
+# the status of the last command of a pipeline decides
+sendline("false | true && echo pipe-ran")
+expect("pipe-ran\r\n", "status of the pipeline was not taken from its last command")
+expect_prompt("Shell did not print expected prompt ")
+
+# builtins set the status and do not end the command line
+sendline("cd /nonexistent-directory || echo cd-failed")
+expect("cd-failed\r\n", "failed builtin did not set the status")
+expect_prompt("Shell did not print expected prompt ")
+sendline("cd / && echo cd-ok; echo after")
+expect("cd-ok\r\nafter\r\n", "commands after a builtin did not run")
+expect_prompt("Shell did not print expected prompt ")
+
+# a missing pipeline is an error
+sendline("echo x &&")
+expect("Invalid null command", "missing pipeline after && was not reported")
+expect_prompt("Shell did not print expected prompt ")
+
+# a chain cannot be put in the background, and a background job cannot
+# be chained; neither runs any part of the command line
+start = time.time()
+sendline("false && sleep 10 &")
+expect_exact("Cannot run a && or || chain in the background", "backgrounded chain was accepted")
+expect_prompt("Shell did not print expected prompt ")
+assert time.time() - start < 2, "part of a backgrounded chain ran in the foreground"
+sendline("echo ran-bg & || echo ran-or")
+expect_exact("Cannot run a && or || chain in the background", "chained background job was accepted")
+expect_prompt("Shell did not print expected prompt ")
+assert "ran-" not in testutil.console.before, "part of a refused command line ran"
+sendline("jobs")
+expect_prompt("Shell did not print expected prompt ")
+assert "sleep" not in testutil.console.before, "part of a refused command line was started"
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -4,13 +4,25 @@
  * Developed by Godmar Back for CS 3214 Summer 2020 
  * Virginia Tech.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <readline/readline.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
 #include <termios.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <time.h>
 
 /* Since the handed out code contains a number of unused functions. */
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -19,22 +31,71 @@
 #include "signal_support.h"
 #include "shell-ast.h"
 #include "utils.h"
+#include "stats.h"
+#include "jobsched.h"
+#include "joblimits.h"
+#include "variables.h"
+#include "pathglob.h"
+#include "completion.h"
+#include "prompt.h"
+#include "astcache.h"
+#include "readbuf.h"
+#include "arith.h"
+#include "functions.h"
+#include "server.h"
+#include "zygote.h"
+#include "jobout.h"
+#include "jobtimeout.h"
+#include "timerwheel.h"
 
 static void
 usage(char *progname)
 {
-    printf("Usage: %s -h\n"
-           " -h            print this help\n",
+    printf("Usage: %s [-h] [-n] [-z] [--server socket | script [args...]]\n"
+           " -h            print this help\n"
+           " -n            read commands without running them\n"
+           " -z            start commands from a zygote process\n"
+           " --server socket\n"
+           "               run the command lines sent to socket by cushc\n",
            progname);
 
     exit(EXIT_SUCCESS);
 }
 
+int countActiveJobs(void);
+char *takeFinishedJobs(size_t *len);
+
 /* Build a prompt */
-static char *
+static const char *
 build_prompt(void)
 {
-    return strdup("cush> ");
+    /*PS1 holds the template, see prompt.h for its segments*/
+    return prompt_render(var_get("PS1"), countActiveJobs(), var_status());
+}
+
+/*Called by readline while it waits for input: draws the prompt again
+when the worker has fresher values for it*/
+static int
+refreshPrompt(void)
+{
+    /*Jobs that finished while we wait: print their Done notices above
+    the input line and redraw it with the new job count*/
+    /*the timers of "every" run from here while the shell waits for input*/
+    timerwheel_advance();
+    size_t len = 0;
+    char *notices = takeFinishedJobs(&len);
+    if (notices != NULL || prompt_changed())
+    {
+        /*the redraw starts from the beginning of a cleared line*/
+        rl_clear_visible_line();
+        fflush(rl_outstream);
+        if (len > 0 && write(1, notices, len) < 0)
+            perror("write");
+        free(notices);
+        rl_set_prompt(build_prompt());
+        rl_forced_update_display();
+    }
+    return 0;
 }
 
 enum job_status
@@ -45,8 +106,23 @@ enum job_status
     STOPPED,       /* job is stopped via SIGSTOP */
     NEEDSTERMINAL, /* job is stopped because it was a background job
                        and requires exclusive terminal access */
+    QUEUED,        /* background job waiting for a free slot under
+                       the background job limit; not yet forked */
 };
 
+/*Events the SIGCHLD handler records for a job. It does not print them
+itself: they are reported with the Done notices by takeFinishedJobs, or
+right after a foreground job by fprintNotices*/
+enum job_notice
+{
+    NOTICE_STOPPED = 1,  /* the job stopped */
+    NOTICE_SIGNALED = 2, /* a process of the job was killed by termSignal */
+    NOTICE_TIMEDOUT = 4, /* the job ended after its deadline expired */
+};
+
+/*Maximum number of processes in one job, including process substitutions*/
+#define MAXPROCS 64
+
 struct job
 {
     struct list_elem elem;          /* Link element for jobs list. */
@@ -60,7 +136,37 @@ struct job
     bool isFinished;                /* determines weather the job is finished or not */
     bool wasKilled;                 /* determines weather the job was killed by a kill signal or not*/
     int totalProc;                  /*Number of total processes the job ever had*/
-    int pids[10];                   /* pids of processes in this job group */
+    int pids[MAXPROCS];             /* pids of processes in this job group */
+    int lastPid;                    /* pid of the last command of the pipeline */
+    uint64_t startTime;             /* stats_now() when the job was added */
+    int exitStatus;                 /* exit status of the last command, 128+sig if killed */
+    int outFd;                      /* if >= 0, stdout and stderr of the job go here */
+    bool reportDone;                /* print Done when the job finishes in background */
+    struct list_elem queueElem;     /* Link element for the queue of QUEUED jobs */
+    struct list_elem finishedElem;  /* Link element for finished_list once isFinished is set */
+    unsigned waitGeneration;        /* equals waitGeneration while the wait builtin waits for it */
+    struct jobsched sched;          /* CPU affinity, nice and I/O priority of the job */
+    bool deprioritized;             /* true while lowered by the background sched policy */
+    struct joblimits limits;        /* resource limits of every process in the job */
+    double timeout;                 /* seconds the job may run, 0 for no limit */
+    double killAfter;               /* seconds from SIGTERM to SIGKILL once it is up */
+    struct jobtimeout *deadline;    /* the running deadline, see jobtimeout.h */
+    struct list_elem noticeElem;    /* Link element for notice_list while notices is set */
+    unsigned notices;               /* job_notice events not reported yet */
+    int termSignal;                 /* signal that killed a process of the job */
+    double termCpu;                 /* CPU seconds that process had used */
+    unsigned long serial;           /* unique among all jobs ever added, unlike jid */
+};
+
+/*Settings given by prefix commands such as "sched -n 10 make" that apply
+to the job they precede*/
+struct job_prefix
+{
+    struct jobsched sched;    /* settings given with sched */
+    struct joblimits limits;  /* limits given with limit */
+    double timeout;           /* seconds given with timeout, 0 if none */
+    double killAfter;         /* timeout -k */
+    const char *name;         /* the first prefix, NULL if there was none */
 };
 
 struct history
@@ -82,21 +188,119 @@ char homeDir[1024];
 #define MAXJOBS (1 << 16)
 static struct list job_list;
 static struct list history_list;
+/*Background jobs waiting for a free slot, in the order they were started*/
+static struct list queued_list;
+/*Jobs that have finished but have not been deleted yet, in the order they
+finished. Filled by the SIGCHLD handler so cleanup never walks job_list*/
+static struct list finished_list;
+/*Jobs with events that the SIGCHLD handler recorded for reporting*/
+static struct list notice_list;
+/*State of the wait builtin: the jobs it waits for carry the current
+generation, so starting or ending a wait resets them all at once*/
+static unsigned waitGeneration = 1;
+/*Number of jobs of the current generation that have not finished*/
+static int waitPending;
+/*Serial number of the last job added*/
+static unsigned long jobSerial;
+/*First job of the current generation that finished*/
+static struct job *waitFirst;
+/*Maximum number of background jobs running at once, 0 for no limit*/
+static int bgJobLimit;
+/*Set by the SIGCHLD handler when a background job finished; the queued
+jobs it made room for are started from the main loop, since starting one
+forks and allocates*/
+static volatile sig_atomic_t bgSlotFreed;
+/*Nice value given to background jobs by the sched -b policy, or -1 if off*/
+static int bgNicePolicy = -1;
+/*Resource limits set with ulimit that every job starts with*/
+static struct joblimits defaultLimits;
+/*Number of loops the shell is running inside each other*/
+static int loopDepth;
+/*A pending break leaves this many loops; a pending continue leaves one
+loop less and goes on with the next iteration of the last one*/
+static int loopBreaks;
+static int loopContinues;
+/*Number of loops and function calls the shell is running itself, and the
+SIGINT action that the outermost of them replaced*/
+static int blockDepth;
+static struct sigaction blockOldSigint;
+/*Set by Ctrl-C while the shell itself runs a loop or function*/
+static volatile sig_atomic_t loopInterrupted;
+/*Calls nested deeper than this fail rather than overflow the stack*/
+#define MAXFUNCDEPTH 1000
+/*Number of function calls running, and the loopDepth when the innermost
+one started: break and continue only reach the loops inside it*/
+static int funcDepth;
+static int funcLoopBase;
+/*Set by the return builtin until the function it leaves has returned*/
+static bool funcReturns;
+/*The arguments of the running function, or of the script outside of
+functions; NULL in an interactive shell. $1, $2, ... are the variables
+"1", "2", ..., and $#, $@ and $* are "#", "@" and "*"*/
+static char **positional;
+/*$? before the running builtin started, for a plain "return"*/
+static int builtinPrevStatus;
+/*Set when an expansion such as $((1/0)) failed; assignments and builtins
+are then not run*/
+static bool expandFailed;
+/*Commands run by "every", in the order they were added*/
+static struct list recurring_list;
+/*Set while "every" starts a run, whose job does not announce itself*/
+static bool quietJob;
 
 /*Function Declarations*/
 static struct job *jid2job[MAXJOBS];
-static void handle_child_status(pid_t pid, int status);
+static void handle_child_status(pid_t pid, int status, const struct rusage *usage);
+void markJobFinished(struct job *jb);
 int get_pgid_from_jobId(int id);
 bool checkInternalCommand(struct ast_command *cmd);
-void runInternalCommand(struct ast_command *cmd);
+void runInternalCommand(struct ast_pipeline *pipe, char **argv);
+int countRunningBackgroundJobs(void);
+void startQueuedJob(struct job *jb);
+void admitQueuedJobs(FILE *out);
+int parseJobId(const char *spec);
+bool isJobSpec(const char *word);
+void shiftArgv(struct ast_command *cmd, int n);
+bool consumeJobPrefixes(struct ast_command *cmd, struct job_prefix *prefix);
+void getBackgroundSched(struct job *jb, struct jobsched *sched);
+void deprioritizeJob(struct job *jb);
+void restoreJobPriority(struct job *jb);
+void runSched(char **argv);
+void runUlimit(char **argv);
+void runExport(char **argv);
+void runWait(char **argv);
+void runRead(char **argv);
+void runLoopControl(char **argv);
+void runLoop(struct ast_pipeline *pipe);
+void runReturn(char **argv);
+void runFunction(struct ast_pipeline *pipe, struct ast_function *func, char **argv);
+bool isAssignment(const char *word);
+bool isAssignmentList(struct ast_command *cmd);
+bool runAssignments(struct ast_command *cmd);
+void runParallel(struct ast_pipeline *pipe, char **argv);
+void runJobLog(char **argv);
+void runEvery(struct ast_pipeline *pipe, char **argv);
+void runWatch(struct ast_pipeline *pipe, char **argv);
 void saveToHistory(char *cmdline);
 void history_list_free(void);
 void closePipes(int numPipes, int pipes[]);
 void cleanUpJobsList(void);
 void runCommand(struct ast_command_line *cmdline);
-void runChildProcess(int currCommand, int numCommands, int numPipes, int j, struct job *jb, int pipefds[], char *comd, char **argg);
+void spawnJob(struct job *jb);
+void spawnPipeline(struct job *jb, struct ast_pipeline *pipeline, int inFd, int outFd);
+void runChildProcess(int currCommand, int numCommands, int numPipes, int j, struct job *jb, int pipefds[],
+                     struct ast_pipeline *pipeline, struct ast_command *cmd, char **argv,
+                     int inFd, int outFd, int psfds[]);
+char **expandArgv(struct ast_command *cmd, int psfds[]);
+char *substituteCommands(const char *word, struct ast_command *cmd);
+char *expandWord(const char *word, struct ast_command *cmd);
+char *captureCommandLine(const char *text, size_t len, struct ast_command *cmd);
 int strcompare(const char *str1, const char *str2);
 char *CpyStringOver(char *s);
+int runScript(const char *path, bool parseOnly);
+int runServer(const char *path);
+static int openHereDocument(const char *body);
+static char *captureLines(struct ast_command_line *cline, int *exitStatus);
 
 /* Return job corresponding to jid */
 static struct job *
@@ -143,6 +347,23 @@ add_job(struct ast_pipeline *pipe)
     job->totalProc = 0;
     job->isFinished = false;
     job->wasKilled = false;
+    job->startTime = stats_now();
+    job->exitStatus = 0;
+    job->outFd = -1;
+    job->reportDone = true;
+    job->waitGeneration = 0;
+    job->pgid = -1;
+    job->lastPid = -1;
+    memset(&job->sched, 0, sizeof job->sched);
+    job->deprioritized = false;
+    job->limits = defaultLimits;
+    job->timeout = 0;
+    job->killAfter = 0;
+    job->deadline = NULL;
+    job->notices = 0;
+    job->termSignal = 0;
+    job->termCpu = 0;
+    job->serial = ++jobSerial;
     list_push_back(&job_list, &job->elem);
     for (int i = 1; i < MAXJOBS; i++)
     {
@@ -168,6 +389,9 @@ delete_job(struct job *job)
     assert(jid != -1);
     jid2job[jid]->jid = -1;
     jid2job[jid] = NULL;
+    if (job->notices != 0)
+        list_remove(&job->noticeElem);
+    jobtimeout_cancel(job->deadline);
     ast_pipeline_free(job->pipe);
     free(job);
 }
@@ -185,35 +409,124 @@ get_status(enum job_status status)
         return "Stopped";
     case NEEDSTERMINAL:
         return "Stopped (tty)";
+    case QUEUED:
+        return "Queued";
     default:
         return "Unknown";
     }
 }
 
-/* Print the command line that belongs to one job. */
+/* Print the command line that belongs to one job to 'out'. */
 static void
-print_cmdline(struct ast_pipeline *pipeline)
+fprintCmdline(FILE *out, struct ast_pipeline *pipeline)
 {
     struct list_elem *e = list_begin(&pipeline->commands);
     for (; e != list_end(&pipeline->commands); e = list_next(e))
     {
         struct ast_command *cmd = list_entry(e, struct ast_command, elem);
         if (e != list_begin(&pipeline->commands))
-            printf("| ");
+            fprintf(out, "| ");
         char **p = cmd->argv;
-        printf("%s", *p++);
+        fprintf(out, "%s", *p++);
         while (*p)
-            printf(" %s", *p++);
+            fprintf(out, " %s", *p++);
+    }
+}
+
+/* Print the command line that belongs to one job. */
+static void
+print_cmdline(struct ast_pipeline *pipeline)
+{
+    fprintCmdline(stdout, pipeline);
+}
+
+/* Print a job to 'out' */
+static void
+fprintJob(FILE *out, struct job *job)
+{
+    fprintf(out, "[%d]\t%s\t\t(", job->jid, get_status(job->status));
+    fprintCmdline(out, job->pipe);
+    fprintf(out, ")");
+    /*the time left until the timeout prefix signals the job*/
+    if (job->deadline != NULL && !job->isFinished)
+    {
+        double left = jobtimeout_remaining(job->deadline);
+        if (!jobtimeout_expired(job->deadline))
+            fprintf(out, "\ttimeout in %.1fs", left);
+        else if (left >= 0)
+            fprintf(out, "\ttimed out, killed in %.1fs", left);
     }
+    fprintf(out, "\n");
 }
 
 /* Print a job */
 static void
 print_job(struct job *job)
 {
-    printf("[%d]\t%s\t\t(", job->jid, get_status(job->status));
-    print_cmdline(job->pipe);
-    printf(")\n");
+    fprintJob(stdout, job);
+}
+
+/*Records event 'notice' of a job, to be reported outside of the SIGCHLD
+handler. Called from the handler, so it must not allocate*/
+static void
+queueNotice(struct job *jb, enum job_notice notice)
+{
+    if (jb->notices == 0)
+        list_push_back(&notice_list, &jb->noticeElem);
+    jb->notices |= notice;
+}
+
+/*Prints the events recorded by queueNotice to 'out' and forgets them.
+SIGCHLD must be blocked*/
+static void
+fprintNotices(FILE *out)
+{
+    assert(signal_is_blocked(SIGCHLD));
+    while (!list_empty(&notice_list))
+    {
+        struct job *jb = list_entry(list_pop_front(&notice_list), struct job, noticeElem);
+        if (jb->notices & NOTICE_SIGNALED)
+        {
+            /*Report a resource limit that explains the signal*/
+            char why[128];
+            if (joblimits_explain(&jb->limits, jb->termSignal, jb->termCpu, why, sizeof why) != NULL)
+            {
+                fprintf(out, "[%d] %s\n", jb->jid, why);
+            }
+
+            /*Go through different exit codes and print them*/
+            if (jb->termSignal == 11)
+            {
+                fprintf(out, "segmentation fault\n");
+            }
+            if (jb->termSignal == 8)
+            {
+                fprintf(out, "floating point exception\n");
+            }
+            if (jb->termSignal == 6)
+            {
+                fprintf(out, "aborted\n");
+            }
+            if (jb->termSignal == 9)
+            {
+                fprintf(out, "killed\n");
+            }
+            if (jb->termSignal == 15)
+            {
+                fprintf(out, "terminated\n");
+            }
+        }
+        if (jb->notices & NOTICE_TIMEDOUT)
+        {
+            fprintf(out, "[%d] timed out\n", jb->jid);
+        }
+        /*a job continued meanwhile is no longer worth a Stopped line*/
+        if ((jb->notices & NOTICE_STOPPED) && jb->status == STOPPED)
+        {
+            fprintJob(out, jb);
+        }
+        jb->notices = 0;
+    }
 }
 
 /*
@@ -237,12 +550,13 @@ sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
 
     pid_t child;
     int status;
+    struct rusage usage;
 
     assert(sig == SIGCHLD);
 
-    while ((child = waitpid(-1, &status, WUNTRACED | WNOHANG)) > 0)
+    while ((child = wait4(-1, &status, WUNTRACED | WNOHANG, &usage)) > 0)
     {
-        handle_child_status(child, status);
+        handle_child_status(child, status, &usage);
     }
 }
 
@@ -265,25 +579,52 @@ wait_for_job(struct job *job)
     while (job->status == FOREGROUND && job->num_processes_alive > 0)
     {
         int status;
-        pid_t child = waitpid(-1, &status, WUNTRACED);
+        struct rusage usage;
+        pid_t child = wait4(-1, &status, WUNTRACED, &usage);
         if (child != -1)
         {
-            handle_child_status(child, status);
+            handle_child_status(child, status, &usage);
+        }
+        /*background jobs that finish meanwhile make room for queued ones*/
+        if (bgSlotFreed)
+        {
+            admitQueuedJobs(stdout);
         }
     }
 }
 
 /* 
-Handles the job status for the given pid and child status.
+Handles the job status for the given pid and child status, with the
+resource usage of the child if it ended.
      */
 static void
-handle_child_status(pid_t pid, int status)
+handle_child_status(pid_t pid, int status, const struct rusage *usage)
 {
 
     assert(signal_is_blocked(SIGCHLD));
+    /*The zygote is a child of the shell as well, but not part of a job*/
+    if (zygote_reap(pid))
+    {
+        return;
+    }
+    /*Start timing the bookkeeping for this child*/
+    uint64_t reapStart = stats_now();
 
     /*Get a pointer to the job we are handling from the given pid*/
     struct job *jb = get_job_from_pid(pid);
+    if (jb == NULL)
+    {
+        return;
+    }
+
+    /*Record the exit status if this is the last command of the pipeline*/
+    if (pid == jb->lastPid)
+    {
+        if (WIFEXITED(status))
+            jb->exitStatus = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status))
+            jb->exitStatus = 128 + WTERMSIG(status);
+    }
 
     /*returns true if child exited normally*/
     if (WIFEXITED(status))
@@ -297,52 +638,58 @@ handle_child_status(pid_t pid, int status)
         jb->status = STOPPED;
         /*Save its terminals state*/
         termstate_save(&jb->saved_tty_state);
-        /*Print the job and its status*/
-        print_job(jb);
+        /*Report the job and its status once out of the handler*/
+        queueNotice(jb, NOTICE_STOPPED);
     }
     /*returns true if child was CTRL C'ed or was terminated with an error*/
     else if (WIFSIGNALED(status))
     {
-        /*Make the number of processes 0 as the job was terminated*/
-        jb->num_processes_alive = 0;
-        /*Indicate that the job was killed abnormally*/
-        jb->wasKilled = true;
-        /*Get the exit status of the job with the use of a MACRO*/
-        int exit_status = WTERMSIG(status);
-
-        /*Go through different exit codes and print them*/
-        if (exit_status == 11)
-        {
-            printf("segmentation fault\n");
-        }
-        if (exit_status == 8)
-        {
-            printf("floating point exception\n");
-        }
-        if (exit_status == 6)
-        {
-            printf("aborted\n");
-        }
-        if (exit_status == 9)
-        {
-            printf("killed\n");
-        }
-        if (exit_status == 15)
+        /*The other processes of the job, such as those of a pipeline or a
+        process substitution, may still run, so the job ends only when the
+        last of them is reaped*/
+        jb->num_processes_alive = jb->num_processes_alive - 1;
+        /*Get the signal with the use of a MACRO, fprintNotices reports it.
+        SIGPIPE is how a pipeline normally ends its earlier commands*/
+        if (WTERMSIG(status) != SIGPIPE || pid == jb->lastPid)
         {
-            printf("terminated\n");
+            jb->termSignal = WTERMSIG(status);
+            /*its CPU time tells whether a CPU limit killed it*/
+            jb->termCpu = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 +
+                          usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
         }
     }
     /*Check to see if a job has finished*/
     if (jb->num_processes_alive == 0)
     {
-        /*Indicate that the job has finished*/
-        jb->isFinished = true;
-        /*If the job was in the background print Done*/
-        if (jb->status == BACKGROUND && !jb->wasKilled)
+        /*Record the wall time of the job the first time it is seen finished*/
+        if (!jb->isFinished)
+        {
+            stats_record_since(STATS_WALL, jb->startTime);
+            /*Indicate that the job was killed abnormally*/
+            if (jb->termSignal != 0)
+            {
+                jb->wasKilled = true;
+                queueNotice(jb, NOTICE_SIGNALED);
+            }
+            /*A job ended by its timeout fails with 124, like timeout(1)*/
+            if (jb->deadline != NULL && jobtimeout_expired(jb->deadline))
+            {
+                jb->exitStatus = 124;
+                queueNotice(jb, NOTICE_TIMEDOUT);
+            }
+            /*its process group is gone, and its id may be reused*/
+            jobtimeout_disarm(jb->deadline);
+        }
+        /*Indicate that the job has finished. Its Done notice is printed
+        by takeFinishedJobs, not from within the signal handler*/
+        markJobFinished(jb);
+        /*A finished background job frees a slot for a queued job*/
+        if (jb->status == BACKGROUND)
         {
-            printf("\n[%d]    Done", jb->jid);
+            bgSlotFreed = true;
         }
     }
+    stats_record_since(STATS_REAP, reapStart);
 }
 /*Replacement function for strcmp()*/
 int strcompare(const char *str1, const char *str2)
@@ -400,8 +747,16 @@ int get_pgid_from_jobId(int id)
     return -1;
 }
 
+/*Names of the internal commands, also offered by tab completion*/
+static const char *const builtinNames[] = {
+    "jobs", "fg", "bg", "stop", "kill", "history", "exit", "cd",
+    "stats", "parallel", "bglimit", "sched", "ulimit", "limit",
+    "export", "unset", "wait", "read", "break", "continue", "return", "joblog",
+    "timeout", "every", "watch", NULL};
+
 /*
-checks if the passed ast_command is an internal command.
+checks if the passed ast_command is an internal command, a builtin or a
+shell function, both of which run inside the shell.
 Returns true if internal command is found.
 Returns false if internal command not found.
 */
@@ -411,21 +766,20 @@ bool checkInternalCommand(struct ast_command *cmd)
     char **p = cmd->argv;
 
     /*Compares the given command to the determined internal commands*/
-    if (strcompare(*p, "jobs") == 0 || strcompare(*p, "fg") == 0 || strcompare(*p, "bg") == 0 || strcompare(*p, "stop") == 0 ||
-        strcompare(*p, "kill") == 0 || strcompare(*p, "history") == 0 || strcompare(*p, "exit") == 0 || strcompare(*p, "cd") == 0)
+    for (const char *const *name = builtinNames; *name != NULL; name++)
     {
-        return true;
+        if (strcompare(*p, *name) == 0)
+            return true;
     }
-    else
-        return false;
+    return func_lookup(*p) != NULL;
 }
 
 /*
-runs the internal command passed to it
+runs the internal command passed to it, given by its expanded words
 */
-void runInternalCommand(struct ast_command *cmd)
+void runInternalCommand(struct ast_pipeline *pipe, char **argv)
 {
-    char **p = cmd->argv;
+    char **p = argv;
     /*Compares then runs job command*/
     if (strcompare(*p, "jobs") == 0)
     {
@@ -435,6 +789,9 @@ void runInternalCommand(struct ast_command *cmd)
              e = list_next(e))
         {
             struct job *jb = list_entry(e, struct job, elem);
+            /*Skip the job whose $(...) is running this jobs command*/
+            if (jb->status == FOREGROUND && jb->pgid == -1)
+                continue;
             /*Prints each job*/
             print_job(jb);
         }
@@ -450,12 +807,26 @@ void runInternalCommand(struct ast_command *cmd)
             i++;
         }
         argg[i] = NULL;
-        /*extracts job number from string*/
-        int jobId = atoi(argg[1]);
+        /*get a pointer to the job given by its number*/
+        struct job *jb = argg[1] != NULL ? get_job_from_jid(parseJobId(argg[1])) : NULL;
+        if (jb == NULL)
+        {
+            printf("fg: no such job\n");
+            var_set_status(1);
+            return;
+        }
+        /*Block SigChld*/
+        signal_block(17);
+        /*A queued job is promoted and started right away*/
+        if (jb->status == QUEUED)
+        {
+            jb->pipe->bg_job = false;
+            startQueuedJob(jb);
+        }
+        /*Undo the background sched policy*/
+        restoreJobPriority(jb);
         /*get the pgid to send that group into the foreground*/
-        int pgid = get_pgid_from_jobId(jobId);
-        /*get a pointer to that specific job*/
-        struct job *jb = get_job_from_pid(pgid);
+        int pgid = jb->pgid;
         /*Change the job status to Foregorund*/
         jb->status = FOREGROUND;
         /*Print the commands initially run*/
@@ -464,12 +835,13 @@ void runInternalCommand(struct ast_command *cmd)
         fflush(stdout);
         /*Send a sig cont signal to the process group*/
         killpg(pgid, SIGCONT);
-        /*Block SigChld*/
-        signal_block(17);
         /*give terminal control to job with */
         termstate_give_terminal_to(NULL, pgid);
         /*Wait for the job to complete*/
         wait_for_job(jb);
+        fprintNotices(stdout);
+        if (jb->isFinished)
+            var_set_status(jb->exitStatus);
         /*After job is complete give control back to shell*/
         termstate_give_terminal_back_to_shell();
         /*Unblosk SigCHLD*/
@@ -486,14 +858,28 @@ void runInternalCommand(struct ast_command *cmd)
             i++;
         }
         argg[i] = NULL;
-        /*extracts job number from string*/
-        int jobID = atoi(argg[1]);
+        /*get a pointer to the job given by its number*/
+        struct job *jb = argg[1] != NULL ? get_job_from_jid(parseJobId(argg[1])) : NULL;
+        if (jb == NULL)
+        {
+            printf("bg: no such job\n");
+            var_set_status(1);
+            return;
+        }
+        /*A queued job is started right away, ignoring the limit*/
+        signal_block(SIGCHLD);
+        if (jb->status == QUEUED)
+        {
+            startQueuedJob(jb);
+            printf("[%d] %d\n", jb->jid, jb->lastPid);
+        }
+        signal_unblock(SIGCHLD);
         /*get the pgid from jobid*/
-        int pgid = get_pgid_from_jobId(jobID);
-        /*get a pointer to that specific job*/
-        struct job *jb = get_job_from_pid(pgid);
+        int pgid = jb->pgid;
         /*Change the job status to Background*/
         jb->status = BACKGROUND;
+        /*Apply the background sched policy*/
+        deprioritizeJob(jb);
         /*Send a sig cont signal to the process group*/
         killpg(pgid, SIGCONT);
     }
@@ -509,11 +895,12 @@ void runInternalCommand(struct ast_command *cmd)
         }
         argg[i] = NULL;
         /*extracts job number from string*/
-        int jobId = atoi(argg[1]);
+        int jobId = parseJobId(argg[1]);
         /*get the pgid from jobid*/
         int pgid = get_pgid_from_jobId(jobId);
-        /*Send a sig stop signal to the process group*/
-        killpg(pgid, SIGSTOP);
+        /*Send a sig stop signal to the process group, queued jobs have none*/
+        if (pgid > 0)
+            killpg(pgid, SIGSTOP);
     }
     /*Compares then runs kill command*/
     else if (strcompare(*p, "kill") == 0)
@@ -527,11 +914,19 @@ void runInternalCommand(struct ast_command *cmd)
         }
         argg[i] = NULL;
         /*extracts job number from string*/
-        int jobId = atoi(argg[1]);
+        int jobId = parseJobId(argg[1]);
         /*get the pgid from jobid*/
         int pgid = get_pgid_from_jobId(jobId);
+        struct job *jb = get_job_from_jid(jobId);
+        /*A queued job is simply dropped from the queue*/
+        if (jb != NULL && jb->status == QUEUED)
+        {
+            list_remove(&jb->queueElem);
+            markJobFinished(jb);
+        }
         /*Send a sig term signal to the process group*/
-        killpg(pgid, SIGKILL);
+        else if (pgid > 0)
+            killpg(pgid, SIGKILL);
     }
     /*Compares then runs history command*/
     else if (strcompare(*p, "history") == 0)
@@ -566,6 +961,7 @@ void runInternalCommand(struct ast_command *cmd)
         if(argg[1] == NULL || argg[2] != NULL ){
             printf("Wrong format : ");
             printf("cd requires exactly one argument\n");
+            var_set_status(1);
         }/*Checks to see if the user entered -d as the argg*/
         else if (strcmp(argg[1], "-d") == 0){}
         /*Checks to see if the user entered ~ as the argg*/
@@ -573,229 +969,2961 @@ void runInternalCommand(struct ast_command *cmd)
         {
             chdir(homeDir);
         }/*Else changes directory to user entered dir*/
-        else if (chdir(argg[1]) == -1) printf("Path not recognized.\n");
+        else if (chdir(argg[1]) == -1)
+        {
+            printf("Path not recognized.\n");
+            var_set_status(1);
+        }
        
         /*gets and prints the current directory*/
         getcwd(cwd, sizeof(cwd));
         printf("Current Dir : %s\n",cwd );
     }
 
+    /*Compares then runs stats command*/
+    else if (strcompare(*p, "stats") == 0)
+    {
+        /*stats -r resets, stats -o <file> exports at exit, plain stats prints*/
+        if (p[1] != NULL && strcompare(p[1], "-r") == 0)
+        {
+            stats_reset();
+        }
+        else if (p[1] != NULL && strcompare(p[1], "-o") == 0)
+        {
+            if (p[2] == NULL)
+                printf("stats -o requires a file name\n");
+            else
+                stats_set_export(p[2]);
+        }
+        else
+        {
+            stats_print(stdout);
+            pathglob_cache_print();
+        }
+    }
+    /*Compares then runs parallel command*/
+    else if (strcompare(*p, "parallel") == 0)
+    {
+        runParallel(pipe, p);
+    }
+    /*Compares then runs joblog command*/
+    else if (strcompare(*p, "joblog") == 0)
+    {
+        runJobLog(p);
+    }
+    /*Compares then runs every command*/
+    else if (strcompare(*p, "every") == 0)
+    {
+        runEvery(pipe, p);
+    }
+    /*Compares then runs watch command*/
+    else if (strcompare(*p, "watch") == 0)
+    {
+        runWatch(pipe, p);
+    }
+    /*Compares then runs bglimit command*/
+    else if (strcompare(*p, "bglimit") == 0)
+    {
+        /*Without an argument print the current limit*/
+        if (p[1] == NULL)
+        {
+            if (bgJobLimit == 0)
+                printf("unlimited\n");
+            else
+                printf("%d\n", bgJobLimit);
+        }
+        else if (atoi(p[1]) < 0 || (atoi(p[1]) == 0 && strcompare(p[1], "0") != 0 && strcompare(p[1], "unlimited") != 0))
+        {
+            printf("bglimit: expected a number of jobs or 'unlimited'\n");
+        }
+        else
+        {
+            bgJobLimit = atoi(p[1]);
+            /*A raised limit may admit queued jobs right away*/
+            signal_block(SIGCHLD);
+            admitQueuedJobs(stdout);
+            signal_unblock(SIGCHLD);
+        }
+    }
+    /*Compares then runs sched command*/
+    else if (strcompare(*p, "sched") == 0)
+    {
+        runSched(p);
+    }
+    /*Compares then runs ulimit command*/
+    else if (strcompare(*p, "ulimit") == 0)
+    {
+        runUlimit(p);
+    }
+    /*Compares then runs limit command, which only gets here without a command to run*/
+    else if (strcompare(*p, "limit") == 0)
+    {
+        printf("Usage: limit [-v size] [-d size] [-s size] [-t secs] [-n files] [-c size] [-f size] [-u procs] command...\n");
+    }
+    /*Compares then runs timeout command, which only gets here without a command to run*/
+    else if (strcompare(*p, "timeout") == 0)
+    {
+        printf("Usage: timeout [-k duration] duration command...\n");
+    }
+    /*Compares then runs export command*/
+    else if (strcompare(*p, "export") == 0)
+    {
+        runExport(p);
+    }
+    /*Compares then runs unset command, "unset -f" removes functions*/
+    else if (strcompare(*p, "unset") == 0)
+    {
+        bool functions = p[1] != NULL && strcompare(p[1], "-f") == 0;
+        for (p += functions ? 2 : 1; *p; p++)
+        {
+            if (functions)
+                func_remove(*p);
+            else
+                var_unset(*p);
+        }
+    }
+    /*Compares then runs wait command*/
+    else if (strcompare(*p, "wait") == 0)
+    {
+        runWait(p);
+    }
+    /*Compares then runs read command*/
+    else if (strcompare(*p, "read") == 0)
+    {
+        runRead(p);
+    }
+    /*Compares then runs break and continue commands*/
+    else if (strcompare(*p, "break") == 0 || strcompare(*p, "continue") == 0)
+    {
+        runLoopControl(p);
+    }
+    /*Compares then runs return command*/
+    else if (strcompare(*p, "return") == 0)
+    {
+        runReturn(p);
+    }
     /*Compares then runs exit command*/
     else if (strcompare(*p, "exit") == 0)
     {
+        /*"exit N" sets the exit status of a script*/
+        if (p[1] != NULL)
+            var_set_status(atoi(p[1]));
         quit = true;
     }
+    /*Anything else is a function, see checkInternalCommand*/
+    else
+    {
+        runFunction(pipe, func_lookup(*p), p);
+    }
 }
-/*Saves the given cmdline into the history list*/
-void saveToHistory(char *cmdline)
+/*Returns true if 'word' is an assignment such as NAME=value*/
+bool isAssignment(const char *word)
 {
-    struct history *hist = malloc(sizeof(struct history));
-    /*Copys the cmdline to the history struct*/
-    hist->command = CpyStringOver(cmdline);
-    /*Append the history struct to the history list*/
-    list_push_back(&history_list, &hist->elem);
+    const char *eq = strchr(word, '=');
+    return eq != NULL && var_valid_name(word, eq - word);
 }
 
-/*This function frees the history list*/
-void history_list_free()
+/*Returns true if every word of the command is an assignment*/
+bool isAssignmentList(struct ast_command *cmd)
 {
-    /*Loop through the history list and deletes each item*/
-    for (struct list_elem *e = list_begin(&history_list);
-         e != list_end(&history_list);
-         e = list_remove(e))
+    for (char **p = cmd->argv; *p; p++)
     {
+        if (!isAssignment(*p))
+            return false;
     }
+    return true;
 }
 
-/*This function runs all of the commands present in the cmdline*/
-void runCommand(struct ast_command_line *cmdline)
+/*Sets the variables of an assignment list such as "A=1 B=$A". Returns
+false, leaving the variable alone, if the expansion of a value failed*/
+bool runAssignments(struct ast_command *cmd)
 {
-    /*Loop through each pipeline of commands.*/
-    for (struct list_elem *e = list_begin(&cmdline->pipes);
-         e != list_end(&cmdline->pipes);
-         e = list_next(e))
+    for (char **p = cmd->argv; *p; p++)
     {
-        /*Initialize pid*/
-        pid_t pid = -1;
-        /*J is used as a counter for the pipes*/
-        int j = 0;
-
-        /*Obtain the current pipe*/
-        struct ast_pipeline *pipe1 = list_entry(e, struct ast_pipeline, elem);
-        /*Obtain the commands in the pipe*/
-        struct list_elem *e2 = list_begin(&pipe1->commands);
-        /*Obtain the first command*/
-        struct ast_command *cmd = list_entry(e2, struct ast_command, elem);
-
-        /*Check if the command is internal*/
-        bool isInternal = checkInternalCommand(cmd);
-
-        /*If the command is internal run the internal command fucntion and break this loop*/
-        if (isInternal)
+        char *eq = strchr(*p, '=');
+        expandFailed = false;
+        char *value = expandWord(eq + 1, cmd);
+        if (expandFailed)
         {
-            runInternalCommand(cmd);
-            break;
+            free(value);
+            return false;
         }
-        /*If the command is not internal continue*/
+        *eq = '\0';
+        var_set(*p, value, false);
+        free(value);
+        *eq = '=';
+    }
+    return true;
+}
 
-        /*Scince command pipe is not internal the pipe is added to the job list*/
-        struct job *jb = add_job(pipe1);
-        /*Obtain number of commands*/
-        int numCommands = list_size(&pipe1->commands);
-        /*Calculate number of pipes*/
-        int numPipes = numCommands - 1;
-        /*set the current command*/
-        int currCommand = 0;
-
-        /* Pipes Declarations Block*/
-        int pipefds[2 * numPipes];
-        for (int i = 0; i < numPipes; i++)
-        {
-            if (pipe(pipefds + i * 2) < 0)
-            {
-                perror("couldn't pipe");
-                exit(EXIT_FAILURE);
-            }
+/*Runs the export builtin: "export NAME[=value]..." exports variables,
+a plain "export" lists the exported ones*/
+void runExport(char **argv)
+{
+    if (argv[1] == NULL)
+    {
+        var_print_exported();
+        return;
+    }
+    for (char **p = argv + 1; *p; p++)
+    {
+        char *eq = strchr(*p, '=');
+        if (!var_valid_name(*p, eq ? (size_t)(eq - *p) : strlen(*p)))
+        {
+            fprintf(stderr, "export: '%s' is not a valid name\n", *p);
+            continue;
+        }
+        if (eq == NULL)
+        {
+            var_export(*p);
+            continue;
         }
-        /****************************/
+        *eq = '\0';
+        var_set(*p, eq + 1, true);
+        *eq = '=';
+    }
+}
+
+/*One running task of the parallel builtin*/
+struct parallel_task
+{
+    struct job *jb; /* job that runs the task */
+    int arg;        /* index of the argument the task was started for */
+};
 
-        /*File IO Block*/
-        /*if output needs to be sent to a file*/
-        if (jb->pipe->iored_output != NULL)
+/*Builds the argv of one parallel task by substituting 'arg' for every {}
+in the command template, or by appending it if the template has no {}*/
+static char **buildParallelArgv(char **tmpl, int tmplLen, const char *arg)
+{
+    char **argv = calloc(tmplLen + 2, sizeof(char *));
+    bool substituted = false;
+    for (int i = 0; i < tmplLen; i++)
+    {
+        /*count the {} in this word*/
+        int braces = 0;
+        for (char *b = strstr(tmpl[i], "{}"); b != NULL; b = strstr(b + 2, "{}"))
+            braces++;
+        if (braces == 0)
+        {
+            argv[i] = strdup(tmpl[i]);
+            continue;
+        }
+        /*replace each {} in this word with the argument*/
+        char *out = argv[i] = malloc(strlen(tmpl[i]) + braces * strlen(arg) + 1);
+        for (char *w = tmpl[i]; *w;)
         {
-            /*if stdout needs to be appended to he file*/
-            if (jb->pipe->append_to_output)
+            if (w[0] == '{' && w[1] == '}')
             {
-                freopen(jb->pipe->iored_output, "a", stdout);
+                out = stpcpy(out, arg);
+                w += 2;
             }
-            /*If stdout needs to be written to a file not appended*/
             else
-            {
-                freopen(jb->pipe->iored_output, "w", stdout);
-            }
-            /*if stdout also needs to be appended to the file*/
-            if (cmd->dup_stderr_to_stdout)
-            {
-                dup2(1, 2);
-            }
+                *out++ = *w++;
         }
-        /*If std in needs to be taken from a file*/
-        if (jb->pipe->iored_input != NULL)
+        *out = '\0';
+        substituted = true;
+    }
+    if (!substituted)
+    {
+        argv[tmplLen] = strdup(arg);
+    }
+    return argv;
+}
+
+/*Reads one argument per line from 'in' for the parallel builtin.
+Returns a malloc'ed array and stores its length in 'nargs'*/
+static char **readParallelArgs(FILE *in, int *nargs)
+{
+    int cap = 64;
+    char **args = malloc(cap * sizeof(char *));
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+
+    *nargs = 0;
+    while ((n = getline(&line, &len, in)) > 0)
+    {
+        if (line[n - 1] == '\n')
+            line[--n] = '\0';
+        /*skip empty lines*/
+        if (n == 0)
+            continue;
+        if (*nargs == cap)
         {
-            freopen(jb->pipe->iored_input, "r", stdin);
+            cap *= 2;
+            args = realloc(args, cap * sizeof(char *));
         }
-        /*****************************/
+        args[(*nargs)++] = strdup(line);
+    }
+    free(line);
+    return args;
+}
 
-        /*initialize processGroupID*/
-        pid_t processGroupID = -1;
+/*Copies the output a finished parallel task collected to stdout, then
+removes its job. Returns true if the task succeeded*/
+static bool finishParallelTask(struct job *jb)
+{
+    char buf[65536];
+    ssize_t n;
+    off_t off = 0;
 
-        /*Loop through the pipe to run each command as part of the pipeline*/
-        for (struct list_elem *e2 = list_begin(&pipe1->commands);
-             e2 != list_end(&pipe1->commands);
-             e2 = list_next(e2))
-        {
-            /*Obtain the ast_command from the pipe*/
-            struct ast_command *cmd = list_entry(e2, struct ast_command, elem);
-            /*Block SigCHLD*/
-            signal_block(17);
-            /*Fork to create a parent and child process*/
-            pid = fork();
+    fflush(stdout);
+    while ((n = pread(jb->outFd, buf, sizeof buf, off)) > 0)
+    {
+        if (write(1, buf, n) != n)
+            break;
+        off += n;
+    }
+    close(jb->outFd);
 
-            /*Code Block Which Both Parent and Children execute.*/
-            /*extract command and its arguments*/
-            char **p = cmd->argv;
-            char *comd = *p;
-            char *argg[10];
-            int i = 0;
-            while (*p)
-            {
-                argg[i] = *p++;
-                i++;
-            }
-            argg[i] = NULL;
-            /********************************************************/
+    bool ok = jb->exitStatus == 0;
+    list_remove(&jb->elem);
+    if (jb->isFinished)
+        list_remove(&jb->finishedElem);
+    delete_job(jb);
+    return ok;
+}
 
-            /*Child Code Block*/
-            if (pid == 0)
-            {
-                /*create a new process group if this is the first command in the pipe */
-                if (currCommand == 0)
-                {
-                    setpgid(0, 0);
-                }
-                /*else for the other commands in the pipe put them in the group of the first command*/
-                else
-                {
-                    setpgid(0, jb->pgid);
-                }
+/*Runs "parallel [-j N] cmd [args...] [::: arg...]". Each argument becomes
+one background job; at most N of them run at once and free slots are
+refilled as children are reaped. The output of each task is collected in
+a memfd and printed in one piece when the task finishes. Without :::, the
+arguments are read one per line from the input redirection or stdin*/
+void runParallel(struct ast_pipeline *pipe, char **argv)
+{
+    char **p = argv + 1;
+    long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /*-j N overrides the number of tasks in flight*/
+    if (*p != NULL && strcompare(*p, "-j") == 0)
+    {
+        if (p[1] == NULL || atoi(p[1]) <= 0)
+        {
+            printf("parallel: -j requires a positive number\n");
+            return;
+        }
+        maxJobs = atoi(p[1]);
+        p += 2;
+    }
+    if (maxJobs < 1)
+        maxJobs = 1;
+
+    /*the command template runs up to ::: or the end of the line*/
+    char **tmpl = p;
+    int tmplLen = 0;
+    while (tmpl[tmplLen] != NULL && strcompare(tmpl[tmplLen], ":::") != 0)
+        tmplLen++;
+    if (tmplLen == 0)
+    {
+        printf("Usage: parallel [-j N] command [args...] [::: arg...]\n");
+        return;
+    }
+
+    /*collect the arguments*/
+    char **args;
+    int nargs = 0;
+    bool ownArgs = tmpl[tmplLen] == NULL;
+    if (!ownArgs)
+    {
+        args = tmpl + tmplLen + 1;
+        while (args[nargs] != NULL)
+            nargs++;
+    }
+    else if (pipe->iored_input != NULL)
+    {
+        FILE *in = fopen(pipe->iored_input, "r");
+        if (in == NULL)
+        {
+            perror(pipe->iored_input);
+            return;
+        }
+        args = readParallelArgs(in, &nargs);
+        fclose(in);
+    }
+    else if (pipe->here_body != NULL)
+    {
+        /*read a here-document or here-string straight from memory*/
+        FILE *in = fmemopen(pipe->here_body, strlen(pipe->here_body), "r");
+        args = readParallelArgs(in, &nargs);
+        fclose(in);
+    }
+    else
+    {
+        args = readParallelArgs(stdin, &nargs);
+        clearerr(stdin);
+    }
+
+    if (maxJobs > nargs)
+        maxJobs = nargs > 0 ? nargs : 1;
+    struct parallel_task *running = calloc(maxJobs, sizeof *running);
+    int numRunning = 0, next = 0, failed = 0;
+    uint64_t start = stats_now();
+
+    signal_block(SIGCHLD);
+    while (next < nargs || numRunning > 0)
+    {
+        /*Fill every free slot with a new task*/
+        while (numRunning < maxJobs && next < nargs)
+        {
+            struct ast_pipeline *tpipe = ast_pipeline_create(strdup("/dev/null"), NULL, false);
+            ast_pipeline_add_command(tpipe, ast_command_create(buildParallelArgv(tmpl, tmplLen, args[next]), false));
+            tpipe->bg_job = true;
+
+            struct job *jb = add_job(tpipe);
+            jb->status = BACKGROUND;
+            jb->reportDone = false;
+            jb->outFd = memfd_create("parallel", MFD_CLOEXEC);
+            if (jb->outFd < 0)
+            {
+                utils_fatal_error("memfd_create failed: ");
+            }
+            spawnJob(jb);
+            running[numRunning].jb = jb;
+            running[numRunning].arg = next++;
+            numRunning++;
+        }
+
+        /*Sleep until a child changes state*/
+        int status;
+        struct rusage usage;
+        pid_t child = wait4(-1, &status, WUNTRACED, &usage);
+        if (child != -1)
+        {
+            handle_child_status(child, status, &usage);
+        }
+
+        /*Collect finished tasks, which frees their slots*/
+        for (int i = 0; i < numRunning;)
+        {
+            struct job *jb = running[i].jb;
+            /*a task that stops (e.g. because it wants the terminal) would never finish*/
+            if (!jb->isFinished && jb->status == STOPPED)
+            {
+                fprintf(stderr, "parallel: '%s' stopped, killing it\n", args[running[i].arg]);
+                killpg(jb->pgid, SIGKILL);
+                killpg(jb->pgid, SIGCONT);
+                jb->status = BACKGROUND;
+            }
+            if (!jb->isFinished)
+            {
+                i++;
+                continue;
+            }
+            int exitStatus = jb->exitStatus;
+            if (!finishParallelTask(jb))
+            {
+                fprintf(stderr, "parallel: '%s' failed with status %d\n", args[running[i].arg], exitStatus);
+                failed++;
+            }
+            running[i] = running[--numRunning];
+        }
+    }
+    signal_unblock(SIGCHLD);
+
+    /*Summarize throughput and failures*/
+    double secs = (stats_now() - start) / 1e9;
+    printf("parallel: %d tasks, %d failed, %.2fs, %.1f tasks/s\n",
+           nargs, failed, secs, secs > 0 ? nargs / secs : 0.0);
+
+    free(running);
+    if (ownArgs)
+    {
+        for (int i = 0; i < nargs; i++)
+            free(args[i]);
+        free(args);
+    }
+}
+
+/*Runs the pager, $PAGER or less, as a foreground job with 'fd' as its
+stdin, so that Ctrl-Z and fg work on it as on any other job*/
+static void pageJobLog(int fd)
+{
+    const char *pager = var_get("PAGER");
+    if (pager == NULL || *pager == '\0')
+        pager = "less";
+    /*$PAGER may hold options, such as "less -R"*/
+    char *words = strdup(pager);
+    int n = 0;
+    char **argv = calloc(strlen(words) / 2 + 2, sizeof(char *));
+    for (char *w = strtok(words, " \t"); w != NULL; w = strtok(NULL, " \t"))
+        argv[n++] = strdup(w);
+    free(words);
+    if (n == 0)
+        argv[n++] = strdup("less");
+
+    struct ast_pipeline *ppipe = ast_pipeline_create(NULL, NULL, false);
+    ast_pipeline_add_command(ppipe, ast_command_create(argv, false));
+    struct job *jb = add_job(ppipe);
+    jb->reportDone = false;
+
+    signal_block(SIGCHLD);
+    var_environ();
+    spawnPipeline(jb, ppipe, fd, -1);
+    termstate_give_terminal_to(NULL, jb->pgid);
+    wait_for_job(jb);
+    var_set_status(jb->isFinished ? jb->exitStatus : 128 + SIGTSTP);
+    termstate_give_terminal_back_to_shell();
+    signal_unblock(SIGCHLD);
+}
+
+/*Runs "joblog". "joblog on [size]" captures the output of the background
+jobs started from then on into logs that keep their last size bytes,
+"joblog spill [size]" keeps all of it, moving it to a file past size
+bytes, "joblog tag [size]" has them write to the terminal a line at a
+time, each tagged with the job id, and "joblog off" lets them write to
+the terminal directly again. "joblog" lists the logs and "joblog %N"
+shows the log of job N, with the pager if stdout is a terminal. See
+jobout.h*/
+void runJobLog(char **argv)
+{
+    char **p = argv + 1;
+    size_t size;
+    enum jobout_mode mode = jobout_get_mode(&size);
+    if (*p == NULL)
+    {
+        jobout_list(stdout);
+    }
+    else if (isJobSpec(*p) && p[1] == NULL)
+    {
+        int fd = jobout_open_log(parseJobId(*p));
+        if (fd < 0)
+        {
+            printf("joblog: no log for job %s\n", *p);
+            var_set_status(1);
+        }
+        else if (isatty(1))
+        {
+            pageJobLog(fd);
+            close(fd);
+        }
+        else
+        {
+            /*copy the log to stdout*/
+            char buf[8192];
+            ssize_t n;
+            fflush(stdout);
+            while ((n = read(fd, buf, sizeof buf)) > 0)
+            {
+                if (write(1, buf, n) < 0)
+                    break;
+            }
+            close(fd);
+        }
+    }
+    else if (strcompare(*p, "off") == 0 && p[1] == NULL)
+    {
+        jobout_set_mode(JOBOUT_OFF, size);
+    }
+    else if ((strcompare(*p, "on") == 0 || strcompare(*p, "spill") == 0 || strcompare(*p, "tag") == 0) &&
+             (p[1] == NULL || (p[2] == NULL && jobout_parse_size(p[1], &size))))
+    {
+        mode = strcompare(*p, "on") == 0 ? JOBOUT_RING : strcompare(*p, "spill") == 0 ? JOBOUT_SPILL : JOBOUT_TAG;
+        if (!jobout_set_mode(mode, size))
+        {
+            perror("joblog");
+            var_set_status(1);
+        }
+    }
+    else
+    {
+        printf("Usage: joblog [on [size] | spill [size] | tag [size] | off | %%N]\n");
+        var_set_status(2);
+    }
+}
+
+/*Runs "wait [-n] [%N...]". Without job ids it waits for all background
+jobs, otherwise for the given ones; with -n it returns as soon as the
+first of them finishes. The shell sleeps in sigwaitinfo until a child
+changes state or the user hits Ctrl-C, and each reaped child costs O(1)
+because markJobFinished counts the waited jobs off. $? becomes the exit
+status of the last job given, of the first job to finish with -n, or 0*/
+void runWait(char **argv)
+{
+    char **p = argv + 1;
+    bool any = false;
+    int status = 0;
+    struct job *last = NULL;
+
+    if (*p != NULL && strcompare(*p, "-n") == 0)
+    {
+        any = true;
+        p++;
+    }
+
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGINT);
+    sigprocmask(SIG_BLOCK, &set, &old);
+
+    /*Tag the jobs to wait for with a fresh generation*/
+    waitGeneration++;
+    waitPending = 0;
+    waitFirst = NULL;
+    if (*p == NULL)
+    {
+        for (struct list_elem *e = list_begin(&job_list);
+             e != list_end(&job_list);
+             e = list_next(e))
+        {
+            struct job *jb = list_entry(e, struct job, elem);
+            if (!jb->isFinished && (jb->status == BACKGROUND || jb->status == QUEUED))
+            {
+                jb->waitGeneration = waitGeneration;
+                waitPending++;
+            }
+        }
+    }
+    for (; *p != NULL; p++)
+    {
+        struct job *jb = get_job_from_jid(parseJobId(*p));
+        if (jb == NULL)
+        {
+            printf("wait: %s: no such job\n", *p);
+            status = 127;
+            continue;
+        }
+        last = jb;
+        if (jb->isFinished)
+        {
+            /*A job that already finished satisfies wait -n at once*/
+            if (waitFirst == NULL)
+                waitFirst = jb;
+        }
+        else if (jb->waitGeneration != waitGeneration)
+        {
+            jb->waitGeneration = waitGeneration;
+            waitPending++;
+        }
+    }
+
+    bool interrupted = false;
+    while (waitPending > 0 && !(any && waitFirst != NULL))
+    {
+        int childStatus;
+        struct rusage usage;
+        pid_t child;
+        while ((child = wait4(-1, &childStatus, WUNTRACED | WNOHANG, &usage)) > 0)
+        {
+            handle_child_status(child, childStatus, &usage);
+        }
+        /*queued jobs being waited for start as slots free up*/
+        if (bgSlotFreed)
+            admitQueuedJobs(stdout);
+        if (waitPending == 0 || (any && waitFirst != NULL))
+            break;
+        /*No children left to reap means nothing will ever finish*/
+        if (child == -1 && errno == ECHILD)
+            break;
+        if (sigwaitinfo(&set, NULL) == SIGINT)
+        {
+            printf("\n");
+            interrupted = true;
+            /*Ctrl-C ends the loops and functions the wait runs in too*/
+            if (blockDepth > 0)
+                loopInterrupted = true;
+            break;
+        }
+    }
+    /*Untag the jobs that are still running*/
+    waitGeneration++;
+
+    if (interrupted)
+        status = 128 + SIGINT;
+    else if (any)
+        status = waitFirst != NULL ? waitFirst->exitStatus : 127;
+    else if (last != NULL && last->isFinished)
+        status = last->exitStatus;
+    var_set_status(status);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+/*Returns the next field of a line read by the read builtin as a malloc'd
+string and moves '*pos' past it and the blanks after it. With 'rest' the
+field is the rest of the line, less trailing blanks. Unless 'raw', a
+backslash quotes the character after it, so "a\ b" is one field*/
+static char *nextReadField(const char **pos, bool raw, bool rest)
+{
+    const char *s = *pos;
+    char *field = malloc(strlen(s) + 1);
+    size_t len = 0, keep = 0;
+    while (*s != '\0')
+    {
+        bool quoted = !raw && *s == '\\' && s[1] != '\0';
+        if (quoted)
+            s++;
+        else if (!rest && (*s == ' ' || *s == '\t'))
+            break;
+        field[len++] = *s++;
+        if (quoted || (field[len - 1] != ' ' && field[len - 1] != '\t'))
+            keep = len;
+    }
+    field[keep] = '\0';
+    while (*s == ' ' || *s == '\t')
+        s++;
+    *pos = s;
+    return field;
+}
+
+/*Runs "read [-r] [-u fd] [name...]": reads a line and splits it at blanks
+into the names, the last one taking the rest of the line, or stores it in
+REPLY. Without -r a backslash quotes the character after it and one at
+the end of the line joins the next line. Lines come from the lookahead
+buffer of the file descriptor (see readbuf.h), so reading a file line by
+line costs no system call per byte. Fails at the end of input*/
+void runRead(char **argv)
+{
+    bool raw = false;
+    int fd = 0;
+    char **p = argv + 1;
+    for (; *p != NULL && (*p)[0] == '-'; p++)
+    {
+        if (strcompare(*p, "-r") == 0)
+            raw = true;
+        else if (strcompare(*p, "-u") == 0 && p[1] != NULL)
+            fd = atoi(*++p);
+        else
+        {
+            printf("Usage: read [-r] [-u fd] [name...]\n");
+            var_set_status(2);
+            return;
+        }
+    }
+
+    bool complete;
+    char *line = readbuf_getline(fd, &complete);
+    /*an odd number of backslashes at the end continues the line*/
+    while (!raw && line != NULL && complete)
+    {
+        size_t len = strlen(line), n = 0;
+        while (n < len && line[len - 1 - n] == '\\')
+            n++;
+        if (n % 2 == 0)
+            break;
+        line[len - 1] = '\0';
+        char *more = readbuf_getline(fd, &complete);
+        if (more == NULL)
+            break;
+        line = realloc(line, len + strlen(more));
+        strcpy(line + len - 1, more);
+        free(more);
+    }
+
+    /*at the end of input the names are still set, to empty strings*/
+    const char *pos = line != NULL ? line : "";
+    while (*pos == ' ' || *pos == '\t')
+        pos++;
+    if (*p == NULL)
+    {
+        char *value = nextReadField(&pos, raw, true);
+        var_set("REPLY", value, false);
+        free(value);
+    }
+    for (; *p != NULL; p++)
+    {
+        char *value = nextReadField(&pos, raw, p[1] == NULL);
+        var_set(*p, value, false);
+        free(value);
+    }
+    free(line);
+    var_set_status(complete ? 0 : 1);
+}
+
+/*Runs "break [n]" and "continue [n]", which leave the n-th enclosing loop
+or go on with its next iteration. They take effect when the builtin
+returns: runCommand stops and the loops see the pending counts*/
+void runLoopControl(char **argv)
+{
+    int n = argv[1] != NULL ? atoi(argv[1]) : 1;
+    int loops = loopDepth - funcLoopBase;
+    if (loops == 0)
+    {
+        printf("%s: only meaningful in a loop\n", argv[0]);
+        return;
+    }
+    if (n < 1)
+    {
+        printf("%s: %s: loop count out of range\n", argv[0], argv[1]);
+        var_set_status(1);
+        return;
+    }
+    if (n > loops)
+        n = loops;
+    if (strcompare(argv[0], "break") == 0)
+        loopBreaks = n;
+    else
+        loopContinues = n;
+}
+
+/*Takes the pending break or continue, if any, that is meant for the
+innermost loop. Returns true if that loop stops*/
+static bool loopStops(void)
+{
+    if (quit || loopInterrupted || funcReturns)
+        return true;
+    if (loopBreaks > 0)
+    {
+        loopBreaks--;
+        return true;
+    }
+    if (loopContinues > 1)
+    {
+        loopContinues--;
+        return true;
+    }
+    loopContinues = 0;
+    return false;
+}
+
+/*Returns true once the rest of the command line being run is skipped:
+after break, continue or return, or Ctrl-C in a loop or function*/
+static bool commandLineStops(void)
+{
+    return loopBreaks > 0 || loopContinues > 0 || funcReturns || (blockDepth > 0 && loopInterrupted);
+}
+
+/*SIGINT handler while the shell runs a loop or function. It interrupts a
+read builtin waiting for input, as it is installed without SA_RESTART*/
+static void loopSigint(int sig, siginfo_t *info, void *ctxt)
+{
+    loopInterrupted = true;
+}
+
+/*Called when the shell starts running a loop or function itself. The
+outermost one catches Ctrl-C, which then stops them all*/
+static void enterBlock(void)
+{
+    if (blockDepth++ == 0)
+    {
+        struct sigaction sa = {.sa_sigaction = loopSigint, .sa_flags = SA_SIGINFO};
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, &blockOldSigint);
+        loopInterrupted = false;
+    }
+}
+
+/*Undoes enterBlock*/
+static void leaveBlock(void)
+{
+    if (--blockDepth == 0)
+        sigaction(SIGINT, &blockOldSigint, NULL);
+}
+
+/*Points the shell's own stdin and stdout at the redirections of a loop,
+saving the old ones in 'saved', so that the read builtin and the commands
+in the loop use them. Returns false if a file cannot be opened*/
+static bool redirectLoop(struct ast_pipeline *pipe, int saved[2])
+{
+    int in = -1, out = -1;
+    saved[0] = saved[1] = -1;
+    if (pipe->iored_input != NULL)
+    {
+        char *path = var_expand(pipe->iored_input);
+        in = open(path, O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            perror(path);
+        free(path);
+        if (in < 0)
+            return false;
+    }
+    else if (pipe->here_body != NULL)
+    {
+        char *body = var_expand(pipe->here_body);
+        in = openHereDocument(body);
+        free(body);
+        if (in < 0)
+            return false;
+    }
+    if (pipe->iored_output != NULL)
+    {
+        char *path = var_expand(pipe->iored_output);
+        out = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (pipe->append_to_output ? O_APPEND : O_TRUNC), 0666);
+        if (out < 0)
+            perror(path);
+        free(path);
+        if (out < 0)
+        {
+            if (in >= 0)
+                close(in);
+            return false;
+        }
+    }
+
+    if (in >= 0)
+    {
+        /*what was read ahead belongs to the file stdin was*/
+        readbuf_release(0);
+        saved[0] = fcntl(0, F_DUPFD_CLOEXEC, 10);
+        dup2(in, 0);
+        close(in);
+    }
+    if (out >= 0)
+    {
+        fflush(stdout);
+        saved[1] = fcntl(1, F_DUPFD_CLOEXEC, 10);
+        dup2(out, 1);
+        close(out);
+    }
+    return true;
+}
+
+/*Undoes redirectLoop*/
+static void restoreLoopFds(int saved[2])
+{
+    if (saved[0] >= 0)
+    {
+        readbuf_release(0);
+        dup2(saved[0], 0);
+        close(saved[0]);
+    }
+    if (saved[1] >= 0)
+    {
+        fflush(stdout);
+        dup2(saved[1], 1);
+        close(saved[1]);
+    }
+}
+
+/*Runs a loop inside the shell. The condition and the body are walked
+again in each iteration, nothing is parsed twice. Redirections of the
+loop apply to the shell's own stdin and stdout while it runs. Ctrl-C,
+whether the shell or a foreground job gets it, stops all loops. $?
+becomes the status of the body's last command, or 0 if it never ran*/
+void runLoop(struct ast_pipeline *pipe)
+{
+    struct ast_loop *loop = pipe->loop;
+    /*a loop in the background would need a shell process of its own*/
+    if (pipe->bg_job)
+    {
+        fprintf(stderr, "loops cannot run in the background\n");
+        var_set_status(1);
+        return;
+    }
+    int saved[2];
+    if (!redirectLoop(pipe, saved))
+    {
+        var_set_status(1);
+        return;
+    }
+    loopDepth++;
+    enterBlock();
+
+    int status = 0;
+    if (loop->kind == AST_FOR)
+    {
+        /*the words are expanded once, like those of a command*/
+        struct ast_command words = {.argv = loop->words};
+        list_init(&words.procsubs);
+        char **values = expandArgv(&words, NULL);
+        /*the caches for the $((...)) and $(...) in the words are not kept
+        with the loop*/
+        arith_cache_release(words.arith);
+        ast_subst_cache_release(words.subst);
+        for (char **v = values; *v != NULL; v++)
+        {
+            var_set(loop->var, *v, false);
+            runCommand(loop->body);
+            status = var_status();
+            if (loopStops())
+                break;
+        }
+        var_free_argv(values);
+    }
+    else
+    {
+        while (true)
+        {
+            runCommand(loop->cond);
+            if (loopStops() || (var_status() == 0) != (loop->kind == AST_WHILE))
+                break;
+            runCommand(loop->body);
+            status = var_status();
+            if (loopStops())
+                break;
+        }
+    }
+
+    if (loopInterrupted)
+        status = 128 + SIGINT;
+    loopDepth--;
+    leaveBlock();
+    restoreLoopFds(saved);
+    var_set_status(status);
+}
+
+/*Runs the return builtin: "return [n]" leaves the running function with
+status n, or with the status of the command before it*/
+void runReturn(char **argv)
+{
+    if (funcDepth == 0)
+    {
+        printf("return: can only return from a function\n");
+        var_set_status(1);
+        return;
+    }
+    var_set_status(argv[1] != NULL ? atoi(argv[1]) & 255 : builtinPrevStatus);
+    funcReturns = true;
+}
+
+/*Makes the NULL terminated 'args' the positional parameters, unsetting
+the variables of those before that are not set again*/
+static void setPositional(char **args)
+{
+    int old = 0, count = 0;
+    while (positional != NULL && positional[old] != NULL)
+        old++;
+    while (args != NULL && args[count] != NULL)
+        count++;
+
+    char name[16];
+    size_t len = 0;
+    for (int i = 0; i < count || i < old; i++)
+    {
+        snprintf(name, sizeof name, "%d", i + 1);
+        if (i < count)
+        {
+            var_set(name, args[i], false);
+            len += strlen(args[i]) + 1;
+        }
+        else
+        {
+            var_unset(name);
+        }
+    }
+    snprintf(name, sizeof name, "%d", count);
+    var_set("#", name, false);
+
+    /*$@ and $* are the arguments joined by blanks*/
+    char *all = malloc(len + 1), *end = all;
+    *all = '\0';
+    for (int i = 0; i < count; i++)
+        end = stpcpy(stpcpy(end, i > 0 ? " " : ""), args[i]);
+    var_set("@", all, false);
+    var_set("*", all, false);
+    free(all);
+    positional = args;
+}
+
+/*Calls function 'func' with the words after its name in 'argv' as the
+positional parameters. The body runs in the shell, walking the tree parsed
+when the function was defined, so only the external commands in it fork.
+$? becomes the status of its last command, or the one given to return*/
+void runFunction(struct ast_pipeline *pipe, struct ast_function *func, char **argv)
+{
+    /*like loops, a function would need a shell process of its own*/
+    if (pipe->bg_job || list_size(&pipe->commands) > 1)
+    {
+        fprintf(stderr, "%s: functions cannot be part of a pipeline or run in the background\n", argv[0]);
+        var_set_status(1);
+        return;
+    }
+    if (funcDepth >= MAXFUNCDEPTH)
+    {
+        fprintf(stderr, "%s: maximum function nesting level exceeded (%d)\n", argv[0], MAXFUNCDEPTH);
+        var_set_status(1);
+        return;
+    }
+
+    /*the body may define the function again while it runs*/
+    ast_function_ref(func);
+    char **savedPositional = positional;
+    int savedLoopBase = funcLoopBase;
+    setPositional(argv + 1);
+    funcLoopBase = loopDepth;
+    funcDepth++;
+    enterBlock();
+
+    var_set_status(0);
+    runCommand(func->body);
+    if (loopInterrupted)
+        var_set_status(128 + SIGINT);
+
+    leaveBlock();
+    funcDepth--;
+    funcReturns = false;
+    funcLoopBase = savedLoopBase;
+    setPositional(savedPositional);
+    ast_function_free(func);
+}
+
+/*A command that "every" runs as a fresh background job each interval*/
+struct recurring
+{
+    struct list_elem elem;          /* Link element for recurring_list */
+    int id;                         /* its timer, see timerwheel.h */
+    double interval;                /* seconds between runs */
+    struct ast_pipeline *pipe;      /* the command, copied for each run */
+    int jid;                        /* job of the last run, 0 before the first */
+    unsigned long lastSerial;       /* that job's serial, which tells it from a
+                                       later job with the same id */
+    int runs;                       /* runs started */
+    int skipped;                    /* runs skipped while the last one still ran */
+};
+
+/*Removes the first 'n' words of the first command of 'pipe', keeping its
+process substitutions with their words*/
+static void dropWords(struct ast_pipeline *pipe, int n)
+{
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    shiftArgv(cmd, n);
+    for (struct list_elem *e = list_begin(&cmd->procsubs); e != list_end(&cmd->procsubs); e = list_next(e))
+        list_entry(e, struct ast_procsub, elem)->argidx -= n;
+}
+
+/*Timer callback of "every", called from the main loop: starts the next
+run through runCommand unless the last one is still going. A run neither
+announces its start and end nor changes $?*/
+static void runRecurring(int id, void *arg)
+{
+    struct recurring *rc = arg;
+    signal_block(SIGCHLD);
+    struct job *last = get_job_from_jid(rc->jid);
+    bool busy = last != NULL && last->serial == rc->lastSerial && !last->isFinished;
+    signal_unblock(SIGCHLD);
+    if (busy)
+    {
+        rc->skipped++;
+        return;
+    }
+
+    /*From the readline event hook, an error the run prints must not end up
+    in the middle of the input line, which is drawn again afterwards*/
+    bool atPrompt = RL_ISSTATE(RL_STATE_READCMD);
+    if (atPrompt)
+    {
+        rl_clear_visible_line();
+        fflush(rl_outstream);
+    }
+
+    struct ast_pipeline *run = ast_pipeline_copy(rc->pipe);
+    struct ast_command_line *cline = ast_command_line_create(run);
+    unsigned long serial = jobSerial;
+    int status = var_status();
+    quietJob = true;
+    runCommand(cline);
+    quietJob = false;
+    var_set_status(status);
+    rc->runs++;
+    fflush(stdout);
+    if (atPrompt)
+        rl_forced_update_display();
+
+    /*the job made by the run, if it made one*/
+    struct job *jb = NULL;
+    if (jobSerial != serial)
+    {
+        jb = list_entry(list_back(&job_list), struct job, elem);
+        rc->jid = jb->jid;
+        rc->lastSerial = jb->serial;
+    }
+    /*the job owns the pipeline it runs, one that it did not take is ours*/
+    if (jb == NULL || jb->pipe != run)
+        ast_pipeline_free(run);
+    free(cline);
+}
+
+/*Runs "every". "every duration command..." runs the command as a fresh
+background job right away and then every duration, skipping a run while
+the last one still goes; the timers are in a wheel that the main loop
+advances, see timerwheel.h. "every" lists the commands with their ids and
+"every -d id" removes one*/
+void runEvery(struct ast_pipeline *pipe, char **argv)
+{
+    double interval;
+    if (argv[1] == NULL)
+    {
+        for (struct list_elem *e = list_begin(&recurring_list); e != list_end(&recurring_list); e = list_next(e))
+        {
+            struct recurring *rc = list_entry(e, struct recurring, elem);
+            printf("%d\tevery %gs\t(", rc->id, rc->interval);
+            print_cmdline(rc->pipe);
+            printf(")\t%d runs, %d skipped\n", rc->runs, rc->skipped);
+        }
+    }
+    else if (strcompare(argv[1], "-d") == 0 && argv[2] != NULL && argv[3] == NULL)
+    {
+        int id = atoi(argv[2]);
+        for (struct list_elem *e = list_begin(&recurring_list); e != list_end(&recurring_list); e = list_next(e))
+        {
+            struct recurring *rc = list_entry(e, struct recurring, elem);
+            if (rc->id == id)
+            {
+                list_remove(e);
+                timerwheel_remove(id);
+                ast_pipeline_free(rc->pipe);
+                free(rc);
+                return;
+            }
+        }
+        printf("every: %s: no such command\n", argv[2]);
+        var_set_status(1);
+    }
+    else if (argv[2] != NULL && jobtimeout_parse(argv[1], &interval) && interval > 0)
+    {
+        struct ast_pipeline *copy = ast_pipeline_copy(pipe);
+        copy->bg_job = true;
+        copy->connector = AST_SEQUENCE;
+        dropWords(copy, 2);
+
+        /*Builtins, functions and assignments run inside the shell, so they
+        cannot be run as background jobs; refuse them now rather than at
+        every run. Prefixes are checked on a copy that they are stripped from*/
+        struct ast_pipeline *probe = ast_pipeline_copy(copy);
+        struct ast_command *cmd = list_entry(list_begin(&probe->commands), struct ast_command, elem);
+        struct job_prefix prefix;
+        bool ok = consumeJobPrefixes(cmd, &prefix);
+        if (ok && (isAssignmentList(cmd) || checkInternalCommand(cmd)))
+        {
+            printf("every: cannot repeat '%s', which runs inside the shell\n", cmd->argv[0]);
+            ok = false;
+        }
+        ast_pipeline_free(probe);
+        if (!ok)
+        {
+            ast_pipeline_free(copy);
+            var_set_status(1);
+            return;
+        }
+
+        struct recurring *rc = calloc(1, sizeof *rc);
+        rc->interval = interval;
+        rc->pipe = copy;
+        rc->id = timerwheel_add(0, interval, runRecurring, rc);
+        list_push_back(&recurring_list, &rc->elem);
+    }
+    else
+    {
+        printf("Usage: every [duration command... | -d id]\n");
+        var_set_status(2);
+    }
+}
+
+/*The screen of a running "watch"*/
+struct watchScreen
+{
+    struct ast_pipeline *pipe;  /* the command, copied for each run */
+    char *title;                /* the interval and the command */
+    char **lines;               /* what each row of the terminal shows */
+    int numLines;
+    int rows, cols;             /* the size 'lines' was drawn for */
+};
+
+/*Returns the 'len' bytes at 's' as a row of at most 'cols' columns, with
+tabs expanded and other control characters left out*/
+static char *watchLine(const char *s, size_t len, int cols)
+{
+    char *line = malloc(cols + 1);
+    int col = 0;
+    for (size_t i = 0; i < len && col < cols; i++)
+    {
+        if (s[i] == '\t')
+        {
+            do
+                line[col++] = ' ';
+            while (col % 8 != 0 && col < cols);
+        }
+        else if ((unsigned char)s[i] >= ' ' && s[i] != 0x7f)
+        {
+            line[col++] = s[i];
+        }
+    }
+    line[col] = '\0';
+    return line;
+}
+
+/*Draws the title and 'out' on the terminal, rewriting only the rows that
+differ from what it shows. A change of the terminal size redraws all*/
+static void drawWatch(struct watchScreen *ws, const char *out)
+{
+    int rows = 24, cols = 80;
+    struct winsize size;
+    if (ioctl(1, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0)
+    {
+        rows = size.ws_row;
+        cols = size.ws_col;
+    }
+
+    /*the title with the time on the right, a blank row, then the output*/
+    char **lines = calloc(rows, sizeof *lines);
+    char clock[16], *title;
+    time_t now = time(NULL);
+    strftime(clock, sizeof clock, "%H:%M:%S", localtime(&now));
+    int width = cols - (int)strlen(clock) - 1;
+    if (width > 0 && asprintf(&title, "%-*.*s %s", width, width, ws->title, clock) >= 0)
+    {
+        lines[0] = title;
+    }
+    else
+    {
+        lines[0] = watchLine(ws->title, strlen(ws->title), cols);
+    }
+    int n = 1;
+    if (n < rows)
+        lines[n++] = strdup("");
+    for (const char *p = out; n < rows && *p != '\0';)
+    {
+        const char *nl = strchrnul(p, '\n');
+        lines[n++] = watchLine(p, nl - p, cols);
+        p = *nl != '\0' ? nl + 1 : nl;
+    }
+
+    bool full = rows != ws->rows || cols != ws->cols;
+    int shown = full ? 0 : ws->numLines;
+    char *buf;
+    size_t len;
+    FILE *screen = open_memstream(&buf, &len);
+    if (full)
+        fputs("\033[H\033[2J", screen);
+    for (int i = 0; i < n || i < shown; i++)
+    {
+        if (i < n && i < shown && strcmp(lines[i], ws->lines[i]) == 0)
+            continue;
+        fprintf(screen, "\033[%d;1H%s\033[K", i + 1, i < n ? lines[i] : "");
+    }
+    fclose(screen);
+    fflush(stdout);
+    if (len > 0 && write(1, buf, len) < 0)
+        perror("write");
+    free(buf);
+
+    for (int i = 0; i < ws->numLines; i++)
+        free(ws->lines[i]);
+    free(ws->lines);
+    ws->lines = lines;
+    ws->numLines = n;
+    ws->rows = rows;
+    ws->cols = cols;
+}
+
+/*Timer callback of "watch": runs its command with its output captured and
+shows it. Ctrl-C or Ctrl-Z while the command runs reaches the command
+only, and ends the watch as well*/
+static void runWatched(int id, void *arg)
+{
+    struct watchScreen *ws = arg;
+    int status;
+    struct ast_command_line *cline = ast_command_line_create(ast_pipeline_copy(ws->pipe));
+    char *out = captureLines(cline, &status);
+    ast_command_line_free(cline);
+    if (status == 128 + SIGINT || status == 128 + SIGTSTP)
+        loopInterrupted = true;
+    else
+        drawWatch(ws, out);
+    free(out);
+}
+
+/*Runs "watch [-n duration] command...", which shows the output of the
+command, run in the foreground every duration (2s by default), on the
+alternate screen until Ctrl-C. Only the rows that changed are redrawn. The
+shell sleeps in poll until the next timer of the wheel, so commands of
+"every" keep running meanwhile*/
+void runWatch(struct ast_pipeline *pipe, char **argv)
+{
+    double interval = 2;
+    int n = 1;
+    if (argv[1] != NULL && strcompare(argv[1], "-n") == 0)
+    {
+        if (argv[2] == NULL || !jobtimeout_parse(argv[2], &interval) || interval <= 0)
+        {
+            printf("watch: -n requires a duration\n");
+            var_set_status(2);
+            return;
+        }
+        n = 3;
+    }
+    if (argv[n] == NULL)
+    {
+        printf("Usage: watch [-n duration] command...\n");
+        var_set_status(2);
+        return;
+    }
+
+    struct watchScreen ws;
+    memset(&ws, 0, sizeof ws);
+    ws.pipe = ast_pipeline_copy(pipe);
+    ws.pipe->bg_job = false;
+    ws.pipe->connector = AST_SEQUENCE;
+    dropWords(ws.pipe, n);
+    size_t len;
+    FILE *title = open_memstream(&ws.title, &len);
+    fprintf(title, "Every %gs: ", interval);
+    fprintCmdline(title, ws.pipe);
+    fclose(title);
+
+    /*the alternate screen keeps what the terminal showed before*/
+    fflush(stdout);
+    if (write(1, "\033[?1049h", 8) < 0)
+        perror("write");
+    enterBlock();
+    int id = timerwheel_add(0, interval, runWatched, &ws);
+    while (!quit && !loopInterrupted)
+    {
+        timerwheel_advance();
+        int wait = timerwheel_next_ms();
+        if (!loopInterrupted)
+            poll(NULL, 0, wait);
+    }
+    timerwheel_remove(id);
+    leaveBlock();
+    if (write(1, "\033[?1049l", 8) < 0)
+        perror("write");
+
+    for (int i = 0; i < ws.numLines; i++)
+        free(ws.lines[i]);
+    free(ws.lines);
+    free(ws.title);
+    ast_pipeline_free(ws.pipe);
+}
+
+/*Saves the given cmdline into the history list*/
+void saveToHistory(char *cmdline)
+{
+    struct history *hist = malloc(sizeof(struct history));
+    /*Copys the cmdline to the history struct*/
+    hist->command = CpyStringOver(cmdline);
+    /*Append the history struct to the history list*/
+    list_push_back(&history_list, &hist->elem);
+
+    /*Offer the words of the line for completion*/
+    char *words = CpyStringOver(cmdline);
+    for (char *w = strtok(words, " \t|&;<>()"); w != NULL; w = strtok(NULL, " \t|&;<>()"))
+    {
+        complete_add(COMPLETE_HISTORY, w);
+    }
+    free(words);
+}
+
+/*Hands the strings of a NULL terminated array to readline one at a time*/
+static char *nextMatch(char ***matches, int *next, int state)
+{
+    if (state == 0)
+        *next = 0;
+    char *match = (*matches)[*next];
+    if (match == NULL)
+    {
+        free(*matches);
+        *matches = NULL;
+        return NULL;
+    }
+    (*next)++;
+    return match;
+}
+
+/*Readline generator for command names*/
+static char *commandGenerator(const char *text, int state)
+{
+    static char **matches;
+    static int next;
+    if (state == 0)
+        matches = complete_matches(COMPLETE_COMMAND, text, NULL);
+    return nextMatch(&matches, &next, state);
+}
+
+/*Readline generator for job specs such as %2*/
+static char *jobSpecGenerator(const char *text, int state)
+{
+    static struct list_elem *e;
+    if (state == 0)
+        e = list_begin(&job_list);
+    while (e != list_end(&job_list))
+    {
+        struct job *jb = list_entry(e, struct job, elem);
+        e = list_next(e);
+        char spec[16];
+        snprintf(spec, sizeof spec, "%%%d", jb->jid);
+        if (!jb->isFinished && strncmp(spec, text, strlen(text)) == 0)
+            return strdup(spec);
+    }
+    return NULL;
+}
+
+/*Readline generator for arguments: words from the history, then file names*/
+static char *argumentGenerator(const char *text, int state)
+{
+    static char **matches;
+    static int next;
+    static int fileState;
+    if (state == 0)
+    {
+        matches = complete_matches(COMPLETE_HISTORY, text, NULL);
+        fileState = 0;
+    }
+    if (matches != NULL)
+    {
+        char *match = nextMatch(&matches, &next, state);
+        if (match != NULL)
+            return match;
+    }
+    return rl_filename_completion_function(text, fileState++);
+}
+
+/*Chooses what Tab completes: commands for the first word of a command, job
+specs for words starting with %, and history words or file names otherwise*/
+static char **cushCompletion(const char *text, int start, int end)
+{
+    /*the word starts a command if only blanks separate it from the start
+    of the line or from a | & ; or (*/
+    int i = start - 1;
+    while (i >= 0 && (rl_line_buffer[i] == ' ' || rl_line_buffer[i] == '\t'))
+        i--;
+    bool firstWord = i < 0 || strchr("|&;(", rl_line_buffer[i]) != NULL;
+
+    /*do not fall back to readline's own file name completion*/
+    rl_attempted_completion_over = 1;
+    if (text[0] == '%')
+        return rl_completion_matches(text, jobSpecGenerator);
+    if (firstWord && strchr(text, '/') == NULL)
+        return rl_completion_matches(text, commandGenerator);
+    return rl_completion_matches(text, argumentGenerator);
+}
+
+/*This function frees the history list*/
+void history_list_free()
+{
+    /*Loop through the history list and deletes each item*/
+    for (struct list_elem *e = list_begin(&history_list);
+         e != list_end(&history_list);
+         e = list_remove(e))
+    {
+    }
+}
+
+/*This function runs all of the commands present in the cmdline*/
+void runCommand(struct ast_command_line *cmdline)
+{
+    /*Loop through each pipeline of commands, up to a break, continue or return.*/
+    for (struct list_elem *e = list_begin(&cmdline->pipes);
+         e != list_end(&cmdline->pipes) && !commandLineStops();
+         e = list_next(e))
+    {
+        /*Obtain the current pipe*/
+        struct ast_pipeline *pipe1 = list_entry(e, struct ast_pipeline, elem);
+        /*&& and || skip the pipeline, without forking, depending on the
+        status of the pipeline before it. A skipped pipeline leaves the
+        status alone, so "a && b || c" runs c when a fails*/
+        if ((pipe1->connector == AST_AND && var_status() != 0) ||
+            (pipe1->connector == AST_OR && var_status() == 0))
+        {
+            continue;
+        }
+        /*Loops run inside the shell*/
+        if (pipe1->loop != NULL)
+        {
+            runLoop(pipe1);
+            if (quit)
+                break;
+            continue;
+        }
+        /*A definition enters the function into the table*/
+        if (pipe1->func != NULL)
+        {
+            func_define(pipe1->func);
+            var_set_status(0);
+            continue;
+        }
+        /*Obtain the commands in the pipe*/
+        struct list_elem *e2 = list_begin(&pipe1->commands);
+        /*Obtain the first command*/
+        struct ast_command *cmd = list_entry(e2, struct ast_command, elem);
+
+        /*The pipelines of a loop or function run again in the next iteration
+        or call, so the ones that are changed, by stripping prefixes, or that
+        a job keeps and frees are copied. Plain builtins and assignments use
+        the tree*/
+        struct ast_pipeline *copy = NULL;
+        if (blockDepth > 0 && (strcompare(cmd->argv[0], "sched") == 0 || strcompare(cmd->argv[0], "limit") == 0 ||
+                              strcompare(cmd->argv[0], "timeout") == 0 ||
+                              !(isAssignmentList(cmd) || checkInternalCommand(cmd))))
+        {
+            pipe1 = copy = ast_pipeline_copy(pipe1);
+            cmd = list_entry(list_begin(&pipe1->commands), struct ast_command, elem);
+        }
+
+        /*Strip prefixes such as "sched -n 10" and remember their settings*/
+        struct job_prefix prefix;
+        if (!consumeJobPrefixes(cmd, &prefix))
+        {
+            var_set_status(1);
+            if (copy != NULL)
+                ast_pipeline_free(copy);
+            continue;
+        }
+
+        /*A command made only of assignments sets shell variables*/
+        if (isAssignmentList(cmd))
+        {
+            var_set_status(runAssignments(cmd) ? 0 : 1);
+            if (copy != NULL)
+                ast_pipeline_free(copy);
+            continue;
+        }
+
+        /*Check if the command is internal*/
+        bool isInternal = checkInternalCommand(cmd);
+
+        /*If the command is internal run the internal command fucntion and go on
+        with the next pipeline. Builtins succeed unless they set a status*/
+        if (isInternal)
+        {
+            uint64_t builtinStart = stats_now();
+            /*builtins see their words with variables expanded, in an array of
+            their own since a function may run this same command again while
+            it runs*/
+            builtinPrevStatus = var_status();
+            expandFailed = false;
+            char **argv = expandArgv(cmd, NULL);
+            var_set_status(expandFailed ? 1 : 0);
+            if (!expandFailed)
+                runInternalCommand(pipe1, argv);
+            var_free_argv(argv);
+            stats_record_since(STATS_BUILTIN, builtinStart);
+            if (copy != NULL)
+                ast_pipeline_free(copy);
+            if (quit)
+                break;
+            continue;
+        }
+        /*If the command is not internal continue*/
+
+        /*Scince command pipe is not internal the pipe is added to the job list*/
+        struct job *jb = add_job(pipe1);
+        jb->sched = prefix.sched;
+        joblimits_merge(&jb->limits, &prefix.limits);
+        jb->timeout = prefix.timeout;
+        jb->killAfter = prefix.killAfter;
+        jb->reportDone = !quietJob;
+
+        /*A background job over the limit waits in the queue without being forked*/
+        signal_block(SIGCHLD);
+        if (jb->pipe->bg_job && bgJobLimit > 0 && countRunningBackgroundJobs() >= bgJobLimit)
+        {
+            jb->status = QUEUED;
+            list_push_back(&queued_list, &jb->queueElem);
+            if (!quietJob)
+                printf("[%d] queued\n", jb->jid);
+            var_set_status(0);
+            signal_unblock(SIGCHLD);
+            continue;
+        }
+        /*Fork all processes of the job, SIGCHLD stays blocked until they are set up*/
+        spawnJob(jb);
+        /*background jobs started under the sched -b policy run deprioritized*/
+        jb->deprioritized = jb->pipe->bg_job && bgNicePolicy >= 0;
+
+        /*If the current job is not a Background job*/
+        if (!jb->pipe->bg_job)
+        {
+            /*Give control of terminal to the running process group*/
+            termstate_give_terminal_to(NULL, jb->pgid);
+            /*Wait for the job, then report how it stopped or ended*/
+            wait_for_job(jb);
+            fprintNotices(stdout);
+            /*a job stopped with Ctrl-Z counts as failed, like in bash*/
+            var_set_status(jb->isFinished ? jb->exitStatus : 128 + SIGTSTP);
+            /*Ctrl-C ends the loops the job runs in too*/
+            if (jb->wasKilled && jb->exitStatus == 128 + SIGINT)
+                loopInterrupted = true;
+            /*after waiting completed return back terminal controk to the shell*/
+            termstate_give_terminal_back_to_shell();
+        }
+
+        /*If the current job is a Background job*/
+        if (jb->pipe->bg_job)
+        {
+            /*Update the job status and print job*/
+            jb->status = BACKGROUND;
+            if (!quietJob)
+                printf("[%d] %d\n", jb->jid, jb->lastPid);
+            var_set_status(0);
+        }
+        /*Unblock SigChld*/
+        signal_unblock(SIGCHLD);
+    }
+}
+
+/*Returns the number of jobs that have not finished yet*/
+int countActiveJobs(void)
+{
+    int count = 0;
+    for (struct list_elem *e = list_begin(&job_list);
+         e != list_end(&job_list);
+         e = list_next(e))
+    {
+        struct job *jb = list_entry(e, struct job, elem);
+        if (!jb->isFinished)
+            count++;
+    }
+    return count;
+}
+
+/*Returns the number of background jobs that are currently running*/
+int countRunningBackgroundJobs(void)
+{
+    int count = 0;
+    for (struct list_elem *e = list_begin(&job_list);
+         e != list_end(&job_list);
+         e = list_next(e))
+    {
+        struct job *jb = list_entry(e, struct job, elem);
+        if (jb->status == BACKGROUND && !jb->isFinished)
+            count++;
+    }
+    return count;
+}
+
+/*Takes a job off the queue and forks its processes. SIGCHLD must be blocked*/
+void startQueuedJob(struct job *jb)
+{
+    assert(jb->status == QUEUED);
+    list_remove(&jb->queueElem);
+    jb->status = BACKGROUND;
+    spawnJob(jb);
+    jb->deprioritized = jb->pipe->bg_job && bgNicePolicy >= 0;
+}
+
+/*Starts queued jobs in order while the background job limit allows it,
+printing their ids to 'out'. Called from the main loop after background
+jobs finished, and when the limit changes; never from the SIGCHLD handler*/
+void admitQueuedJobs(FILE *out)
+{
+    assert(signal_is_blocked(SIGCHLD));
+    bgSlotFreed = false;
+    while (!list_empty(&queued_list) &&
+           (bgJobLimit == 0 || countRunningBackgroundJobs() < bgJobLimit))
+    {
+        struct job *jb = list_entry(list_front(&queued_list), struct job, queueElem);
+        startQueuedJob(jb);
+        fprintf(out, "[%d] %d\n", jb->jid, jb->lastPid);
+    }
+}
+
+/*Returns the job id given by a job spec such as "2" or "%2", or 0*/
+int parseJobId(const char *spec)
+{
+    if (*spec == '%')
+        spec++;
+    return atoi(spec);
+}
+
+/*Returns true if 'word' looks like a job spec: a job id with an optional %*/
+bool isJobSpec(const char *word)
+{
+    if (*word == '%')
+        word++;
+    if (*word == '\0')
+        return false;
+    for (; *word; word++)
+    {
+        if (*word < '0' || *word > '9')
+            return false;
+    }
+    return true;
+}
+
+/*Removes the first 'n' words from the argv of 'cmd'*/
+void shiftArgv(struct ast_command *cmd, int n)
+{
+    for (int i = 0; i < n; i++)
+        free(cmd->argv[i]);
+    int len = n;
+    while (cmd->argv[len] != NULL)
+        len++;
+    memmove(cmd->argv, cmd->argv + n, (len - n + 1) * sizeof(char *));
+}
+
+/*Strips prefix commands such as "sched -c 0-3 -n 10", "limit -v 2G" or
+"timeout 10s" from the front of 'cmd' and collects their settings in 'prefix'.
+A prefix without a command after it is left alone since it is a builtin invocation. Returns
+false on a usage error, or if the command is a builtin, function or assignment, which run
+inside the shell where the settings cannot apply*/
+bool consumeJobPrefixes(struct ast_command *cmd, struct job_prefix *prefix)
+{
+    memset(prefix, 0, sizeof *prefix);
+    while (cmd->argv[0] != NULL)
+    {
+        if (strcompare(cmd->argv[0], "limit") == 0)
+        {
+            struct joblimits limits;
+            int n = joblimits_parse(cmd->argv + 1, &limits, NULL);
+            if (n < 0)
+                return false;
+            if (cmd->argv[1 + n] == NULL)
+                break;
+            joblimits_merge(&prefix->limits, &limits);
+            shiftArgv(cmd, 1 + n);
+            prefix->name = prefix->name ? prefix->name : "limit";
+            continue;
+        }
+        /*"timeout [-k duration] duration"*/
+        if (strcompare(cmd->argv[0], "timeout") == 0)
+        {
+            int n = 1;
+            double killAfter = JOBTIMEOUT_KILL_AFTER, secs;
+            if (cmd->argv[n] != NULL && strcompare(cmd->argv[n], "-k") == 0)
+            {
+                if (cmd->argv[n + 1] == NULL || !jobtimeout_parse(cmd->argv[n + 1], &killAfter))
+                {
+                    printf("timeout: -k requires a duration\n");
+                    return false;
+                }
+                n += 2;
+            }
+            if (cmd->argv[n] == NULL || cmd->argv[n + 1] == NULL)
+                break;
+            if (!jobtimeout_parse(cmd->argv[n], &secs))
+            {
+                printf("timeout: invalid duration '%s'\n", cmd->argv[n]);
+                return false;
+            }
+            /*the shortest of nested timeouts applies*/
+            if (prefix->timeout == 0 || secs < prefix->timeout)
+            {
+                prefix->timeout = secs;
+                prefix->killAfter = killAfter;
+            }
+            shiftArgv(cmd, n + 1);
+            prefix->name = prefix->name ? prefix->name : "timeout";
+            continue;
+        }
+        if (strcompare(cmd->argv[0], "sched") != 0)
+            break;
+
+        struct jobsched sched;
+        int n = jobsched_parse(cmd->argv + 1, &sched);
+        if (n < 0)
+            return false;
+        /*"sched [opts]" and "sched [opts] %N" are run by the builtin*/
+        char **rest = cmd->argv + 1 + n;
+        if (*rest == NULL || **rest == '-' || (isJobSpec(*rest) && rest[1] == NULL))
+            break;
+        jobsched_merge(&prefix->sched, &sched);
+        shiftArgv(cmd, 1 + n);
+        prefix->name = prefix->name ? prefix->name : "sched";
+    }
+    if (prefix->name != NULL && (isAssignmentList(cmd) || checkInternalCommand(cmd)))
+    {
+        printf("%s: cannot apply to '%s', which runs inside the shell\n", prefix->name, cmd->argv[0]);
+        return false;
+    }
+    return true;
+}
+
+/*Computes the settings a job gets while the sched -b policy keeps it in
+the background: its own settings, but at least the policy's nice value
+and the lowest best-effort I/O priority*/
+void getBackgroundSched(struct job *jb, struct jobsched *sched)
+{
+    *sched = jb->sched;
+    if (bgNicePolicy < 0)
+        return;
+    if (!sched->has_nice || sched->nice < bgNicePolicy)
+    {
+        sched->has_nice = true;
+        sched->nice = bgNicePolicy;
+    }
+    if (!sched->has_ioprio || sched->ioclass != JOBSCHED_IO_IDLE)
+    {
+        sched->has_ioprio = true;
+        sched->ioclass = JOBSCHED_IO_BE;
+        sched->iolevel = 7;
+    }
+}
+
+/*Lowers the priority of a running job that moved to the background*/
+void deprioritizeJob(struct job *jb)
+{
+    if (bgNicePolicy < 0 || jb->deprioritized || jb->pgid <= 0)
+        return;
+    struct jobsched sched;
+    getBackgroundSched(jb, &sched);
+    jobsched_apply_pgrp(jb->pgid, &sched);
+    jb->deprioritized = true;
+}
+
+/*Gives a job that is moved to the foreground its own priority back*/
+void restoreJobPriority(struct job *jb)
+{
+    if (!jb->deprioritized || jb->pgid <= 0)
+        return;
+    struct jobsched sched = jb->sched;
+    if (!sched.has_nice)
+    {
+        sched.has_nice = true;
+        sched.nice = getpriority(PRIO_PROCESS, 0);
+    }
+    if (!sched.has_ioprio)
+    {
+        sched.has_ioprio = true;
+        sched.ioclass = JOBSCHED_IO_NONE;
+        sched.iolevel = 0;
+    }
+    /*raising priority again needs CAP_SYS_NICE or a suitable RLIMIT_NICE*/
+    if (!jobsched_apply_pgrp(jb->pgid, &sched))
+    {
+        fprintf(stderr, "sched: could not fully restore the priority of job %d\n", jb->jid);
+    }
+    jb->deprioritized = false;
+}
+
+/*Runs the sched builtin:
+  sched                       print the shell's settings and the policy
+  sched -b NICE|off           run background jobs at nice NICE (and low I/O priority)
+  sched [opts] %N             print or change the settings of a running job
+  sched [opts] cmd args...    run cmd with the settings (handled as a prefix)*/
+void runSched(char **argv)
+{
+    if (argv[1] != NULL && strcompare(argv[1], "-b") == 0)
+    {
+        if (argv[2] == NULL)
+            printf("sched -b requires a nice value or 'off'\n");
+        else if (strcompare(argv[2], "off") == 0)
+            bgNicePolicy = -1;
+        else if (atoi(argv[2]) < 0 || atoi(argv[2]) > 19)
+            printf("sched -b: nice value must be between 0 and 19\n");
+        else
+            bgNicePolicy = atoi(argv[2]);
+        return;
+    }
+
+    struct jobsched sched;
+    int n = jobsched_parse(argv + 1, &sched);
+    if (n < 0)
+        return;
+    char *spec = argv[1 + n];
+
+    /*Without a job print the shell's own settings and the policy*/
+    if (spec == NULL)
+    {
+        jobsched_print(0);
+        if (bgNicePolicy < 0)
+            printf("background policy off\n");
+        else
+            printf("background policy nice %d\n", bgNicePolicy);
+        return;
+    }
+    if (*spec == '-')
+    {
+        printf("Usage: sched [-c cpus] [-n nice] [-i class[:level]] [%%job | command...]\n");
+        return;
+    }
+
+    struct job *jb = get_job_from_jid(parseJobId(spec));
+    if (jb == NULL || jb->pgid <= 0)
+    {
+        printf("sched: no running job %s\n", spec);
+        return;
+    }
+    if (n == 0)
+    {
+        jobsched_print(jb->pgid);
+        return;
+    }
+    jobsched_merge(&jb->sched, &sched);
+    jobsched_apply_pgrp(jb->pgid, &sched);
+}
+
+/*Runs the ulimit builtin, which sets the limits every job starts with:
+  ulimit [-a]                 print all limits
+  ulimit -v                   print one limit
+  ulimit -v 2G -n 1024        set limits for jobs started from now on*/
+void runUlimit(char **argv)
+{
+    struct joblimits limits;
+    bool queries[JOBLIMIT_COUNT];
+    int n = joblimits_parse(argv + 1, &limits, queries);
+    if (n < 0)
+        return;
+    if (argv[1 + n] != NULL)
+    {
+        printf("ulimit: unexpected argument '%s'\n", argv[1 + n]);
+        return;
+    }
+
+    bool anySet = false, anyQuery = false;
+    for (int i = 0; i < JOBLIMIT_COUNT; i++)
+    {
+        anySet |= limits.has[i];
+        anyQuery |= queries[i];
+    }
+    joblimits_merge(&defaultLimits, &limits);
+    if (anyQuery || !anySet)
+    {
+        joblimits_print(&defaultLimits, anyQuery ? queries : NULL);
+    }
+}
+
+/*Returns a close-on-exec file descriptor from which the text 'body' of a
+here-document can be read. A body that fits in the capacity of a pipe is
+written into one right away; a larger one goes into a sealed memfd so that
+the writer never has to wait for the reader. Neither touches the file system*/
+static int openHereDocument(const char *body)
+{
+    size_t len = strlen(body);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == 0)
+    {
+        int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+        if (capacity > 0 && len <= (size_t)capacity && write(fds[1], body, len) == (ssize_t)len)
+        {
+            close(fds[1]);
+            return fds[0];
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    int fd = memfd_create("cush-here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        perror("memfd_create");
+        return -1;
+    }
+    for (size_t done = 0; done < len;)
+    {
+        ssize_t n = write(fd, body + done, len - done);
+        if (n < 0)
+        {
+            perror("here-document");
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    /*the body is read-only from now on*/
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/*Reads a line of a here-document or of a loop from the terminal*/
+static char *readTerminalLine(void *ctx)
+{
+    /*the prompt hook would replace "> " with PS1*/
+    rl_hook_func_t *hook = rl_event_hook;
+    rl_event_hook = NULL;
+    char *line = readline(isatty(0) ? "> " : NULL);
+    rl_event_hook = hook;
+    return line;
+}
+
+/*Reads the body of a here-document one line at a time up to the line
+holding only 'delim'. 'nextLine' returns the next malloc'd line from 'ctx',
+or NULL at the end*/
+static char *readHereBody(const char *delim, char *(*nextLine)(void *ctx), void *ctx)
+{
+    size_t len = 0, cap = 256;
+    char *body = malloc(cap);
+    while (true)
+    {
+        char *line = nextLine(ctx);
+        if (line == NULL)
+        {
+            fprintf(stderr, "here-document ended by end of input (wanted '%s')\n", delim);
+            break;
+        }
+        if (strcmp(line, delim) == 0)
+        {
+            free(line);
+            break;
+        }
+        size_t n = strlen(line);
+        while (len + n + 2 > cap)
+        {
+            cap *= 2;
+            body = realloc(body, cap);
+        }
+        memcpy(body + len, line, n);
+        len += n;
+        body[len++] = '\n';
+        free(line);
+    }
+    body[len] = '\0';
+    return body;
+}
+
+/*Reads the body of each here-document of a command line that does not
+have one yet, in the order they appear*/
+static void readHereDocuments(struct ast_command_line *cline,
+                              char *(*nextLine)(void *ctx), void *ctx)
+{
+    for (struct list_elem *e = list_begin(&cline->here_docs);
+         e != list_end(&cline->here_docs);
+         e = list_next(e))
+    {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, here_elem);
+        if (pipe->here_body == NULL)
+            pipe->here_body = readHereBody(pipe->here_delim, nextLine, ctx);
+    }
+}
+
+/*Parses 'line' and, as long as it ends inside a loop, the lines from
+'nextLine' that continue it, joined by newlines. The bodies of the
+here-documents are read from the lines right after the one they start
+on, inside a loop too. Returns the command line, NULL on a syntax error,
+and the malloc'd text of all its lines in '*text'*/
+static struct ast_command_line *parseLines(const char *line, char *(*nextLine)(void *ctx),
+                                           void *ctx, char **text)
+{
+    char *all = strdup(line);
+    size_t nbodies = 0;
+    char **bodies = NULL;
+    struct ast_command_line *cline;
+    while ((cline = ast_parse_command_line(all)) == NULL && ast_parse_incomplete())
+    {
+        const char *delim;
+        while ((delim = ast_parse_here_delim(nbodies)) != NULL)
+        {
+            bodies = realloc(bodies, (nbodies + 1) * sizeof *bodies);
+            bodies[nbodies++] = readHereBody(delim, nextLine, ctx);
+        }
+        char *more = nextLine(ctx);
+        if (more == NULL)
+        {
+            fprintf(stderr, "loop ended by end of input (wanted 'done')\n");
+            break;
+        }
+        size_t len = strlen(all);
+        all = realloc(all, len + strlen(more) + 2);
+        all[len] = '\n';
+        strcpy(all + len + 1, more);
+        free(more);
+    }
+
+    size_t i = 0;
+    if (cline != NULL)
+    {
+        for (struct list_elem *e = list_begin(&cline->here_docs);
+             e != list_end(&cline->here_docs) && i < nbodies;
+             e = list_next(e))
+        {
+            list_entry(e, struct ast_pipeline, here_elem)->here_body = bodies[i++];
+        }
+        readHereDocuments(cline, nextLine, ctx);
+    }
+    for (; i < nbodies; i++)
+        free(bodies[i]);
+    free(bodies);
+    *text = all;
+    return cline;
+}
+
+/*This function forks one process for each command in the job's pipeline,
+puts them in a new process group and wires up their pipes. SIGCHLD is
+blocked on return; the caller unblocks it once the job is recorded.*/
+void spawnJob(struct job *jb)
+{
+    /*Block SigCHLD*/
+    signal_block(SIGCHLD);
+    /*Bring the cached environment up to date once so children share it*/
+    var_environ();
+    /*While joblog is on a background job writes to its log, see jobout.h*/
+    int logFd = -1;
+    if (jb->pipe->bg_job && jb->outFd < 0)
+    {
+        char *text = NULL;
+        size_t len;
+        FILE *out = open_memstream(&text, &len);
+        fprintCmdline(out, jb->pipe);
+        fclose(out);
+        logFd = jb->outFd = jobout_capture(jb->jid, text);
+        free(text);
+    }
+    spawnPipeline(jb, jb->pipe, -1, -1);
+    if (logFd >= 0)
+    {
+        close(logFd);
+        jb->outFd = -1;
+    }
+    /*The deadline of the timeout prefix runs from here, see jobtimeout.h*/
+    if (jb->timeout > 0 && jb->totalProc > 0)
+    {
+        jb->deadline = jobtimeout_start(jb->pgid, jb->timeout, jb->killAfter);
+    }
+}
+
+/*Starts a command of a pipeline from the zygote, see zygote.h. The
+redirections that runChildProcess sets up in the child are opened here and
+passed along. Returns the pid, or -1 if the command must be forked: when
+there is no zygote, for process substitutions, whose pipes must keep their
+numbers, for functions and failed expansions, and for redirections that
+cannot be opened, which the forked child reports*/
+static pid_t spawnFromZygote(int currCommand, int numCommands, int j, struct job *jb, int pipefds[],
+                             struct ast_pipeline *pipeline, struct ast_command *cmd, char **argv,
+                             int inFd, int outFd)
+{
+    if (!zygote_running() || !list_empty(&cmd->procsubs) || expandFailed ||
+        argv[0] == NULL || func_lookup(argv[0]) != NULL)
+    {
+        return -1;
+    }
+
+    int fds[3] = {0, 1, 2};
+    int inFile = -1, outFile = -1;
+    /*stdin: the previous command's pipe, a file or a process substitution pipe*/
+    if (j != 0)
+    {
+        fds[0] = pipefds[j - 2];
+    }
+    else if (pipeline->iored_input != NULL)
+    {
+        char *path = var_expand(pipeline->iored_input);
+        inFile = open(path, O_RDONLY | O_CLOEXEC);
+        free(path);
+        if (inFile < 0)
+            return -1;
+        fds[0] = inFile;
+    }
+    else if (inFd >= 0)
+    {
+        fds[0] = inFd;
+    }
+    /*stdout: the next command's pipe, a file, a process substitution pipe or
+    the job's capture fd*/
+    if (currCommand != numCommands - 1)
+    {
+        fds[1] = pipefds[j + 1];
+    }
+    else if (pipeline->iored_output != NULL)
+    {
+        char *path = var_expand(pipeline->iored_output);
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (pipeline->append_to_output ? O_APPEND : O_TRUNC);
+        outFile = open(path, flags, 0666);
+        free(path);
+        if (outFile < 0)
+        {
+            if (inFile >= 0)
+                close(inFile);
+            return -1;
+        }
+        fds[1] = outFile;
+    }
+    else if (outFd >= 0)
+    {
+        fds[1] = outFd;
+    }
+    else if (jb->outFd >= 0)
+    {
+        fds[1] = jb->outFd;
+    }
+    /*stderr: the capture fd, or stdout for >& and |&*/
+    if (jb->outFd >= 0)
+    {
+        fds[2] = jb->outFd;
+    }
+    if (cmd->dup_stderr_to_stdout)
+    {
+        fds[2] = fds[1];
+    }
+
+    struct jobsched sched = jb->sched;
+    if (jb->pipe->bg_job)
+    {
+        getBackgroundSched(jb, &sched);
+    }
+    pid_t pid = zygote_spawn(argv, var_environ(), fds, jb->pgid == -1 ? 0 : jb->pgid,
+                             &sched, &jb->limits);
+    if (inFile >= 0)
+        close(inFile);
+    if (outFile >= 0)
+        close(outFile);
+    return pid;
+}
+
+/*Forks the commands of 'pipeline' into the process group of 'jb', which is
+created by the first process if the job has none yet. If 'inFd' or 'outFd'
+are not -1 they become stdin of the first and stdout of the last command,
+which is how the pipelines of process substitutions are wired up*/
+void spawnPipeline(struct job *jb, struct ast_pipeline *pipeline, int inFd, int outFd)
+{
+    /*Obtain number of commands*/
+    int numCommands = list_size(&pipeline->commands);
+    /*Calculate number of pipes*/
+    int numPipes = numCommands - 1;
+    /*set the current command*/
+    int currCommand = 0;
+    /*J is used as a counter for the pipes*/
+    int j = 0;
+    /*The children must find stdin where the read builtin stopped*/
+    readbuf_release_all();
+    /*A here-document or here-string is stdin of the first command*/
+    int hereFd = -1;
+    if (pipeline->here_body != NULL && inFd == -1)
+    {
+        char *body = var_expand(pipeline->here_body);
+        hereFd = inFd = openHereDocument(body);
+        free(body);
+    }
+
+    /* Pipes Declarations Block*/
+    /*all pipes are close-on-exec, children dup2 the ends they need*/
+    int pipefds[2 * numPipes];
+    for (int i = 0; i < numPipes; i++)
+    {
+        if (pipe2(pipefds + i * 2, O_CLOEXEC) < 0)
+        {
+            perror("couldn't pipe");
+            exit(EXIT_FAILURE);
+        }
+    }
+    /****************************/
+
+    /*Loop through the pipe to run each command as part of the pipeline*/
+    for (struct list_elem *e2 = list_begin(&pipeline->commands);
+         e2 != list_end(&pipeline->commands);
+         e2 = list_next(e2))
+    {
+        /*Obtain the ast_command from the pipe*/
+        struct ast_command *cmd = list_entry(e2, struct ast_command, elem);
+        if (jb->totalProc == MAXPROCS)
+        {
+            fprintf(stderr, "Maximum number of processes in job %d exceeded\n", jb->jid);
+            break;
+        }
+
+        /*One pipe per process substitution of this command*/
+        int numSubs = list_size(&cmd->procsubs);
+        int psfds[2 * numSubs + 1];
+        for (int i = 0; i < numSubs; i++)
+        {
+            if (pipe2(psfds + i * 2, O_CLOEXEC) < 0)
+            {
+                perror("couldn't pipe");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /*Expand the words here so that the shell's directory cache is used*/
+        expandFailed = false;
+        char **argv = expandArgv(cmd, psfds);
+
+        /*Time the fork until the child has been placed in its job*/
+        uint64_t forkStart = stats_now();
+        /*While the shell runs a loop or function, a Ctrl-C that reaches the
+        child before it execs must kill it rather than run the shell's SIGINT
+        handler*/
+        bool inLoop = blockDepth > 0;
+        /*The zygote starts the command if it can, which needs no fork of the
+        shell; its processes start with SIGINT at its default already*/
+        pid_t pid = spawnFromZygote(currCommand, numCommands, j, jb, pipefds, pipeline, cmd, argv, inFd, outFd);
+        if (pid > 0)
+        {
+            inLoop = false;
+        }
+        else
+        {
+            if (inLoop)
+                signal_block(SIGINT);
+            /*Fork to create a parent and child process*/
+            pid = fork();
+
+            /*Child Code Block*/
+            if (pid == 0)
+            {
+                if (inLoop)
+                {
+                    signal(SIGINT, SIG_DFL);
+                    signal_unblock(SIGINT);
+                }
+                /*create a new process group if this is the job's first process,
+                else put the process in the group of the first one*/
+                setpgid(0, jb->pgid == -1 ? 0 : jb->pgid);
                 /*Run the current command*/
-                runChildProcess(currCommand, numCommands, numPipes, j, jb, pipefds, comd, argg);
+                runChildProcess(currCommand, numCommands, numPipes, j, jb, pipefds, pipeline, cmd, argv, inFd, outFd, psfds);
             }
             /********************************************************/
 
-            /*Error if not correctly forked*/
-            else if (pid < 0)
-            {
-                perror("error");
-                exit(EXIT_FAILURE);
-            }
+            /*Error if not correctly forked*/
+            else if (pid < 0)
+            {
+                perror("error");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /*Parent Code Block*/
+        /*Sets the Process group id to the first spawned processes pid*/
+        if (jb->pgid == -1)
+        {
+            jb->pgid = pid;
+        }
+
+        setpgid(pid, jb->pgid);
+        if (inLoop)
+            signal_unblock(SIGINT);
+        stats_record_since(STATS_FORK, forkStart);
+        var_free_argv(argv);
+        /*Fills in the pid array in jobs*/
+        jb->pids[jb->totalProc] = pid;
+        /*The last command of the job's own pipeline decides its exit status*/
+        if (pipeline == jb->pipe && currCommand == numCommands - 1)
+        {
+            jb->lastPid = pid;
+        }
+        /*increment counter*/
+        j += 2;
+        /*update the job*/
+        jb->num_processes_alive = jb->num_processes_alive + 1;
+        jb->totalProc = jb->totalProc + 1;
+        /*increment counter*/
+        currCommand++;
+
+        /*Start the process substitutions of this command in the same job,
+        each one talking to the command through its end of the pipe*/
+        int i = 0;
+        for (struct list_elem *e3 = list_begin(&cmd->procsubs);
+             e3 != list_end(&cmd->procsubs);
+             e3 = list_next(e3), i++)
+        {
+            struct ast_procsub *ps = list_entry(e3, struct ast_procsub, elem);
+            if (ps->is_output)
+                spawnPipeline(jb, ps->pipe, psfds[2 * i], -1);
+            else
+                spawnPipeline(jb, ps->pipe, -1, psfds[2 * i + 1]);
+        }
+        closePipes(numSubs, psfds);
+        /********************************************************/
+    }
+    /*call function to close all open pipes*/
+    closePipes(numPipes, pipefds);
+    if (hereFd >= 0)
+    {
+        close(hereFd);
+    }
+}
+
+/*Size of the reads that collect the output of a command substitution*/
+#define CAPTURE_CHUNK (64 * 1024)
+/*How often a substitution that prints nothing is checked for having stopped*/
+#define CAPTURE_POLL_MS 100
+
+/*Reads once from 'fd', appending to the growable buffer 'buf' of 'len'
+bytes and 'cap' capacity. Each read asks for a whole chunk and goes
+straight into the buffer. Returns false at end of file*/
+static bool readOutput(int fd, char **buf, size_t *len, size_t *cap)
+{
+    if (*cap - *len < CAPTURE_CHUNK)
+    {
+        *cap = 2 * *cap + CAPTURE_CHUNK;
+        *buf = realloc(*buf, *cap);
+    }
+    ssize_t n = read(fd, *buf + *len, *cap - *len);
+    if (n < 0 && errno == EINTR)
+        return true;
+    if (n <= 0)
+        return false;
+    *len += n;
+    return true;
+}
+
+/*Reads 'fd' until end of file into 'buf', see readOutput*/
+static void readAllOutput(int fd, char **buf, size_t *len, size_t *cap)
+{
+    while (readOutput(fd, buf, len, cap))
+        ;
+}
+
+/*Shell state that a command substitution leaves alone. Its builtins,
+assignments, loops and function definitions run in the shell itself, so
+the state is saved before the first of them and put back when the
+substitution ends, as if they had run in a subshell*/
+struct substState
+{
+    bool saved;
+    int cwd;                      /* the working directory, -1 if it could not be opened */
+    struct var_snapshot *vars;    /* variables, see variables.h */
+    struct func_snapshot *funcs;  /* functions, see functions.h */
+    struct joblimits limits;      /* ulimit */
+    int bgJobLimit;               /* bglimit */
+    int bgNicePolicy;             /* sched -b */
+};
+
+/*Saves the state in 'st' unless it was saved already*/
+static void saveSubstState(struct substState *st)
+{
+    if (st->saved)
+        return;
+    st->saved = true;
+    st->cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    st->vars = var_save();
+    st->funcs = func_save();
+    st->limits = defaultLimits;
+    st->bgJobLimit = bgJobLimit;
+    st->bgNicePolicy = bgNicePolicy;
+}
+
+/*Puts back the state saved in 'st', if any*/
+static void restoreSubstState(struct substState *st)
+{
+    if (!st->saved)
+        return;
+    if (st->cwd >= 0)
+    {
+        if (fchdir(st->cwd) < 0)
+            perror("cd");
+        close(st->cwd);
+    }
+    var_restore(st->vars);
+    func_restore(st->funcs);
+    defaultLimits = st->limits;
+    bgJobLimit = st->bgJobLimit;
+    bgNicePolicy = st->bgNicePolicy;
+    st->saved = false;
+}
+
+/*Runs a builtin, or a loop if 'cmd' is NULL, with its stdout going to a
+memfd and appends what it printed to 'buf'. The builtin itself forks no
+process*/
+static void captureBuiltin(struct ast_pipeline *pipe, struct ast_command *cmd,
+                           char **buf, size_t *len, size_t *cap)
+{
+    int fd = memfd_create("cush-substitution", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("memfd_create");
+        return;
+    }
+    fflush(stdout);
+    int savedStdout = fcntl(1, F_DUPFD_CLOEXEC, 3);
+    dup2(fd, 1);
+
+    /*exit, break, continue and return in a substitution only leave the
+    substitution*/
+    bool savedQuit = quit, savedReturns = funcReturns;
+    int savedBreaks = loopBreaks, savedContinues = loopContinues;
+    if (cmd == NULL)
+    {
+        runLoop(pipe);
+    }
+    else
+    {
+        builtinPrevStatus = var_status();
+        expandFailed = false;
+        char **argv = expandArgv(cmd, NULL);
+        var_set_status(expandFailed ? 1 : 0);
+        if (!expandFailed)
+            runInternalCommand(pipe, argv);
+        var_free_argv(argv);
+    }
+    quit = savedQuit;
+    funcReturns = savedReturns;
+    loopBreaks = savedBreaks;
+    loopContinues = savedContinues;
+
+    fflush(stdout);
+    dup2(savedStdout, 1);
+    close(savedStdout);
+    lseek(fd, 0, SEEK_SET);
+    readAllOutput(fd, buf, len, cap);
+    close(fd);
+}
+
+/*Forks 'pipe' with its stdout going to a pipe and appends everything it
+writes to 'buf'. The processes form a process group of their own that
+holds the terminal while they run, but they are not a job: they are
+waited for here, with SIGCHLD blocked so the handler cannot reap them.
+Since a group that stops (Ctrl-Z) would neither close the pipe nor give
+the terminal back, the pipe is polled and the group is checked for
+stopped processes, and killed if it has one. Returns the exit status of
+the last command, 128+SIGTSTP if the group was stopped*/
+static int captureCommand(struct ast_pipeline *pipe, struct job_prefix *prefix,
+                          char **buf, size_t *len, size_t *cap)
+{
+    struct job sub;
+    memset(&sub, 0, sizeof sub);
+    sub.pipe = pipe;
+    sub.pgid = -1;
+    sub.lastPid = -1;
+    sub.outFd = -1;
+    sub.status = FOREGROUND;
+    sub.sched = prefix->sched;
+    sub.limits = defaultLimits;
+    joblimits_merge(&sub.limits, &prefix->limits);
+    sub.timeout = prefix->timeout;
+    sub.killAfter = prefix->killAfter;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        perror("couldn't pipe");
+        return 1;
+    }
+    var_environ();
+    spawnPipeline(&sub, pipe, -1, fds[1]);
+    close(fds[1]);
+    if (sub.totalProc > 0)
+        termstate_give_terminal_to(NULL, sub.pgid);
+    if (sub.timeout > 0 && sub.totalProc > 0)
+        sub.deadline = jobtimeout_start(sub.pgid, sub.timeout, sub.killAfter);
+
+    int status = 0, alive = sub.totalProc;
+    bool open = true, running = sub.totalProc > 0, stopped = false;
+    while (open || running)
+    {
+        if (open)
+        {
+            struct pollfd pfd = {.fd = fds[0], .events = POLLIN};
+            if (poll(&pfd, 1, CAPTURE_POLL_MS) > 0)
+                open = readOutput(fds[0], buf, len, cap);
+        }
+        if (!running)
+            continue;
+        /*without output to wait for, sleep until a process ends or stops*/
+        int st;
+        pid_t pid = waitpid(-sub.pgid, &st, WUNTRACED | (open ? WNOHANG : 0));
+        if (pid < 0 && errno == EINTR)
+            continue;
+        if (pid < 0)
+        {
+            /*a process that left the group may still hold the pipe*/
+            running = false;
+            jobtimeout_disarm(sub.deadline);
+            continue;
+        }
+        if (pid == 0)
+            continue;
+        if (WIFSTOPPED(st))
+        {
+            killpg(sub.pgid, SIGKILL);
+            killpg(sub.pgid, SIGCONT);
+            stopped = true;
+            continue;
+        }
+        if (pid == sub.lastPid)
+            status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+        /*the deadline must not signal the id of a group that is gone*/
+        if (--alive == 0)
+            jobtimeout_disarm(sub.deadline);
+    }
+    close(fds[0]);
+    if (stopped)
+        status = 128 + SIGTSTP;
+    if (sub.deadline != NULL)
+    {
+        if (jobtimeout_expired(sub.deadline))
+            status = 124;
+        jobtimeout_cancel(sub.deadline);
+    }
+    if (sub.totalProc > 0)
+        termstate_give_terminal_back_to_shell();
+    return status;
+}
+
+/*Runs the command line inside a $(...), the 'len' bytes at 'text', and
+returns what it printed, without trailing newlines. It is parsed once per
+'cmd', the command whose word it is (NULL if none), and kept with it, so a
+loop or function that runs the command again does not parse it again*/
+char *captureCommandLine(const char *text, size_t len, struct ast_command *cmd)
+{
+    struct ast_command_line *cline;
+    char *copy = NULL;
+    if (cmd != NULL)
+    {
+        cline = ast_subst_cache_get(&cmd->subst, text, len);
+    }
+    else
+    {
+        copy = strndup(text, len);
+        cline = ast_parse_command_line(copy);
+    }
+
+    int status;
+    char *output = cline != NULL ? captureLines(cline, &status) : strdup("");
+    if (cmd == NULL && cline != NULL)
+        ast_command_line_free(cline);
+    free(copy);
+    return output;
+}
+
+/*Runs 'cline' and returns what it printed, without trailing newlines, and
+the status of its last pipeline in '*exitStatus'. Its pipelines run one
+after the other in the foreground, honoring && and ||; builtins run inside
+the shell, whose state is restored afterwards. 'cline' may be kept in a
+cache and run again, so it is left as it is: a pipeline that prefixes are
+stripped from is copied first*/
+static char *captureLines(struct ast_command_line *cline, int *exitStatus)
+{
+    size_t len = 0, cap = 0;
+    char *buf = NULL;
 
-            /*Parent Code Block*/
-            else
-            {
-                /*Sets the Process group id to the first spawned processes pid*/
-                if (currCommand == 0)
-                {
-                    processGroupID = pid;
-                    jb->pgid = processGroupID;
-                }
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &old);
 
-                setpgid(pid, processGroupID);
-                /*Fills in the pid array in jobs*/
-                jb->pids[currCommand] = pid;
-                /*increment counter*/
-                j += 2;
-                /*update the job*/
-                jb->num_processes_alive = jb->num_processes_alive + 1;
-                jb->totalProc = jb->totalProc + 1;
-                /*increment counter*/
-                currCommand++;
-                /********************************************************/
-            }
+    /*a failure inside belongs to the commands inside, not to the word*/
+    bool savedFailed = expandFailed;
+    int status = var_status();
+    struct substState state = {.saved = false};
+    for (struct list_elem *e = list_begin(&cline->pipes);
+         e != list_end(&cline->pipes);
+         e = list_next(e))
+    {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        if ((pipe->connector == AST_AND && status != 0) ||
+            (pipe->connector == AST_OR && status == 0))
+        {
+            continue;
+        }
+        if (pipe->func != NULL)
+        {
+            saveSubstState(&state);
+            func_define(pipe->func);
+            status = 0;
+            continue;
+        }
+        /*builtins such as fg and the jobs of a loop unblock SIGCHLD, but
+        the processes of captureCommand must not be reaped by the handler*/
+        if (pipe->loop != NULL)
+        {
+            saveSubstState(&state);
+            captureBuiltin(pipe, NULL, &buf, &len, &cap);
+            sigprocmask(SIG_BLOCK, &set, NULL);
+            status = var_status();
+            continue;
         }
-        /*call function to close all open pipes*/
-        closePipes(numPipes, pipefds);
 
-        /*If the current job is not a Background job*/
-        if (!jb->pipe->bg_job)
+        struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+        struct ast_pipeline *copy = NULL;
+        if (strcompare(cmd->argv[0], "sched") == 0 || strcompare(cmd->argv[0], "limit") == 0 ||
+            strcompare(cmd->argv[0], "timeout") == 0)
         {
-            /*Give control of terminal to the running process group*/
-            termstate_give_terminal_to(NULL, processGroupID);
-            /*Wait for the job*/
-            wait_for_job(jb);
-            /*after waiting completed return back terminal controk to the shell*/
-            termstate_give_terminal_back_to_shell();
+            pipe = copy = ast_pipeline_copy(pipe);
+            cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+        }
+        struct job_prefix prefix;
+        if (!consumeJobPrefixes(cmd, &prefix))
+        {
+            status = 1;
         }
-        /*FILE IO reset Block*/
-        freopen("/dev/tty", "w", stdout);
-        freopen("/dev/tty", "r", stdin);
-        dup2(2, 2);
-        /*********************/
+        else if (isAssignmentList(cmd))
+        {
+            saveSubstState(&state);
+            status = runAssignments(cmd) ? 0 : 1;
+        }
+        else if (list_size(&pipe->commands) == 1 && checkInternalCommand(cmd))
+        {
+            saveSubstState(&state);
+            captureBuiltin(pipe, cmd, &buf, &len, &cap);
+            sigprocmask(SIG_BLOCK, &set, NULL);
+            status = var_status();
+        }
+        else
+        {
+            status = captureCommand(pipe, &prefix, &buf, &len, &cap);
+        }
+        if (copy != NULL)
+            ast_pipeline_free(copy);
+    }
+    restoreSubstState(&state);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    expandFailed = savedFailed;
+    *exitStatus = status;
 
-        /*If the current job is a Background job*/
-        if (jb->pipe->bg_job)
+    while (len > 0 && buf[len - 1] == '\n')
+        len--;
+    buf = realloc(buf, len + 1);
+    buf[len] = '\0';
+    return buf;
+}
+
+/*Returns true if the $( at 'start', closed at 'end', is a $((...)) rather
+than a command substitution: its second parenthesis must close right
+before 'end', as in $((1+2)) but not in $((cd /tmp); ls)*/
+static bool isArithmetic(const char *start, const char *end)
+{
+    if (start[2] != '(' || end[-1] != ')')
+        return false;
+    int depth = 0;
+    for (const char *q = start + 2; q < end; q++)
+    {
+        if (*q == '(')
+            depth++;
+        else if (*q == ')' && --depth == 0)
+            return q == end - 1;
+    }
+    return false;
+}
+
+/*Evaluates the 'len' bytes of 'text', the inside of a $((...)) in a word
+of 'cmd', taking its compiled form from the cache of 'cmd' (NULL if the
+word belongs to no AST node). Returns the value as a malloc'd string, or
+an empty one after reporting an error*/
+static char *expandArithmetic(const char *text, size_t len, struct ast_command *cmd)
+{
+    struct arith_cache **cache = cmd != NULL ? &cmd->arith : NULL;
+    /*an expression containing $(...) differs each time and is not cached*/
+    char *expr = NULL;
+    if (memmem(text, len, "$(", 2) != NULL)
+    {
+        char *inner = strndup(text, len);
+        expr = substituteCommands(inner, cmd);
+        free(inner);
+        text = expr;
+        len = strlen(expr);
+        cache = NULL;
+    }
+
+    int64_t value;
+    const char *error;
+    char *result;
+    if (arith_evaluate(cache, text, len, &value, &error))
+    {
+        result = malloc(24);
+        snprintf(result, 24, "%" PRId64, value);
+    }
+    else
+    {
+        fprintf(stderr, "cush: %.*s: %s\n", (int)len, text, error);
+        expandFailed = true;
+        result = strdup("");
+    }
+    free(expr);
+    return result;
+}
+
+/*Replaces each $(...) in 'word' by the output of the command line inside,
+which may itself contain $(...), and each $((...)) by the value of the
+arithmetic expression inside. Both are parsed once per 'cmd', the command
+the word belongs to (NULL if none). The variables in the rest of the word
+are expanded, the output is not expanded again. Returns a malloc'd string*/
+char *substituteCommands(const char *word, struct ast_command *cmd)
+{
+    size_t len = 0, cap = strlen(word) + 1;
+    char *result = malloc(cap);
+
+    const char *p = word;
+    while (*p)
+    {
+        /*\$( is not a substitution*/
+        const char *start = strstr(p, "$(");
+        while (start != NULL && start > word && start[-1] == '\\')
+            start = strstr(start + 2, "$(");
+        /*find the parenthesis that closes this $(*/
+        const char *end = NULL;
+        if (start != NULL)
         {
-            /*Update the job status and print job*/
-            jb->status = BACKGROUND;
-            printf("[%d] %d\n", jb->jid, pid);
+            int depth = 0;
+            for (const char *q = start + 1; *q && end == NULL; q++)
+            {
+                if (*q == '(')
+                    depth++;
+                else if (*q == ')' && --depth == 0)
+                    end = q;
+            }
         }
-        /*Unblock SigChld*/
-        signal_unblock(17);
+        size_t plainLen = (end != NULL ? start : p + strlen(p)) - p;
+        char *plainText = strndup(p, plainLen);
+        char *plain = var_expand(plainText);
+        free(plainText);
+        char *output = NULL;
+        if (end != NULL && isArithmetic(start, end))
+        {
+            output = expandArithmetic(start + 3, end - start - 4, cmd);
+        }
+        else if (end != NULL)
+        {
+            output = captureCommandLine(start + 2, end - start - 2, cmd);
+        }
+        size_t plen = strlen(plain), olen = output ? strlen(output) : 0;
+        if (len + plen + olen + 1 > cap)
+        {
+            cap = 2 * (len + plen + olen + 1);
+            result = realloc(result, cap);
+        }
+        memcpy(result + len, plain, plen);
+        if (output != NULL)
+            memcpy(result + len + plen, output, olen);
+        len += plen + olen;
+        free(plain);
+        free(output);
+        p = end != NULL ? end + 1 : p + plainLen;
+    }
+    result[len] = '\0';
+    return result;
+}
+
+/*Expands the variables, arithmetic and command substitutions in 'word'*/
+char *expandWord(const char *word, struct ast_command *cmd)
+{
+    if (strstr(word, "$(") != NULL)
+        return substituteCommands(word, cmd);
+    return var_expand(word);
+}
+
+/*Builds the argv a command runs with: variables are expanded, commands in
+$(...) are run and their output is split into words at blanks, wildcards
+are matched against the file system, and the placeholders of process
+substitutions become the /dev/fd paths of their pipes in 'psfds' (NULL when
+the pipes do not exist, as for builtins)*/
+char **expandArgv(struct ast_command *cmd, int psfds[])
+{
+    struct pathglob_words words;
+    pathglob_words_init(&words);
+
+    struct list_elem *e = list_begin(&cmd->procsubs);
+    int sub = 0;
+    for (int i = 0; cmd->argv[i] != NULL; i++)
+    {
+        struct ast_procsub *ps = NULL;
+        if (e != list_end(&cmd->procsubs))
+            ps = list_entry(e, struct ast_procsub, elem);
+        if (ps != NULL && ps->argidx == i && psfds != NULL)
+        {
+            char *path = malloc(32);
+            snprintf(path, 32, "/dev/fd/%d", ps->is_output ? psfds[2 * sub + 1] : psfds[2 * sub]);
+            pathglob_words_push(&words, path);
+            e = list_next(e);
+            sub++;
+            continue;
+        }
+        /*"$@" and "$*" become one word per argument of the function*/
+        if (strcmp(cmd->argv[i], "$@") == 0 || strcmp(cmd->argv[i], "$*") == 0)
+        {
+            for (char **arg = positional; arg != NULL && *arg != NULL; arg++)
+                pathglob_words_push(&words, strdup(*arg));
+            continue;
+        }
+        if (strstr(cmd->argv[i], "$(") != NULL)
+        {
+            /*the output of a substitution is split into words at blanks*/
+            char *output = substituteCommands(cmd->argv[i], cmd);
+            char *save;
+            for (char *field = strtok_r(output, " \t\n", &save);
+                 field != NULL;
+                 field = strtok_r(NULL, " \t\n", &save))
+            {
+                pathglob_expand(field, &words);
+            }
+            free(output);
+            continue;
+        }
+        char *word = var_expand(cmd->argv[i]);
+        pathglob_expand(word, &words);
+        free(word);
+    }
+    return words.words;
+}
+
+/*Opens 'path' and moves it onto file descriptor 'target' in a child process*/
+static void redirectChildFd(const char *path, int flags, int target)
+{
+    int fd = open(path, flags, 0666);
+    if (fd < 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (fd != target)
+    {
+        dup2(fd, target);
+        close(fd);
     }
 }
 
 /*This function runs a specific child process*/
-void runChildProcess(int currCommand, int numCommands, int numPipes, int j, struct job *jb, int pipefds[], char *comd, char **argg)
+void runChildProcess(int currCommand, int numCommands, int numPipes, int j, struct job *jb, int pipefds[],
+                     struct ast_pipeline *pipeline, struct ast_command *cmd, char **argv,
+                     int inFd, int outFd, int psfds[])
 {
 
     /*If this is not the last command*/
@@ -823,8 +3951,87 @@ void runChildProcess(int currCommand, int numCommands, int numPipes, int j, stru
     {
         close(pipefds[i]);
     }
+
+    /*File IO Block*/
+    /*stdin of the first command comes from a file or a process substitution pipe*/
+    if (currCommand == 0 && pipeline->iored_input != NULL)
+    {
+        redirectChildFd(var_expand(pipeline->iored_input), O_RDONLY, 0);
+    }
+    else if (currCommand == 0 && inFd >= 0)
+    {
+        dup2(inFd, 0);
+    }
+    /*if output of the last command needs to be sent to a file*/
+    if (currCommand == numCommands - 1 && pipeline->iored_output != NULL)
+    {
+        /*append to the file or write it from the start*/
+        int flags = O_WRONLY | O_CREAT | (pipeline->append_to_output ? O_APPEND : O_TRUNC);
+        redirectChildFd(var_expand(pipeline->iored_output), flags, 1);
+    }
+    /*else if it goes to a process substitution pipe*/
+    else if (currCommand == numCommands - 1 && outFd >= 0)
+    {
+        dup2(outFd, 1);
+    }
+    /*else if the job's output is captured by the shell*/
+    else if (currCommand == numCommands - 1 && jb->outFd >= 0)
+    {
+        dup2(jb->outFd, 1);
+    }
+    /*stderr of every command goes to the capture fd as well*/
+    if (jb->outFd >= 0)
+    {
+        dup2(jb->outFd, 2);
+    }
+    /*if stderr also needs to go where stdout goes (>& and |&)*/
+    if (cmd->dup_stderr_to_stdout)
+    {
+        dup2(1, 2);
+    }
+    /*****************************/
+
+    /*Process Substitution Block*/
+    /*keep this command's end of each pipe open across exec, argv names it as /dev/fd/N*/
+    int i = 0;
+    for (struct list_elem *e = list_begin(&cmd->procsubs);
+         e != list_end(&cmd->procsubs);
+         e = list_next(e), i++)
+    {
+        struct ast_procsub *ps = list_entry(e, struct ast_procsub, elem);
+        fcntl(ps->is_output ? psfds[2 * i + 1] : psfds[2 * i], F_SETFD, 0);
+    }
+    /*****************************/
+
+    /*Apply the job's scheduling settings, lowered if it starts in the background*/
+    struct jobsched sched = jb->sched;
+    if (jb->pipe->bg_job)
+    {
+        getBackgroundSched(jb, &sched);
+    }
+    jobsched_apply_self(&sched);
+    /*Apply the job's resource limits*/
+    joblimits_apply_self(&jb->limits);
+
+    /*A failed expansion such as $((1/0)) has been reported, the command
+    fails without running*/
+    if (expandFailed)
+    {
+        exit(EXIT_FAILURE);
+    }
+    /*Functions run in the shell, which is not part of the pipeline*/
+    if (func_lookup(argv[0]) != NULL)
+    {
+        fprintf(stderr, "%s: functions cannot be part of a pipeline or run in the background\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /*Run with the exported environment; execvp looks the command up in the
+    PATH of that environment*/
+    environ = var_environ();
+
     /*Execute the command after all pipes have been sorted*/
-    if (execvp(comd, argg) < 0)
+    if (execvp(argv[0], argv) < 0)
     {
         printf("no such file or directory");
         exit(EXIT_FAILURE);
@@ -842,53 +4049,400 @@ void closePipes(int numPipes, int pipes[])
     }
 }
 
-/*This functions cleans up the job list by looping through the job list 
-and removig any jobs which have been marked a finished*/
+/*Marks a job as finished and queues it on finished_list the first time.
+Called from the SIGCHLD handler, so it must not allocate*/
+void markJobFinished(struct job *jb)
+{
+    if (!jb->isFinished)
+    {
+        jb->isFinished = true;
+        list_push_back(&finished_list, &jb->finishedElem);
+        /*Count the job off if the wait builtin waits for it*/
+        if (jb->waitGeneration == waitGeneration)
+        {
+            waitPending--;
+            if (waitFirst == NULL)
+                waitFirst = jb;
+        }
+    }
+}
+
+/*Deletes the jobs queued on finished_list and returns the events recorded
+by the SIGCHLD handler and the Done notices of the background jobs among
+them, followed by the ids of the queued jobs
+that their slots admitted, as one string of 'len' bytes, so they can be
+written at once. Returns NULL if no job has finished since the last call.
+The cost depends only on the number of finished jobs*/
+char *takeFinishedJobs(size_t *len)
+{
+    if (list_empty(&finished_list) && list_empty(&notice_list) && !bgSlotFreed)
+        return NULL;
+
+    char *notices = NULL;
+    FILE *out = open_memstream(&notices, len);
+    signal_block(SIGCHLD);
+    fprintNotices(out);
+    while (!list_empty(&finished_list))
+    {
+        struct job *jb = list_entry(list_pop_front(&finished_list), struct job, finishedElem);
+        /*Only background jobs that were not killed print Done*/
+        if (jb->status == BACKGROUND && !jb->wasKilled && jb->reportDone)
+        {
+            fprintf(out, "[%d]    Done\t\t", jb->jid);
+            fprintCmdline(out, jb->pipe);
+            fputc('\n', out);
+        }
+        list_remove(&jb->elem);
+        delete_job(jb);
+    }
+    if (bgSlotFreed)
+        admitQueuedJobs(out);
+    signal_unblock(SIGCHLD);
+    fclose(out);
+    return notices;
+}
+
+/*This functions cleans up the job list by removing the jobs which have
+finished, and prints their Done notices before the next prompt*/
 void cleanUpJobsList()
 {
-    /*Loop through the jobs list*/
-    for (struct list_elem *e = list_begin(&job_list);
-         e != list_end(&job_list);)
+    size_t len;
+    char *notices = takeFinishedJobs(&len);
+    if (notices != NULL)
     {
-        /*get pointer to job*/
-        struct job *jb = list_entry(e, struct job, elem);
+        fflush(stdout);
+        if (len > 0 && write(1, notices, len) < 0)
+            perror("write");
+        free(notices);
+    }
+}
 
-        /*If the job has been marked finished remove it*/
-        if (jb->isFinished)
+/*The text of a script being parsed and the position of its next line*/
+struct scriptText
+{
+    char *text;
+    char *next;
+    int lineno;
+};
+
+/*Returns the next line of a script as a malloc'd string, NULL at the end*/
+static char *nextScriptLine(void *ctx)
+{
+    struct scriptText *st = ctx;
+    if (*st->next == '\0')
+        return NULL;
+    char *end = strchrnul(st->next, '\n');
+    char *line = strndup(st->next, end - st->next);
+    st->next = *end ? end + 1 : end;
+    st->lineno++;
+    return line;
+}
+
+/*Parses the script in 'fd' line by line, here-documents and loops that
+span several lines included, into an array of '*count' command lines.
+Blank lines and comments are dropped.
+Lines with syntax errors are reported and counted in '*errors'*/
+static struct ast_command_line **parseScript(const char *path, int fd, size_t *count, int *errors)
+{
+    size_t len = 0, cap = 0;
+    char *text = NULL;
+    readAllOutput(fd, &text, &len, &cap);
+    text = realloc(text, len + 1);
+    text[len] = '\0';
+
+    struct scriptText st = {text, text, 0};
+    size_t n = 0, size = 64;
+    struct ast_command_line **lines = malloc(size * sizeof *lines);
+    char *line;
+    while ((line = nextScriptLine(&st)) != NULL)
+    {
+        char *lineText;
+        struct ast_command_line *cline = parseLines(line, nextScriptLine, &st, &lineText);
+        free(lineText);
+        free(line);
+        if (cline == NULL)
+        {
+            fprintf(stderr, "%s: line %d: syntax error\n", path, st.lineno);
+            (*errors)++;
+            continue;
+        }
+        if (list_empty(&cline->pipes))
+        {
+            ast_command_line_free(cline);
+            continue;
+        }
+        if (n == size)
+        {
+            size *= 2;
+            lines = realloc(lines, size * sizeof *lines);
+        }
+        lines[n++] = cline;
+    }
+    free(text);
+    *count = n;
+    return lines;
+}
+
+/*Runs the script 'path', or with 'parseOnly' (-n) only checks it. The
+parsed command lines come from the script cache when the script has not
+changed since it was cached, so a warm start does not parse at all.
+Returns the exit status of the script*/
+int runScript(const char *path, bool parseOnly)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        return 127;
+    }
+
+    uint64_t parseStart = stats_now();
+    size_t count;
+    int errors = 0;
+    struct ast_command_line **lines = astcache_load(path, &st, &count);
+    if (lines == NULL)
+    {
+        lines = parseScript(path, fd, &count, &errors);
+        /*scripts with errors are not cached so the errors show every time*/
+        if (errors == 0)
+            astcache_store(path, &st, lines, count);
+    }
+    close(fd);
+    stats_record_since(STATS_PARSE, parseStart);
+
+    size_t i = 0;
+    if (!parseOnly)
+    {
+        for (; i < count && !quit; i++)
         {
-            e = list_remove(e);
-            delete_job(jb);
+            cleanUpJobsList();
+            runCommand(lines[i]);
+        }
+    }
+    /*the lines that did not run are still ours*/
+    for (; i < count; i++)
+        ast_command_line_free(lines[i]);
+    free(lines);
+
+    if (errors > 0)
+        return 2;
+    return parseOnly ? 0 : var_status();
+}
+
+/*Runs the command lines of a server request with the client's stdin,
+stdout, stderr and working directory in place of the shell's. Returns the
+exit status of the last one*/
+static int runRequest(char *text, int fds[SERVER_NFDS])
+{
+    /*the shell's own descriptors are put back afterwards*/
+    int saved[3];
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++)
+    {
+        saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+        dup2(fds[i], i);
+    }
+
+    var_set_status(0);
+    if (fchdir(fds[3]) < 0)
+    {
+        perror("cd");
+        var_set_status(1);
+    }
+    else
+    {
+        struct scriptText st = {text, text, 0};
+        char *line;
+        while (!quit && (line = nextScriptLine(&st)) != NULL)
+        {
+            char *lineText;
+            struct ast_command_line *cline = parseLines(line, nextScriptLine, &st, &lineText);
+            free(lineText);
+            free(line);
+            /*like sh -c, a syntax error ends the request*/
+            if (cline == NULL)
+            {
+                var_set_status(2);
+                break;
+            }
+            if (list_empty(&cline->pipes))
+                ast_command_line_free(cline);
+            else
+                runCommand(cline);
+        }
+    }
+    /*exit ends the request, not the server*/
+    quit = false;
+
+    fflush(stdout);
+    fflush(stderr);
+    readbuf_release(0);
+    for (int i = 0; i < 3; i++)
+    {
+        if (saved[i] >= 0)
+        {
+            dup2(saved[i], i);
+            close(saved[i]);
         }
-        /*else iterate to the next job*/
         else
+            close(i);
+    }
+    return var_status();
+}
+
+/*Runs as a command server listening at 'path', see server.h. Requests
+are run in this process one at a time, in the order they arrive on any
+of the connections, so what they define, such as variables and
+functions, stays for the requests after them. Only returns on an error*/
+int runServer(const char *path)
+{
+    int sock = server_listen(path);
+    if (sock < 0)
+        return EXIT_FAILURE;
+
+    /*polls[0] is the listening socket, the others are connections*/
+    size_t npolls = 1, size = 16;
+    struct pollfd *polls = malloc(size * sizeof *polls);
+    polls[0] = (struct pollfd){.fd = sock, .events = POLLIN};
+    for (;;)
+    {
+        cleanUpJobsList();
+        if (poll(polls, npolls, -1) < 0)
         {
-            e = list_next(e);
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        for (size_t i = npolls - 1; i > 0; i--)
+        {
+            if (polls[i].revents == 0)
+                continue;
+            int fds[SERVER_NFDS];
+            char *text = server_recv_request(polls[i].fd, fds);
+            bool answered = false;
+            if (text != NULL)
+            {
+                int status = runRequest(text, fds);
+                free(text);
+                for (int j = 0; j < SERVER_NFDS; j++)
+                    close(fds[j]);
+                answered = server_send_status(polls[i].fd, status);
+            }
+            /*the client is gone or broke the protocol*/
+            if (!answered)
+            {
+                close(polls[i].fd);
+                polls[i] = polls[--npolls];
+            }
+        }
+
+        if (polls[0].revents & POLLIN)
+        {
+            int conn = server_accept(sock);
+            if (conn < 0)
+            {
+                if (errno == EACCES)
+                    fprintf(stderr, "cush: refused a connection from another user\n");
+                continue;
+            }
+            if (npolls == size)
+            {
+                size *= 2;
+                polls = realloc(polls, size * sizeof *polls);
+            }
+            polls[npolls++] = (struct pollfd){.fd = conn, .events = POLLIN};
         }
     }
+    free(polls);
+    close(sock);
+    return EXIT_FAILURE;
 }
 
 int main(int ac, char *av[])
 {
+    static const struct option options[] = {
+        {"server", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0},
+    };
     int opt;
+    bool parseOnly = false;
+    const char *serverPath = NULL;
+    bool useZygote = false;
     quit = false;
 
     /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "h")) > 0)
+    /* '+' stops at the script name, the rest are its arguments */
+    while ((opt = getopt_long(ac, av, "+hnz", options, NULL)) > 0)
     {
         switch (opt)
         {
         case 'h':
             usage(av[0]);
             break;
+        case 'n':
+            parseOnly = true;
+            break;
+        case 'z':
+            useZygote = true;
+            break;
+        case 'S':
+            serverPath = optarg;
+            break;
         }
     }
     
+    /*The zygote is forked first, while the shell is small and has no
+    threads or signal handlers*/
+    if (useZygote && !zygote_start())
+    {
+        perror("zygote");
+    }
+
     /*Gets the current directory and saves it as the home*/
     getcwd(homeDir, sizeof(homeDir));
 
     /*Initialize Lists*/
     list_init(&job_list);
     list_init(&history_list);
+    list_init(&queued_list);
+    list_init(&finished_list);
+    list_init(&notice_list);
+    list_init(&recurring_list);
+    /*Import the environment as exported shell variables*/
+    var_init(environ);
+
+    /*Server mode: the commands come from cushc, see server.h*/
+    if (serverPath != NULL)
+    {
+        signal_set_handler(SIGCHLD, sigchld_handler);
+        termstate_init_none();
+        return runServer(serverPath);
+    }
+
+    /*Script mode: $0 is the script, $1... its arguments*/
+    if (optind < ac)
+    {
+        var_set("0", av[optind], false);
+        setPositional(av + optind + 1);
+        signal_set_handler(SIGCHLD, sigchld_handler);
+        termstate_init_optional();
+        int status = runScript(av[optind], parseOnly);
+        /*Tagged lines of background jobs still in their pipes go out first*/
+        jobout_flush();
+        history_list_free();
+        return status;
+    }
+
+    /*Index the commands for tab completion in the background*/
+    complete_start(getenv("PATH"), builtinNames);
+    rl_attempted_completion_function = cushCompletion;
+    /*Compute slow prompt segments in the background*/
+    prompt_start();
+    rl_event_hook = refreshPrompt;
     /*set the sigchld handler*/
     signal_set_handler(SIGCHLD, sigchld_handler);
     /*iniitialize terminal*/
@@ -898,24 +4452,38 @@ int main(int ac, char *av[])
     /*enter command "exit" to quit shell*/
     while (!quit)
     {
+        /*Start the runs of "every" that came due while a job had the terminal*/
+        timerwheel_advance();
         /*Clean up jobs list by removing any finished jobs*/
         cleanUpJobsList();
         /* Do not output a prompt unless shell's stdin is a terminal */
-        char *prompt = isatty(0) ? build_prompt() : NULL;
+        const char *prompt = isatty(0) ? build_prompt() : NULL;
+        uint64_t readlineStart = stats_now();
         char *cmdline = readline(prompt);
-        free(prompt);
+        stats_record_since(STATS_READLINE, readlineStart);
 
         if (cmdline == NULL) /* User typed EOF */
             break;
 
-        struct ast_command_line *cline = ast_parse_command_line(cmdline);
+        uint64_t parseStart = stats_now();
+        char *text;
+        struct ast_command_line *cline = parseLines(cmdline, readTerminalLine, NULL, &text);
+        stats_record_since(STATS_PARSE, parseStart);
         /*Save cline to history before it is freed.*/
-        saveToHistory(cmdline);
+        saveToHistory(text);
 
+        free(text);
         free(cmdline);
         if (cline == NULL) /* Error in command line */
             continue;
 
+        /*-n only checks the syntax*/
+        if (parseOnly)
+        {
+            ast_command_line_free(cline);
+            continue;
+        }
+
         if (list_empty(&cline->pipes))
         { /* User hit enter */
             ast_command_line_free(cline);
@@ -924,8 +4492,11 @@ int main(int ac, char *av[])
         else
         {
             runCommand(cline);
+            /*readline reads stdin where the read builtin stopped*/
+            readbuf_release(0);
         }
     }
+    jobout_flush();
     /*This needs to be called before the shell exits.*/
     history_list_free();
     return 0;
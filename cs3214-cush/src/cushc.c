@@ -0,0 +1,72 @@
+/*
+ * cushc - run a command line in a cush command server.
+ *
+ * A stand-in for "sh -c": the command line runs in a long-lived
+ * "cush --server" with this process's stdin, stdout, stderr and working
+ * directory, and cushc exits with its status.  No shell starts, so the
+ * cost of a command is that of this small program and of the commands
+ * themselves.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static void
+usage(char *progname)
+{
+    fprintf(stderr, "Usage: %s [-s socket] -c command\n"
+            " -s socket     the socket of the server, by default $CUSH_SERVER\n"
+            " -c command    the command line to run\n",
+            progname);
+    exit(2);
+}
+
+int
+main(int ac, char *av[])
+{
+    const char *path = getenv("CUSH_SERVER");
+    const char *command = NULL;
+    int opt;
+
+    while ((opt = getopt(ac, av, "hs:c:")) > 0) {
+        switch (opt) {
+        case 's':
+            path = optarg;
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        default:
+            usage(av[0]);
+        }
+    }
+    if (command == NULL || path == NULL || optind != ac)
+        usage(av[0]);
+
+    int sock = server_connect(path);
+    if (sock < 0) {
+        fprintf(stderr, "%s: cannot connect to %s: %s\n", av[0], path, strerror(errno));
+        return 127;
+    }
+
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) {
+        perror("getcwd");
+        return 127;
+    }
+
+    int fds[SERVER_NFDS] = { 0, 1, 2, cwd };
+    int status;
+    if (!server_send_request(sock, command, fds)
+        || !server_recv_status(sock, &status)) {
+        fprintf(stderr, "%s: the server went away\n", av[0]);
+        return 127;
+    }
+    return status & 255;
+}
@@ -1,3 +1,28 @@
 = Tests for Custom Features
 1 cd_test.py
-2 history_test.py
\ No newline at end of file
+2 history_test.py
+1 stats_test.py
+1 parallel_test.py
+1 bglimit_test.py
+1 sched_test.py
+1 limit_test.py
+1 procsub_test.py
+1 heredoc_test.py
+1 variables_test.py
+1 glob_test.py
+1 completion_test.py
+1 prompt_test.py
+1 notify_test.py
+1 wait_test.py
+1 cond_test.py
+1 subst_test.py
+1 script_test.py
+1 loop_test.py
+1 arith_test.py
+1 func_test.py
+1 server_test.py
+1 zygote_test.py
+1 joblog_test.py
+1 tag_test.py
+1 timeout_test.py
+1 every_test.py
\ No newline at end of file
@@ -0,0 +1,93 @@
+#!/usr/bin/python
+#
+# every_test: tests the every and watch commands
+# 
+# Test that every runs its command again and again from the prompt,
+# skips a run while the last one is still going and can be removed, and
+# that watch redraws only the rows of its output that changed
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, os, tempfile
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# the command runs while the shell waits at the prompt
+sendline("every 0.3 expr 40 + 2")
+expect("42", "every did not run its command")
+expect("42", "every did not run its command again")
+sendline("every")
+expect("1\s+every 0.3s\s+\(expr 40 \+ 2\)", "every did not list its command")
+sendline("every -d 1")
+expect_prompt("Shell did not print expected prompt ")
+
+# a run that is still going is skipped
+sendline("every 0.2 sleep 1")
+expect_prompt("Shell did not print expected prompt ")
+time.sleep(1.5)
+sendline("every")
+expect("every 0.2s\s+\(sleep 1\)\s+[12] runs, [1-9]\d* skipped", "runs were not skipped")
+expect_prompt("Shell did not print expected prompt ")
+sendline("every -d 2")
+expect_prompt("Shell did not print expected prompt ")
+sendline("every -d 2")
+expect("no such command", "removed command was still there")
+expect_prompt("Shell did not print expected prompt ")
+
+# builtins and functions cannot run as background jobs
+sendline("f() { echo hi; }")
+expect_prompt("Shell did not print expected prompt ")
+sendline("every 1 f; echo status $?")
+expect("every: cannot repeat 'f', which runs inside the shell\r\nstatus 1\r\n", "every took a function")
+expect_prompt("Shell did not print expected prompt ")
+sendline("every 1 jobs")
+expect("every: cannot repeat 'jobs'", "every took a builtin")
+expect_prompt("Shell did not print expected prompt ")
+sendline("every")
+expect_prompt("Shell did not print expected prompt ")
+assert "every 1s" not in testutil.console.before, "a refused command was kept"
+
+# runs from the prompt leave a half-typed line alone
+sendline("every 0.2 true")
+expect_prompt("Shell did not print expected prompt ")
+testutil.console.send("echo half")
+time.sleep(1)
+sendline("-typed")
+expect("\rhalf-typed\r\n", "a run garbled the input line")
+assert "halfcush>" not in testutil.console.before, "the input line was drawn twice"
+expect_prompt("Shell did not print expected prompt ")
+sendline("every -d 3")
+expect_prompt("Shell did not print expected prompt ")
+
+# watch rewrites only the rows that changed
+fd, path = tempfile.mkstemp()
+os.write(fd, "aaa\nbbb\n")
+os.close(fd)
+sendline("watch -n 0.3 cat " + path)
+expect("\x1b\[3;1Haaa\x1b\[K\x1b\[4;1Hbbb\x1b\[K", "watch did not show the output")
+f = open(path, "w")
+f.write("aaa\nccc\n")
+f.close()
+expect("\x1b\[4;1Hccc\x1b\[K", "watch did not show the change")
+assert "aaa" not in testutil.console.before, "watch redrew a row that did not change"
+sendcontrol("c")
+expect("\x1b\[\?1049l", "Ctrl-C did not end watch")
+expect_prompt("Shell did not print expected prompt ")
+
+# Ctrl-Z while the watched command runs ends watch as well
+sendline("watch -n 0.3 sleep 100")
+time.sleep(0.5)
+sendcontrol("z")
+expect("\x1b\[\?1049l", "Ctrl-Z did not end watch")
+expect_prompt("Shell did not print expected prompt ")
+os.unlink(path)
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
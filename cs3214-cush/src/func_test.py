@@ -0,0 +1,80 @@
+#!/usr/bin/python
+#
+# func_test: tests shell functions defined with name() { ... }
+#
+# Test that functions see their arguments as positional parameters, that
+# they can call themselves and return a status, that their output can be
+# captured, that unset -f removes them, and that they cannot be part of
+# a pipeline
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# arguments become $1, $2, ..., $# and $@
+sendline("greet() { echo hi $1 and $2, $# args: $@; }")
+expect_prompt("Shell did not print expected prompt ")
+sendline("greet a b c")
+expect("hi a and b, 3 args: a b c\r\n", "function did not see its arguments")
+expect_prompt("Shell did not print expected prompt ")
+
+# "$@" passes each argument on as a word of its own
+sendline("each() { for a in \"$@\"; do echo arg-$a; done; }; each x y")
+expect("arg-x\r\n", "\"$@\" did not give the first argument")
+expect("arg-y\r\n", "\"$@\" did not give the second argument")
+expect_prompt("Shell did not print expected prompt ")
+
+# a definition can span lines
+sendline("add() {")
+expect("> ", "Shell did not prompt for the rest of the definition")
+sendline("echo $(($1 + $2))")
+expect("> ", "Shell did not prompt for the rest of the definition")
+sendline("}")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo sum-$(add 3 4)")
+expect("sum-7\r\n", "output of a function was not captured")
+expect_prompt("Shell did not print expected prompt ")
+
+# recursion, with the caller's arguments restored after each call
+sendline("fib() { if_small=$(($1 < 2)); for s in $(seq $if_small); do echo $1; return; done; echo $(($(fib $(($1 - 1))) + $(fib $(($1 - 2))))); }")
+expect_prompt("Shell did not print expected prompt ")
+sendline("fib 10")
+expect("55\r\n", "recursive function computed the wrong value")
+expect_prompt("Shell did not print expected prompt ")
+
+# return ends the function, and its argument is the status
+sendline("check() { for i in 1 2 3; do if_two=$((i == 2)); for s in $(seq $if_two); do return 7; done; echo i-$i; done; echo not-reached; }")
+expect_prompt("Shell did not print expected prompt ")
+sendline("check; echo status-$?")
+expect("i-1\r\n", "function did not run its loop")
+expect("status-7\r\n", "return did not set the status")
+assert "not-reached" not in testutil.console.before, "return did not end the function"
+expect_prompt("Shell did not print expected prompt ")
+
+# return outside of a function is an error
+sendline("return 3; echo status-$?")
+expect("can only return from a function", "return outside a function was not reported")
+expect("status-1\r\n", "return outside a function did not fail")
+expect_prompt("Shell did not print expected prompt ")
+
+# functions cannot be part of a pipeline
+sendline("greet a | cat")
+expect("cannot be part of a pipeline", "function in a pipeline was not reported")
+expect_prompt("Shell did not print expected prompt ")
+
+# unset -f removes a function
+sendline("unset -f greet; greet a")
+expect("no such file or directory", "function was not removed")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
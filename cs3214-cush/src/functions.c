@@ -0,0 +1,154 @@
+/*
+ * The function table, see functions.h.
+ *
+ * A hash table with chaining.  Lookups happen for every command that is
+ * not a builtin, so an empty table is checked without hashing.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "functions.h"
+
+struct entry {
+    struct ast_function *func;
+    uint32_t hash;
+    struct entry *next;
+};
+
+static struct entry **buckets;
+static size_t nbuckets;         /* always a power of 2 */
+static size_t count;
+
+/* FNV-1a */
+static uint32_t
+hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+    return h;
+}
+
+/* Return the link that points to the entry of 'name', or to the NULL at
+ * the end of its chain */
+static struct entry **
+find(const char *name, uint32_t h)
+{
+    struct entry **link = &buckets[h & (nbuckets - 1)];
+    while (*link && ((*link)->hash != h || strcmp((*link)->func->name, name) != 0))
+        link = &(*link)->next;
+    return link;
+}
+
+/* Double the number of buckets */
+static void
+grow(void)
+{
+    size_t n = nbuckets ? 2 * nbuckets : 16;
+    struct entry **b = calloc(n, sizeof *b);
+
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (struct entry *e = buckets[i], *next; e; e = next) {
+            next = e->next;
+            e->next = b[e->hash & (n - 1)];
+            b[e->hash & (n - 1)] = e;
+        }
+    }
+    free(buckets);
+    buckets = b;
+    nbuckets = n;
+}
+
+void
+func_define(struct ast_function *func)
+{
+    if (count >= nbuckets)
+        grow();
+
+    uint32_t h = hash_name(func->name);
+    struct entry **link = find(func->name, h);
+    ast_function_ref(func);
+    if (*link) {
+        ast_function_free((*link)->func);
+        (*link)->func = func;
+        return;
+    }
+
+    struct entry *e = malloc(sizeof *e);
+    e->func = func;
+    e->hash = h;
+    e->next = NULL;
+    *link = e;
+    count++;
+}
+
+struct ast_function *
+func_lookup(const char *name)
+{
+    if (count == 0)
+        return NULL;
+    struct entry *e = *find(name, hash_name(name));
+    return e ? e->func : NULL;
+}
+
+struct func_snapshot {
+    struct entry **buckets;
+    size_t nbuckets;
+    size_t count;
+};
+
+struct func_snapshot *
+func_save(void)
+{
+    struct func_snapshot *s = malloc(sizeof *s);
+    s->nbuckets = nbuckets;
+    s->count = count;
+    s->buckets = calloc(nbuckets ? nbuckets : 1, sizeof *s->buckets);
+    for (size_t i = 0; i < nbuckets; i++) {
+        struct entry **link = &s->buckets[i];
+        for (struct entry *e = buckets[i]; e; e = e->next) {
+            struct entry *copy = malloc(sizeof *copy);
+            *copy = *e;
+            copy->next = NULL;
+            ast_function_ref(copy->func);
+            *link = copy;
+            link = &copy->next;
+        }
+    }
+    return s;
+}
+
+void
+func_restore(struct func_snapshot *s)
+{
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (struct entry *e = buckets[i], *next; e; e = next) {
+            next = e->next;
+            ast_function_free(e->func);
+            free(e);
+        }
+    }
+    free(buckets);
+    buckets = s->buckets;
+    nbuckets = s->nbuckets;
+    count = s->count;
+    free(s);
+}
+
+bool
+func_remove(const char *name)
+{
+    if (count == 0)
+        return false;
+    struct entry **link = find(name, hash_name(name));
+    struct entry *e = *link;
+    if (e == NULL)
+        return false;
+
+    *link = e->next;
+    ast_function_free(e->func);
+    free(e);
+    count--;
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef __FUNCTIONS_H
+#define __FUNCTIONS_H
+
+#include <stdbool.h>
+
+#include "shell-ast.h"
+
+/* Shell functions.
+ *
+ * The function table maps names to the parsed definitions, so calling
+ * a function runs its body without parsing anything.  It holds one
+ * reference to each definition (see struct ast_function).
+ */
+
+/* Define function 'func->name', replacing an earlier definition, and
+ * take a reference to 'func' */
+void func_define(struct ast_function *func);
+
+/* Return the definition of function 'name', or NULL if there is none.
+ * A caller that runs it must hold a reference of its own while it does,
+ * since the body may define the function again. */
+struct ast_function *func_lookup(const char *name);
+
+/* Remove function 'name'.  Returns false if there is none. */
+bool func_remove(const char *name);
+
+/* Return a copy of the function table, holding a reference to each
+ * definition, to be put back with func_restore */
+struct func_snapshot *func_save(void);
+
+/* Replace the function table with 'snapshot', which is freed */
+void func_restore(struct func_snapshot *snapshot);
+
+#endif /* __FUNCTIONS_H */
@@ -0,0 +1,65 @@
+#!/usr/bin/python
+#
+# glob_test: tests wildcard expansion
+# 
+# Test that *, ? and [...] are expanded to the sorted list of matching
+# paths, across several directory levels, that patterns without matches
+# are passed on unchanged, and that a changed directory is read again
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutil import *
+
+# a directory tree with an old mtime, which the shell may cache
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+for name in ["b.log", "a.log", "c.txt", ".hidden.log", "sub1/x.c", "sub2/y.c"]:
+    path = os.path.join(tmpdir, name)
+    if not os.path.isdir(os.path.dirname(path)):
+        os.makedirs(os.path.dirname(path))
+    open(path, "w").close()
+for d in [tmpdir, tmpdir + "/sub1", tmpdir + "/sub2"]:
+    os.utime(d, (time.time() - 3600, time.time() - 3600))
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("cd " + tmpdir)
+expect_prompt("Shell did not print expected prompt ")
+
+# matches are sorted and hidden files are left out
+sendline("echo *.log")
+expect("a.log b.log\r\n", "*.log was not expanded")
+expect_prompt("Shell did not print expected prompt ")
+
+# ? and classes
+sendline("echo [ab].log ?.txt")
+expect("a.log b.log c.txt\r\n", "? or [...] were not expanded")
+expect_prompt("Shell did not print expected prompt ")
+
+# several levels
+sendline("echo */*.c")
+expect("sub1/x.c sub2/y.c\r\n", "*/*.c was not expanded")
+expect_prompt("Shell did not print expected prompt ")
+
+# no match and escaped wildcards are passed on
+sendline("echo *.none a\\*b")
+expect("\*.none a\*b\r\n", "pattern without matches was not passed on")
+expect_prompt("Shell did not print expected prompt ")
+
+# the listing is read again after the directory changed
+sendline("echo *.log")
+expect("a.log b.log\r\n", "*.log was not expanded")
+expect_prompt("Shell did not print expected prompt ")
+open(os.path.join(tmpdir, "d.log"), "w").close()
+sendline("echo *.log")
+expect("a.log b.log d.log\r\n", "a new file was not found")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,45 @@
+#!/usr/bin/python
+#
+# heredoc_test: tests here-documents and here-strings
+# 
+# Test that the body of a here-document and the word of a here-string
+# become stdin of the first command of a pipeline, including bodies
+# larger than a pipe can hold
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a here-string
+sendline("tr a-z A-Z <<< herestring")
+expect("HERESTRING", "here-string was not read")
+expect_prompt("Shell did not print expected prompt ")
+
+# a here-document read up to its delimiter, feeding a pipeline
+sendline("cat << EOF | wc -l")
+sendline("first line")
+sendline("second line")
+sendline("EOF")
+expect("[^0-9]2\r\n", "here-document body was not passed on")
+expect_prompt("Shell did not print expected prompt ")
+
+# a body larger than the pipe capacity
+sendline("wc -c << END")
+for i in range(0, 70):
+    sendline("x" * 999)
+sendline("END")
+expect("70000", "large here-document was not passed on completely")
+expect_prompt("Shell did not print expected prompt ")
+# let the terminal catch up with the echo of the typed body
+time.sleep(1)
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,234 @@
+/*
+ * ulimit-style resource limits for jobs.
+ *
+ * Sizes are given in KiB like in bash's ulimit unless a K, M, G or T
+ * suffix is used; CPU time is given in seconds unless an s, m or h
+ * suffix is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include "joblimits.h"
+
+/* Description of one limit option */
+struct limit_info {
+    char option;        /* option letter */
+    int resource;       /* RLIMIT_* */
+    const char *name;   /* human readable name */
+    rlim_t unit;        /* multiplier for a plain number */
+    bool is_size;       /* true if the value is a size in bytes */
+};
+
+static const struct limit_info limit_infos[JOBLIMIT_COUNT] = {
+    [JOBLIMIT_AS]     = { 'v', RLIMIT_AS,     "virtual memory", 1024, true },
+    [JOBLIMIT_DATA]   = { 'd', RLIMIT_DATA,   "data segment",   1024, true },
+    [JOBLIMIT_STACK]  = { 's', RLIMIT_STACK,  "stack size",     1024, true },
+    [JOBLIMIT_CPU]    = { 't', RLIMIT_CPU,    "cpu time",       1,    false },
+    [JOBLIMIT_NOFILE] = { 'n', RLIMIT_NOFILE, "open files",     1,    false },
+    [JOBLIMIT_CORE]   = { 'c', RLIMIT_CORE,   "core file size", 1024, true },
+    [JOBLIMIT_FSIZE]  = { 'f', RLIMIT_FSIZE,  "file size",      1024, true },
+    [JOBLIMIT_NPROC]  = { 'u', RLIMIT_NPROC,  "processes",      1,    false },
+};
+
+/* Find the limit for option letter 'opt', or -1 */
+static int
+limit_by_option(char opt)
+{
+    for (int i = 0; i < JOBLIMIT_COUNT; i++)
+        if (limit_infos[i].option == opt)
+            return i;
+    return -1;
+}
+
+/* Parse the value of limit 'which', such as "2G", "90m" or "unlimited" */
+static bool
+parse_value(int which, const char *s, rlim_t *value)
+{
+    if (strcmp(s, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return true;
+    }
+
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || *s == '-')
+        return false;
+
+    rlim_t mult = limit_infos[which].unit;
+    if (*end != '\0') {
+        const char *suffixes = limit_infos[which].is_size ? "KMGT"
+                             : which == JOBLIMIT_CPU ? "smh" : "";
+        static const rlim_t size_mult[] = { 1ull << 10, 1ull << 20, 1ull << 30, 1ull << 40 };
+        static const rlim_t time_mult[] = { 1, 60, 3600 };
+        const char *suffix = strchr(suffixes, *end);
+        if (suffix == NULL || *suffixes == '\0' || end[1] != '\0')
+            return false;
+        mult = limit_infos[which].is_size ? size_mult[suffix - suffixes]
+                                          : time_mult[suffix - suffixes];
+    }
+    *value = v * mult;
+    return true;
+}
+
+/* Parse limit options such as -v 2G -t 60 from argv */
+int
+joblimits_parse(char **argv, struct joblimits *limits, bool *queries)
+{
+    int i = 0;
+
+    memset(limits, 0, sizeof *limits);
+    if (queries)
+        memset(queries, 0, JOBLIMIT_COUNT * sizeof *queries);
+
+    while (argv[i] && argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0') {
+        int which = limit_by_option(argv[i][1]);
+        if (which == -1) {
+            if (argv[i][1] == 'a' && queries) {
+                for (int j = 0; j < JOBLIMIT_COUNT; j++)
+                    queries[j] = true;
+                i++;
+                continue;
+            }
+            fprintf(stderr, "unknown limit option %s\n", argv[i]);
+            return -1;
+        }
+
+        char *arg = argv[i + 1];
+        if (arg == NULL || (arg[0] == '-' && queries)) {
+            if (queries == NULL) {
+                fprintf(stderr, "option %s requires a value\n", argv[i]);
+                return -1;
+            }
+            queries[which] = true;
+            i++;
+            continue;
+        }
+        if (!parse_value(which, arg, &limits->value[which])) {
+            fprintf(stderr, "invalid %s limit '%s'\n", limit_infos[which].name, arg);
+            return -1;
+        }
+        limits->has[which] = true;
+        i += 2;
+    }
+    return i;
+}
+
+/* Merge the limits present in 'from' into 'into' */
+void
+joblimits_merge(struct joblimits *into, const struct joblimits *from)
+{
+    for (int i = 0; i < JOBLIMIT_COUNT; i++) {
+        if (from->has[i]) {
+            into->has[i] = true;
+            into->value[i] = from->value[i];
+        }
+    }
+}
+
+/* Apply 'limits' to the calling process. */
+void
+joblimits_apply_self(const struct joblimits *limits)
+{
+    for (int i = 0; i < JOBLIMIT_COUNT; i++) {
+        if (!limits->has[i])
+            continue;
+
+        struct rlimit rl;
+        getrlimit(limit_infos[i].resource, &rl);
+        rl.rlim_cur = limits->value[i];
+        /* A hard limit can be lowered but not raised by a regular user.
+         * For CPU time, leave the hard limit a little above the soft one
+         * so the process gets SIGXCPU, which identifies the cause,
+         * before the kernel sends SIGKILL. */
+        rlim_t hard = limits->value[i];
+        if (i == JOBLIMIT_CPU && hard != RLIM_INFINITY)
+            hard += 5;
+        if (rl.rlim_max == RLIM_INFINITY || (hard != RLIM_INFINITY && hard < rl.rlim_max))
+            rl.rlim_max = hard;
+        if (rl.rlim_cur > rl.rlim_max)
+            rl.rlim_cur = rl.rlim_max;
+
+        if (setrlimit(limit_infos[i].resource, &rl) == -1)
+            perror(limit_infos[i].name);
+    }
+}
+
+/* Format the value of limit 'which' */
+static char *
+format_value(int which, rlim_t v, char *buf, size_t len)
+{
+    if (v == RLIM_INFINITY)
+        snprintf(buf, len, "unlimited");
+    else if (!limit_infos[which].is_size)
+        snprintf(buf, len, "%llu%s", (unsigned long long) v, which == JOBLIMIT_CPU ? "s" : "");
+    else if (v >= (1ull << 30) && v % (1ull << 30) == 0)
+        snprintf(buf, len, "%lluG", (unsigned long long) (v >> 30));
+    else if (v >= (1ull << 20) && v % (1ull << 20) == 0)
+        snprintf(buf, len, "%lluM", (unsigned long long) (v >> 20));
+    else
+        snprintf(buf, len, "%lluK", (unsigned long long) (v >> 10));
+    return buf;
+}
+
+/* Print the limits flagged in 'which' (all if NULL) */
+void
+joblimits_print(const struct joblimits *limits, const bool *which)
+{
+    char buf[64];
+
+    for (int i = 0; i < JOBLIMIT_COUNT; i++) {
+        if (which && !which[i])
+            continue;
+
+        rlim_t v;
+        if (limits->has[i]) {
+            v = limits->value[i];
+        } else {
+            struct rlimit rl;
+            getrlimit(limit_infos[i].resource, &rl);
+            v = rl.rlim_cur;
+        }
+        printf("%-16s (-%c) %s\n", limit_infos[i].name, limit_infos[i].option,
+               format_value(i, v, buf, sizeof buf));
+    }
+}
+
+/* Describe which limit may have caused a process to be killed by 'sig'.
+ * The CPU limit is only blamed if the process used that much CPU time;
+ * a memory limit cannot be told from a crash or a kill, so it is only
+ * reported as possible. */
+const char *
+joblimits_explain(const struct joblimits *limits, int sig, double cpu, char *buf, size_t len)
+{
+    char value[64];
+    int which = -1;
+
+    /* rusage is rounded to the tick, so allow for a little less */
+    if ((sig == SIGXCPU || sig == SIGKILL) && limits->has[JOBLIMIT_CPU] &&
+        limits->value[JOBLIMIT_CPU] != RLIM_INFINITY &&
+        cpu >= 0.99 * limits->value[JOBLIMIT_CPU])
+        which = JOBLIMIT_CPU;
+    else if (sig == SIGXFSZ)
+        which = JOBLIMIT_FSIZE;
+    else if (sig == SIGSEGV || sig == SIGBUS || sig == SIGABRT || sig == SIGKILL) {
+        /* running out of memory shows up as a failed allocation
+         * (usually an abort) or a fault on stack growth */
+        static const int memory_limits[] = { JOBLIMIT_AS, JOBLIMIT_DATA, JOBLIMIT_STACK };
+        for (int i = 0; i < 3; i++)
+            if (limits->has[memory_limits[i]] && limits->value[memory_limits[i]] != RLIM_INFINITY) {
+                which = memory_limits[i];
+                break;
+            }
+    }
+
+    if (which == -1 || !limits->has[which] || limits->value[which] == RLIM_INFINITY)
+        return NULL;
+
+    snprintf(buf, len, "%s limit of %s %s", limit_infos[which].name,
+             format_value(which, limits->value[which], value, sizeof value),
+             which == JOBLIMIT_CPU || which == JOBLIMIT_FSIZE ? "exceeded" : "possibly exceeded");
+    return buf;
+}
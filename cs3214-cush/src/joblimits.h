@@ -0,0 +1,50 @@
+#ifndef __JOBLIMITS_H
+#define __JOBLIMITS_H
+
+#include <stdbool.h>
+#include <sys/resource.h>
+
+/* Resource limits that can be set for a job */
+enum joblimit {
+    JOBLIMIT_AS,        /* -v  address space */
+    JOBLIMIT_DATA,      /* -d  data segment */
+    JOBLIMIT_STACK,     /* -s  stack size */
+    JOBLIMIT_CPU,       /* -t  CPU time */
+    JOBLIMIT_NOFILE,    /* -n  open files */
+    JOBLIMIT_CORE,      /* -c  core file size */
+    JOBLIMIT_FSIZE,     /* -f  file size */
+    JOBLIMIT_NPROC,     /* -u  processes */
+    JOBLIMIT_COUNT
+};
+
+/* A set of limits.  Only limits whose 'has' flag is set are applied;
+ * the others are inherited from the shell. */
+struct joblimits {
+    bool has[JOBLIMIT_COUNT];
+    rlim_t value[JOBLIMIT_COUNT];   /* RLIM_INFINITY for unlimited */
+};
+
+/* Parse limit options such as -v 2G -t 60 from argv into 'limits',
+ * stopping at the first word that is not a limit option.
+ * Returns the number of words consumed, or -1 after printing an
+ * error message.  Options without a value are only accepted if
+ * 'queries' is not NULL, in which case they are flagged there. */
+int joblimits_parse(char **argv, struct joblimits *limits, bool *queries);
+
+/* Merge the limits present in 'from' into 'into' */
+void joblimits_merge(struct joblimits *into, const struct joblimits *from);
+
+/* Apply 'limits' to the calling process.  Used in a child before exec. */
+void joblimits_apply_self(const struct joblimits *limits);
+
+/* Print the limits flagged in 'which' (all if NULL) from 'limits',
+ * falling back to the shell's own limits for unset entries. */
+void joblimits_print(const struct joblimits *limits, const bool *which);
+
+/* Describe which limit in 'limits' may have caused a process that used
+ * 'cpu' seconds of CPU time to be killed by signal 'sig'.  Returns NULL
+ * if no limit explains it. */
+const char *joblimits_explain(const struct joblimits *limits, int sig, double cpu,
+                              char *buf, size_t len);
+
+#endif /* __JOBLIMITS_H */
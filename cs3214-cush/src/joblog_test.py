@@ -0,0 +1,79 @@
+#!/usr/bin/python
+#
+# joblog_test: tests the joblog command
+#
+# Test that background jobs write to logs instead of the terminal while
+# joblog is on, that the logs keep the last bytes of the output and that
+# joblog %N shows them through the pager
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("export PAGER=cat")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("joblog on")
+expect_prompt("Shell did not print expected prompt ")
+
+# the output of the job goes to its log, and so does stderr
+sendline("echo to-the-log &")
+jid = parse_bg_status()[0]
+expect_prompt("Shell did not print expected prompt ")
+sendline("wait")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("joblog")
+expect("\[" + jid + "\]\s+Done\s+11 bytes\s+\(echo to-the-log\)", "log was not listed")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("joblog %" + jid)
+expect_exact("to-the-log\r\n", "log was not shown")
+expect_prompt("Shell did not print expected prompt ")
+
+# a small log keeps only the last bytes
+sendline("joblog on 10")
+expect_prompt("Shell did not print expected prompt ")
+sendline("seq 100 &")
+jid = parse_bg_status()[0]
+expect_prompt("Shell did not print expected prompt ")
+sendline("wait")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("joblog %" + jid)
+expect("\r98\r\n99\r\n100\r\n", "log did not keep the last bytes")
+expect_prompt("Shell did not print expected prompt ")
+
+# a spilled log keeps everything
+sendline("joblog spill 10")
+expect_prompt("Shell did not print expected prompt ")
+sendline("seq 1000 &")
+jid = parse_bg_status()[0]
+expect_prompt("Shell did not print expected prompt ")
+sendline("wait")
+expect_prompt("Shell did not print expected prompt ")
+sendline("joblog")
+expect("3893 bytes, in a file\s+\(seq 1000\)", "log was not spilled")
+expect_prompt("Shell did not print expected prompt ")
+
+# with joblog off jobs write to the terminal again
+sendline("joblog off")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo not-logged &")
+parse_bg_status()
+expect_exact("not-logged\r\n", "job did not write to the terminal")
+
+sendline("joblog %99")
+expect("no log for job", "missing log was not reported")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,655 @@
+/*
+ * Output capture of background jobs, see jobout.h.
+ *
+ * The main thread creates a log and its pipe and adds the read end to
+ * an epoll set; the worker thread waits on that set and reads whatever
+ * is ready straight into the log's buffer.  The logs are on a list,
+ * most recent first, protected by 'lock'.  Only the worker closes the
+ * pipes and only the main thread frees logs, and only those whose pipe
+ * is closed, so a log the worker may still see an event for is never
+ * freed under it.  The main thread drains a log as well before it shows
+ * it, so that the output of a job that just finished is all there.
+ *
+ * Tagged captures belong to the worker alone once they are in the epoll
+ * set.  Each round the worker reads once from every ready pipe, so that
+ * no job starves the others, and then writes the complete lines of all
+ * captures, each after its tag, with as few writev calls as fit.  The
+ * sink is non-blocking: when the terminal takes no more, the worker
+ * waits for it in the same epoll set, and a capture whose buffer fills
+ * meanwhile leaves the set until its lines went out, so the job blocks
+ * in write on its full pipe.  Before the shell exits, jobout_flush has
+ * the worker run rounds with a blocking sink until the pipes are empty.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "jobout.h"
+#include "utils.h"
+
+#define MIN_BUFFER  4096        /* a buffer starts this small and doubles */
+#define SPLICE_MAX  (1 << 20)   /* bytes moved by one splice */
+#define MAX_EVENTS  16
+#define BATCH_MAX   1024        /* pieces in one writev, at most IOV_MAX */
+#define FLUSH_ROUNDS 256        /* bound on a flush, for jobs still writing */
+
+struct capture {
+    struct capture *next;
+    int jid;
+    char *cmdline;
+    int fd;                     /* read end of the pipe, -1 once closed */
+    size_t size;                /* the most bytes 'buf' may hold */
+    bool spills;                /* move to a file when 'buf' is full */
+    /* the last 'len' bytes, ending at 'head'.  While 'cap' is below
+     * 'size' the buffer has not wrapped and 'head' equals 'len'. */
+    char *buf;
+    size_t cap, head, len;
+    int spill;                  /* the file holding everything, or -1 */
+    unsigned long long total;   /* bytes the job wrote */
+    /* tagged captures: 'buf' holds 'len' bytes of which the first 'sent'
+     * are written and the next 'queued' are in the batch being built */
+    bool tagged;
+    char tag[16];               /* "[jid] " */
+    size_t sent, queued;
+    bool listed;                /* on the worker's list */
+    bool paused;                /* out of the epoll set while 'buf' is full */
+};
+
+/* A piece of a batch of tagged lines: a tag, text from the buffer of
+ * 'c', or the newline that ends a line cut at the size of the buffer */
+struct piece {
+    struct capture *c;
+    bool text;                  /* counts in c->sent once written */
+    bool starts_line;           /* a tag */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct capture *logs;
+static int epfd = -1;
+
+static struct capture *tagged;  /* the worker's tagged captures */
+static int sink = -1;           /* where tagged lines go */
+static bool sink_blocked;       /* waiting for the sink to take more */
+
+static int wakefd = -1;         /* eventfd the main thread asks for a flush with */
+static pthread_cond_t flushed = PTHREAD_COND_INITIALIZER;
+static bool flush_pending;      /* protected by 'lock' */
+
+static enum jobout_mode mode = JOBOUT_OFF;
+static size_t mode_size = JOBOUT_DEFAULT_SIZE;
+
+/* Create the temporary file a log spills into */
+static int
+open_spill_file(void)
+{
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || *dir == '\0')
+        dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR))
+        return fd;
+
+    /* O_TMPFILE is not supported by every file system */
+    char path[4096];
+    snprintf(path, sizeof path, "%s/cush-joblog-XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+/* Move the buffer of 'log', which has not wrapped, into a spill file.
+ * Returns false if the file cannot be made, in which case the log keeps
+ * only its last bytes from now on. */
+static bool
+start_spill(struct capture *log)
+{
+    int fd = open_spill_file();
+    if (fd < 0) {
+        log->spills = false;
+        return false;
+    }
+    for (size_t off = 0; off < log->len; ) {
+        ssize_t n = write(fd, log->buf + off, log->len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            close(fd);
+            log->spills = false;
+            return false;
+        }
+        off += n;
+    }
+    free(log->buf);
+    log->buf = NULL;
+    log->cap = log->head = log->len = 0;
+    log->spill = fd;
+    return true;
+}
+
+/* Read from the pipe of 'log' into its buffer.  Returns what read
+ * returns. */
+static ssize_t
+read_into_buffer(struct capture *log)
+{
+    if (log->len == log->cap && log->cap < log->size) {
+        size_t cap = log->cap ? log->cap * 2 : MIN_BUFFER;
+        log->cap = cap < log->size ? cap : log->size;
+        log->buf = realloc(log->buf, log->cap);
+    }
+
+    /* Before the buffer has reached its size, or in spill mode, read
+     * into the free space only; after that overwrite the oldest bytes,
+     * which follow 'head' */
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = log->buf + log->head;
+    iov[0].iov_len = log->cap - log->head;
+    if (log->cap == log->size && !log->spills && log->head > 0) {
+        iov[1].iov_base = log->buf;
+        iov[1].iov_len = log->head;
+        iovcnt = 2;
+    }
+
+    ssize_t n = readv(log->fd, iov, iovcnt);
+    if (n > 0) {
+        log->head = (log->head + n) % log->cap;
+        log->len = log->len + n < log->cap ? log->len + n : log->cap;
+        if (log->cap < log->size || log->spills)
+            log->head = log->len;
+    }
+    return n;
+}
+
+/* Read everything that is in the pipe of 'log' and, if 'may_close', close
+ * it when the job closed its end.  Called with 'lock' held. */
+static void
+drain(struct capture *log, bool may_close)
+{
+    while (log->fd >= 0) {
+        ssize_t n;
+        if (log->spill >= 0)
+            n = splice(log->fd, NULL, log->spill, NULL, SPLICE_MAX,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        else if (log->spills && log->len == log->size && start_spill(log))
+            continue;
+        else
+            n = read_into_buffer(log);
+
+        if (n > 0) {
+            log->total += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if ((n < 0 && errno == EAGAIN) || !may_close)
+            return;
+        /* the end of the output, or an error that ends it as well */
+        epoll_ctl(epfd, EPOLL_CTL_DEL, log->fd, NULL);
+        close(log->fd);
+        log->fd = -1;
+    }
+}
+
+static void
+free_capture(struct capture *c)
+{
+    if (c->spill >= 0)
+        close(c->spill);
+    free(c->buf);
+    free(c->cmdline);
+    free(c);
+}
+
+/* Write all of 'len' bytes of 'buf' to 'fd', waiting for it if it is
+ * non-blocking */
+static bool
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EAGAIN) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Take tagged capture 'c' out of the epoll set, or put it back */
+static void
+set_paused(struct capture *c, bool paused)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    epoll_ctl(epfd, paused ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, c->fd, &ev);
+    c->paused = paused;
+}
+
+/* Read once from the pipe of tagged capture 'c' */
+static void
+read_tagged(struct capture *c)
+{
+    if (!c->listed) {
+        c->next = tagged;
+        tagged = c;
+        c->listed = true;
+    }
+    if (c->len == c->size)
+        return;
+    ssize_t n = read(c->fd, c->buf + c->len, c->size - c->len);
+    if (n > 0) {
+        c->len += n;
+        c->total += n;
+    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+        return;
+    }
+    /* backpressure: the job blocks once its pipe is full as well */
+    if (c->len == c->size)
+        set_paused(c, true);
+}
+
+/* Count a written piece */
+static void
+piece_written(const struct piece *piece, size_t len)
+{
+    if (piece->text)
+        piece->c->sent += len;
+}
+
+/* Write a batch of 'n' pieces to the sink.  Returns false if the sink
+ * took only part of it, in which case it is waited for with epoll.  A
+ * line the sink took part of is finished first, so that lines from
+ * different jobs never mix. */
+static bool
+write_batch(struct iovec *iov, const struct piece *pieces, int n)
+{
+    ssize_t w = writev(sink, iov, n);
+    if (w < 0 && errno != EAGAIN && errno != EINTR) {
+        /* the sink is gone, and the lines with it */
+        for (int i = 0; i < n; i++)
+            piece_written(&pieces[i], iov[i].iov_len);
+        return true;
+    }
+    if (w < 0)
+        w = 0;
+
+    int i = 0;
+    for (; i < n && (size_t) w >= iov[i].iov_len; i++) {
+        w -= iov[i].iov_len;
+        piece_written(&pieces[i], iov[i].iov_len);
+    }
+    if (i < n && (w > 0 || !pieces[i].starts_line)) {
+        do {
+            write_all(sink, (char *) iov[i].iov_base + w, iov[i].iov_len - w);
+            piece_written(&pieces[i], iov[i].iov_len);
+            w = 0;
+            i++;
+        } while (i < n && !pieces[i].starts_line);
+    }
+    if (i == n)
+        return true;
+
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sink, &ev);
+    sink_blocked = true;
+    return false;
+}
+
+/* Add a piece to the batch */
+static void
+add_piece(struct iovec *iov, struct piece *pieces, int *n, struct capture *c,
+          void *base, size_t len, bool text, bool starts_line)
+{
+    iov[*n].iov_base = base;
+    iov[*n].iov_len = len;
+    pieces[*n] = (struct piece) { .c = c, .text = text, .starts_line = starts_line };
+    (*n)++;
+}
+
+/* Write the complete lines of all tagged captures, then move what is
+ * left of each buffer to its start and free the captures that are done */
+static void
+write_tagged(void)
+{
+    static struct iovec iov[BATCH_MAX];
+    static struct piece pieces[BATCH_MAX];
+    static char newline[] = "\n";
+    int n = 0;
+
+    bool blocked = false;
+    for (struct capture *c = tagged; c && !blocked; c = c->next) {
+        for (;;) {
+            char *line = c->buf + c->sent + c->queued;
+            size_t rest = c->len - c->sent - c->queued;
+            char *nl = memchr(line, '\n', rest);
+            /* a line as long as the buffer, or the last one, is cut */
+            bool cut = nl == NULL && rest > 0
+                       && (c->fd < 0 || rest == c->size);
+            if (nl == NULL && !cut)
+                break;
+            if (n + 3 > BATCH_MAX) {
+                blocked = !write_batch(iov, pieces, n);
+                n = 0;
+                for (struct capture *q = tagged; q; q = q->next)
+                    q->queued = 0;
+                if (blocked)
+                    break;
+                continue;
+            }
+            size_t len = nl ? (size_t) (nl - line + 1) : rest;
+            add_piece(iov, pieces, &n, c, c->tag, strlen(c->tag), false, true);
+            add_piece(iov, pieces, &n, c, line, len, true, false);
+            if (cut)
+                add_piece(iov, pieces, &n, c, newline, 1, false, false);
+            c->queued += len;
+        }
+    }
+    if (n > 0 && !blocked)
+        write_batch(iov, pieces, n);
+
+    for (struct capture **p = &tagged; *p; ) {
+        struct capture *c = *p;
+        c->queued = 0;
+        if (c->sent > 0) {
+            memmove(c->buf, c->buf + c->sent, c->len - c->sent);
+            c->len -= c->sent;
+            c->sent = 0;
+        }
+        if (c->fd < 0 && c->len == 0) {
+            *p = c->next;
+            free_capture(c);
+            continue;
+        }
+        if (c->paused && c->len < c->size)
+            set_paused(c, false);
+        p = &c->next;
+    }
+}
+
+/* Make the sink blocking for a flush, which writes everything */
+static void
+start_flush(void)
+{
+    uint64_t count;
+    if (read(wakefd, &count, sizeof count) < 0)
+        return;
+    fcntl(sink, F_SETFL, fcntl(sink, F_GETFL) & ~O_NONBLOCK);
+    if (sink_blocked) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, sink, NULL);
+        sink_blocked = false;
+    }
+}
+
+/* Body of the worker thread */
+static void *
+worker(void *arg)
+{
+    (void) arg;
+    struct epoll_event events[MAX_EVENTS];
+    int flush_rounds = -1;      /* rounds of a flush so far, -1 if none */
+
+    for (;;) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, flush_rounds >= 0 ? 0 : -1);
+        for (int i = 0; i < n; i++) {
+            struct capture *c = events[i].data.ptr;
+            if (c == (void *) &wakefd) {
+                start_flush();
+                flush_rounds = 0;
+            } else if (c == NULL) {
+                /* the sink takes more */
+                epoll_ctl(epfd, EPOLL_CTL_DEL, sink, NULL);
+                sink_blocked = false;
+            } else if (c->tagged) {
+                read_tagged(c);
+            } else {
+                pthread_mutex_lock(&lock);
+                drain(c, true);
+                pthread_mutex_unlock(&lock);
+            }
+        }
+        if (!sink_blocked)
+            write_tagged();
+
+        /* a flush is over when no pipe had anything left */
+        if (flush_rounds >= 0 && (n == 0 || ++flush_rounds > FLUSH_ROUNDS)) {
+            flush_rounds = -1;
+            pthread_mutex_lock(&lock);
+            flush_pending = false;
+            pthread_cond_signal(&flushed);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    return NULL;
+}
+
+/* Create the epoll set and start the worker, the first time only */
+static bool
+start_worker(void)
+{
+    if (epfd >= 0)
+        return true;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        return false;
+
+    bool ok = utils_start_thread(worker, NULL) == 0;
+    if (!ok) {
+        close(epfd);
+        epfd = -1;
+    }
+    return ok;
+}
+
+/* Free the oldest finished logs beyond JOBOUT_MAXLOGS.  Called with
+ * 'lock' held. */
+static void
+trim_logs(void)
+{
+    int finished = 0;
+    for (struct capture **p = &logs; *p; ) {
+        struct capture *log = *p;
+        if (log->fd < 0 && ++finished > JOBOUT_MAXLOGS) {
+            *p = log->next;
+            free_capture(log);
+        } else {
+            p = &log->next;
+        }
+    }
+}
+
+/* Open where tagged lines go: the terminal on stdout, through a file
+ * description of its own that can be non-blocking without affecting
+ * the shell's, or else a copy of stdout */
+static int
+open_sink(void)
+{
+    char *tty = isatty(1) ? ttyname(1) : NULL;
+    if (tty != NULL) {
+        int fd = open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd >= 0)
+            return fd;
+    }
+    return fcntl(1, F_DUPFD_CLOEXEC, 3);
+}
+
+bool
+jobout_set_mode(enum jobout_mode m, size_t size)
+{
+    if (m == JOBOUT_TAG && sink < 0) {
+        if (!start_worker())
+            return false;
+        wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &wakefd };
+        if (wakefd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev) < 0
+            || (sink = open_sink()) < 0)
+            return false;
+    }
+    mode = m;
+    mode_size = size;
+    return true;
+}
+
+enum jobout_mode
+jobout_get_mode(size_t *size)
+{
+    *size = mode_size;
+    return mode;
+}
+
+bool
+jobout_parse_size(const char *s, size_t *size)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || *s == '-' || v == 0)
+        return false;
+    if (*end != '\0') {
+        static const char suffixes[] = "KMG";
+        const char *suffix = strchr(suffixes, *end);
+        if (suffix == NULL || end[1] != '\0')
+            return false;
+        v <<= 10 * (suffix - suffixes + 1);
+    }
+    *size = v;
+    return true;
+}
+
+int
+jobout_capture(int jid, const char *cmdline)
+{
+    if (mode == JOBOUT_OFF || !start_worker())
+        return -1;
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    struct capture *log = calloc(1, sizeof *log);
+    log->jid = jid;
+    log->cmdline = strdup(cmdline);
+    log->fd = fds[0];
+    log->size = mode_size;
+    log->spills = mode == JOBOUT_SPILL;
+    log->spill = -1;
+
+    /* from here on a tagged capture is the worker's */
+    if (mode == JOBOUT_TAG) {
+        log->tagged = true;
+        log->buf = malloc(log->size);
+        snprintf(log->tag, sizeof log->tag, "[%d] ", jid);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = log };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, log->fd, &ev) < 0) {
+            close(log->fd);
+            free_capture(log);
+            close(fds[1]);
+            return -1;
+        }
+        return fds[1];
+    }
+
+    pthread_mutex_lock(&lock);
+    log->next = logs;
+    logs = log;
+    trim_logs();
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = log };
+    bool ok = epoll_ctl(epfd, EPOLL_CTL_ADD, log->fd, &ev) == 0;
+    if (!ok) {
+        logs = log->next;
+        close(log->fd);
+        free_capture(log);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!ok) {
+        close(fds[1]);
+        return -1;
+    }
+    return fds[1];
+}
+
+void
+jobout_flush(void)
+{
+    if (sink < 0)
+        return;
+    pthread_mutex_lock(&lock);
+    flush_pending = true;
+    uint64_t one = 1;
+    if (write(wakefd, &one, sizeof one) == sizeof one) {
+        while (flush_pending)
+            pthread_cond_wait(&flushed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void
+jobout_list(FILE *out)
+{
+    pthread_mutex_lock(&lock);
+    for (struct capture *log = logs; log; log = log->next) {
+        drain(log, false);
+        fprintf(out, "[%d]\t%s\t%llu bytes", log->jid,
+                log->fd >= 0 ? "Running" : "Done", log->total);
+        if (log->spill >= 0)
+            fprintf(out, ", in a file");
+        else if (log->total > log->len)
+            fprintf(out, ", last %zu kept", log->len);
+        fprintf(out, "\t(%s)\n", log->cmdline);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int
+jobout_open_log(int jid)
+{
+    int fd = -1;
+    pthread_mutex_lock(&lock);
+    struct capture *log = logs;
+    while (log != NULL && log->jid != jid)
+        log = log->next;
+    if (log == NULL) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    drain(log, false);
+    if (log->spill >= 0) {
+        /* a description of its own, so the offset starts at 0 */
+        char path[64];
+        snprintf(path, sizeof path, "/proc/self/fd/%d", log->spill);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    } else if ((fd = memfd_create("joblog", MFD_CLOEXEC)) >= 0) {
+        /* the oldest bytes follow 'head' once the buffer is full */
+        size_t start = log->len == log->cap ? log->head : 0;
+        if (!write_all(fd, log->buf + start, log->len - start)
+            || !write_all(fd, log->buf, start)) {
+            close(fd);
+            fd = -1;
+        } else {
+            lseek(fd, 0, SEEK_SET);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return fd;
+}
@@ -0,0 +1,65 @@
+#ifndef __JOBOUT_H
+#define __JOBOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Capture of the output of background jobs.
+ *
+ * When capture is on, a background job writes its stdout and stderr to
+ * a pipe owned by the shell instead of the terminal.  A worker thread
+ * drains all such pipes with epoll into a log per job: a ring buffer
+ * that keeps the last 'size' bytes, or, in spill mode, a buffer of
+ * 'size' bytes whose contents move to an unlinked temporary file when
+ * it fills, after which the pipe is spliced into the file and nothing
+ * is dropped.  Logs stay after their job finished, the most recent
+ * JOBOUT_MAXLOGS finished ones are kept.
+ *
+ * In tag mode the worker writes the output of the jobs to the terminal
+ * instead, a line at a time with "[jid] " in front, so that the lines of
+ * concurrent jobs do not mix.  A job's lines wait in a buffer of 'size'
+ * bytes; a longer line is cut, and a job whose buffer is full is not
+ * read from until the terminal took its lines.
+ */
+
+#define JOBOUT_DEFAULT_SIZE (64 << 10)  /* bytes kept per job by default */
+#define JOBOUT_MAXLOGS      32          /* finished logs that are kept */
+
+enum jobout_mode {
+    JOBOUT_OFF,         /* background jobs write to the terminal */
+    JOBOUT_RING,        /* keep the last 'size' bytes of each job */
+    JOBOUT_SPILL,       /* keep everything, past 'size' bytes in a file */
+    JOBOUT_TAG,         /* write to the terminal, each line tagged */
+};
+
+/* Set the mode and size for the jobs started from now on.  Jobs
+ * already captured keep theirs.  Tagged lines go to stdout as it is when
+ * tag mode is first set.  Returns false if that cannot be opened. */
+bool jobout_set_mode(enum jobout_mode mode, size_t size);
+
+/* Return the current mode and store its size in '*size' */
+enum jobout_mode jobout_get_mode(size_t *size);
+
+/* Parse a size such as "4096", "64K" or "1M".  Returns false if 's' is
+ * not a size greater than zero. */
+bool jobout_parse_size(const char *s, size_t *size);
+
+/* Start capturing the output of job 'jid', shown as 'cmdline'.  Returns
+ * the close-on-exec write end of its pipe, which the caller hands to the
+ * job and then closes, or -1 if capture is off or failed. */
+int jobout_capture(int jid, const char *cmdline);
+
+/* Wait until the worker wrote the tagged lines that are in the pipes
+ * now.  Called before the shell exits. */
+void jobout_flush(void);
+
+/* Print a line for each log, most recent first */
+void jobout_list(FILE *out);
+
+/* Return a new close-on-exec descriptor, at offset 0, from which the
+ * log of job 'jid' as it is now can be read, the most recent if jid was
+ * used more than once.  Returns -1 if there is no such log. */
+int jobout_open_log(int jid);
+
+#endif /* __JOBOUT_H */
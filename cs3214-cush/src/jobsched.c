@@ -0,0 +1,290 @@
+/*
+ * Per-job CPU affinity, nice value and I/O priority.
+ *
+ * Settings are applied either in a freshly forked child before it
+ * execs, or later to a running job through its process group.
+ */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "jobsched.h"
+
+/* glibc does not wrap ioprio_set/ioprio_get; see ioprio_set(2) */
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_WHO_PGRP     2
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_VALUE(class, level)  (((class) << IOPRIO_CLASS_SHIFT) | (level))
+
+static const char *ioclass_names[] = {
+    [JOBSCHED_IO_NONE] = "none",
+    [JOBSCHED_IO_RT] = "rt",
+    [JOBSCHED_IO_BE] = "be",
+    [JOBSCHED_IO_IDLE] = "idle",
+};
+
+/* Parse a CPU list such as "0-3,6" into 'set' */
+static bool
+parse_cpulist(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0)
+            return false;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo)
+                return false;
+        }
+        if (hi >= CPU_SETSIZE)
+            return false;
+        for (long cpu = lo; cpu <= hi; cpu++)
+            CPU_SET(cpu, set);
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return false;
+        s = end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/* Parse an I/O priority such as "idle", "be:7" or "2:4" */
+static bool
+parse_ioprio(const char *s, int *ioclass, int *iolevel)
+{
+    const char *colon = strchr(s, ':');
+    size_t len = colon ? (size_t) (colon - s) : strlen(s);
+
+    *ioclass = -1;
+    for (int i = JOBSCHED_IO_RT; i <= JOBSCHED_IO_IDLE; i++)
+        if (strlen(ioclass_names[i]) == len && strncmp(s, ioclass_names[i], len) == 0)
+            *ioclass = i;
+    if (*ioclass == -1 && len == 1 && s[0] >= '1' && s[0] <= '3')
+        *ioclass = s[0] - '0';
+    if (*ioclass == -1)
+        return false;
+
+    *iolevel = *ioclass == JOBSCHED_IO_IDLE ? 0 : 4;
+    if (colon) {
+        char *end;
+        *iolevel = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || *iolevel < 0 || *iolevel > 7)
+            return false;
+    }
+    return true;
+}
+
+/* Parse -c CPULIST, -n NICE and -i CLASS[:LEVEL] from argv. */
+int
+jobsched_parse(char **argv, struct jobsched *sched)
+{
+    int i = 0;
+
+    memset(sched, 0, sizeof *sched);
+    while (argv[i] && argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0') {
+        char opt = argv[i][1];
+        char *arg = argv[i + 1];
+
+        if (strchr("cni", opt) == NULL)
+            break;
+        if (arg == NULL) {
+            fprintf(stderr, "option -%c requires an argument\n", opt);
+            return -1;
+        }
+
+        if (opt == 'c') {
+            if (!parse_cpulist(arg, &sched->cpus)) {
+                fprintf(stderr, "invalid cpu list '%s'\n", arg);
+                return -1;
+            }
+            sched->has_cpus = true;
+        } else if (opt == 'n') {
+            char *end;
+            sched->nice = strtol(arg, &end, 10);
+            if (end == arg || *end != '\0' || sched->nice < -20 || sched->nice > 19) {
+                fprintf(stderr, "invalid nice value '%s'\n", arg);
+                return -1;
+            }
+            sched->has_nice = true;
+        } else {
+            if (!parse_ioprio(arg, &sched->ioclass, &sched->iolevel)) {
+                fprintf(stderr, "invalid io priority '%s', expected rt|be|idle[:0-7]\n", arg);
+                return -1;
+            }
+            sched->has_ioprio = true;
+        }
+        i += 2;
+    }
+    return i;
+}
+
+/* Merge the settings present in 'from' into 'into' */
+void
+jobsched_merge(struct jobsched *into, const struct jobsched *from)
+{
+    if (from->has_cpus) {
+        into->has_cpus = true;
+        into->cpus = from->cpus;
+    }
+    if (from->has_nice) {
+        into->has_nice = true;
+        into->nice = from->nice;
+    }
+    if (from->has_ioprio) {
+        into->has_ioprio = true;
+        into->ioclass = from->ioclass;
+        into->iolevel = from->iolevel;
+    }
+}
+
+/* Apply 'sched' to the calling process. */
+void
+jobsched_apply_self(const struct jobsched *sched)
+{
+    if (sched->has_cpus && sched_setaffinity(0, sizeof sched->cpus, &sched->cpus) == -1)
+        perror("sched_setaffinity");
+    if (sched->has_nice && setpriority(PRIO_PROCESS, 0, sched->nice) == -1)
+        perror("setpriority");
+    if (sched->has_ioprio &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                IOPRIO_VALUE(sched->ioclass, sched->iolevel)) == -1)
+        perror("ioprio_set");
+}
+
+/* Return the process group of 'pid' as found in /proc, or -1 */
+static pid_t
+proc_pgrp(const char *pid)
+{
+    char path[300], buf[512];
+    snprintf(path, sizeof path, "/proc/%s/stat", pid);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    size_t n = fread(buf, 1, sizeof buf - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    /* skip "pid (comm)", comm may contain spaces and parentheses */
+    char *p = strrchr(buf, ')');
+    int ppid, pgrp;
+    char state;
+    if (p == NULL || sscanf(p + 1, " %c %d %d", &state, &ppid, &pgrp) != 3)
+        return -1;
+    return pgrp;
+}
+
+/* Set the affinity of every thread of process 'pid' */
+static bool
+set_process_affinity(const char *pid, const cpu_set_t *cpus)
+{
+    char path[300];
+    snprintf(path, sizeof path, "/proc/%s/task", pid);
+
+    DIR *tasks = opendir(path);
+    if (tasks == NULL)
+        return false;
+
+    bool ok = true;
+    struct dirent *t;
+    while ((t = readdir(tasks)) != NULL) {
+        if (!isdigit(t->d_name[0]))
+            continue;
+        if (sched_setaffinity(atoi(t->d_name), sizeof *cpus, cpus) == -1 && errno != ESRCH)
+            ok = false;
+    }
+    closedir(tasks);
+    return ok;
+}
+
+/* Apply 'sched' to every process in process group 'pgid'. */
+bool
+jobsched_apply_pgrp(pid_t pgid, const struct jobsched *sched)
+{
+    bool ok = true;
+
+    if (sched->has_nice && setpriority(PRIO_PGRP, pgid, sched->nice) == -1) {
+        perror("setpriority");
+        ok = false;
+    }
+    if (sched->has_ioprio &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PGRP, pgid,
+                IOPRIO_VALUE(sched->ioclass, sched->iolevel)) == -1) {
+        perror("ioprio_set");
+        ok = false;
+    }
+    if (!sched->has_cpus)
+        return ok;
+
+    /* there is no process group variant of sched_setaffinity,
+     * so find the members of the group, including any processes
+     * the job forked itself, in /proc */
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) {
+        perror("/proc");
+        return false;
+    }
+    struct dirent *d;
+    while ((d = readdir(proc)) != NULL) {
+        if (isdigit(d->d_name[0]) && proc_pgrp(d->d_name) == pgid
+            && !set_process_affinity(d->d_name, &sched->cpus)) {
+            fprintf(stderr, "sched_setaffinity failed for pid %s\n", d->d_name);
+            ok = false;
+        }
+    }
+    closedir(proc);
+    return ok;
+}
+
+/* Print the current settings of process 'pid' */
+void
+jobsched_print(pid_t pid)
+{
+    cpu_set_t cpus;
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, pid);
+    if (nice == -1 && errno != 0) {
+        perror("getpriority");
+        return;
+    }
+    printf("nice %d", nice);
+
+    if (sched_getaffinity(pid, sizeof cpus, &cpus) == 0) {
+        printf(", cpus ");
+        const char *sep = "";
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &cpus))
+                continue;
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+                last++;
+            if (last == cpu)
+                printf("%s%d", sep, cpu);
+            else
+                printf("%s%d-%d", sep, cpu, last);
+            sep = ",";
+            cpu = last;
+        }
+    }
+
+    long prio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, pid);
+    if (prio >= 0) {
+        int ioclass = prio >> IOPRIO_CLASS_SHIFT;
+        int level = prio & ((1 << IOPRIO_CLASS_SHIFT) - 1);
+        if (ioclass >= JOBSCHED_IO_NONE && ioclass <= JOBSCHED_IO_IDLE)
+            printf(", io %s:%d", ioclass_names[ioclass], level);
+    }
+    printf("\n");
+}
@@ -0,0 +1,47 @@
+#ifndef __JOBSCHED_H
+#define __JOBSCHED_H
+
+#include <sched.h>         /* cpu_set_t requires _GNU_SOURCE */
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* I/O scheduling classes, as used by ioprio_set(2) */
+enum jobsched_ioclass {
+    JOBSCHED_IO_NONE = 0,
+    JOBSCHED_IO_RT = 1,
+    JOBSCHED_IO_BE = 2,
+    JOBSCHED_IO_IDLE = 3,
+};
+
+/* Scheduling settings of a job.  Only the settings whose has_ flag is
+ * set are applied; everything else is inherited from the shell. */
+struct jobsched {
+    bool has_cpus;
+    cpu_set_t cpus;         /* CPU affinity */
+    bool has_nice;
+    int nice;               /* nice value, -20..19 */
+    bool has_ioprio;
+    int ioclass;            /* enum jobsched_ioclass */
+    int iolevel;            /* 0 (highest) .. 7 (lowest) within the class */
+};
+
+/* Parse scheduling options -c CPULIST, -n NICE and -i CLASS[:LEVEL]
+ * from argv into 'sched', stopping at the first word that is not an
+ * option.  Returns the number of words consumed, or -1 after printing
+ * an error message. */
+int jobsched_parse(char **argv, struct jobsched *sched);
+
+/* Merge the settings present in 'from' into 'into' */
+void jobsched_merge(struct jobsched *into, const struct jobsched *from);
+
+/* Apply 'sched' to the calling process.  Used in a child before exec. */
+void jobsched_apply_self(const struct jobsched *sched);
+
+/* Apply 'sched' to every process (and thread) in process group 'pgid'.
+ * Returns false if any setting could not be applied. */
+bool jobsched_apply_pgrp(pid_t pgid, const struct jobsched *sched);
+
+/* Print the current settings of process 'pid' */
+void jobsched_print(pid_t pid);
+
+#endif /* __JOBSCHED_H */
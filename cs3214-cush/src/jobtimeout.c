@@ -0,0 +1,210 @@
+/*
+ * Job deadlines, see jobtimeout.h.
+ *
+ * The deadlines are on a list protected by 'lock'.  The epoll set
+ * carries the id of a deadline rather than a pointer to it: the main
+ * thread may cancel and free a deadline while the worker is about to
+ * handle its expiry, and the worker then does not find the id.  A
+ * deadline whose job was reaped but not yet cancelled is marked
+ * 'reaped' from the SIGCHLD handler, which cannot take the lock.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "jobtimeout.h"
+#include "utils.h"
+
+#define MAX_EVENTS  16
+
+enum stage {
+    ARMED,                      /* waiting for the deadline */
+    TERMINATED,                 /* SIGTERM sent, SIGKILL may follow */
+    KILLED,                     /* nothing more to send */
+};
+
+struct jobtimeout {
+    struct jobtimeout *next;
+    uint64_t id;
+    int fd;                     /* the timerfd */
+    pid_t pgid;
+    double kill_after;
+    volatile sig_atomic_t stage;
+    volatile sig_atomic_t reaped;   /* set by jobtimeout_disarm */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct jobtimeout *timeouts;
+static uint64_t next_id = 1;
+static int epfd = -1;
+
+/* Arm the timer of 't' to expire once, 'secs' from now */
+static bool
+arm(struct jobtimeout *t, double secs)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof its);
+    its.it_value.tv_sec = (time_t) secs;
+    its.it_value.tv_nsec = (long) ((secs - (time_t) secs) * 1e9);
+    /* zero would disarm the timer */
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;
+    return timerfd_settime(t->fd, 0, &its, NULL) == 0;
+}
+
+/* Send the next signal of the deadline with id 'id'.  Called with
+ * 'lock' held. */
+static void
+expire(uint64_t id)
+{
+    struct jobtimeout *t = timeouts;
+    while (t != NULL && t->id != id)
+        t = t->next;
+    if (t == NULL)
+        return;
+
+    uint64_t count;
+    if (read(t->fd, &count, sizeof count) < 0 || t->reaped)
+        return;
+    if (t->stage == ARMED) {
+        killpg(t->pgid, SIGTERM);
+        killpg(t->pgid, SIGCONT);
+        t->stage = TERMINATED;
+        if (t->kill_after <= 0 || !arm(t, t->kill_after))
+            t->stage = KILLED;
+    } else if (t->stage == TERMINATED) {
+        killpg(t->pgid, SIGKILL);
+        t->stage = KILLED;
+    }
+}
+
+/* Body of the worker thread */
+static void *
+worker(void *arg)
+{
+    (void) arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        pthread_mutex_lock(&lock);
+        for (int i = 0; i < n; i++)
+            expire(events[i].data.u64);
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* Create the epoll set and start the worker, the first time only */
+static bool
+start_worker(void)
+{
+    if (epfd >= 0)
+        return true;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        return false;
+
+    bool ok = utils_start_thread(worker, NULL) == 0;
+    if (!ok) {
+        close(epfd);
+        epfd = -1;
+    }
+    return ok;
+}
+
+bool
+jobtimeout_parse(const char *s, double *secs)
+{
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || *s == '-' || !isfinite(v))
+        return false;
+    if (*end != '\0') {
+        static const char suffixes[] = "smhd";
+        static const double mult[] = { 1, 60, 3600, 86400 };
+        const char *suffix = strchr(suffixes, *end);
+        if (suffix == NULL || end[1] != '\0')
+            return false;
+        v *= mult[suffix - suffixes];
+    }
+    *secs = v;
+    return true;
+}
+
+struct jobtimeout *
+jobtimeout_start(pid_t pgid, double secs, double kill_after)
+{
+    if (!start_worker())
+        return NULL;
+
+    struct jobtimeout *t = calloc(1, sizeof *t);
+    t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    t->pgid = pgid;
+    t->kill_after = kill_after;
+    t->stage = ARMED;
+    if (t->fd < 0 || !arm(t, secs)) {
+        if (t->fd >= 0)
+            close(t->fd);
+        free(t);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    t->id = next_id++;
+    t->next = timeouts;
+    timeouts = t;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = t->id };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, t->fd, &ev);
+    pthread_mutex_unlock(&lock);
+    return t;
+}
+
+void
+jobtimeout_cancel(struct jobtimeout *t)
+{
+    if (t == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    for (struct jobtimeout **p = &timeouts; *p; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, t->fd, NULL);
+    close(t->fd);
+    pthread_mutex_unlock(&lock);
+    free(t);
+}
+
+void
+jobtimeout_disarm(struct jobtimeout *t)
+{
+    if (t != NULL)
+        t->reaped = true;
+}
+
+bool
+jobtimeout_expired(const struct jobtimeout *t)
+{
+    return t->stage != ARMED;
+}
+
+double
+jobtimeout_remaining(const struct jobtimeout *t)
+{
+    struct itimerspec its;
+    if (t->stage == KILLED || t->reaped || timerfd_gettime(t->fd, &its) < 0)
+        return -1;
+    return its.it_value.tv_sec + its.it_value.tv_nsec / 1e9;
+}
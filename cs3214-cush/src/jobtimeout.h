@@ -0,0 +1,44 @@
+#ifndef __JOBTIMEOUT_H
+#define __JOBTIMEOUT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Deadlines of jobs started with the timeout prefix.
+ *
+ * Each deadline is a timerfd in an epoll set that a worker thread waits
+ * on, so a deadline expires while the shell waits for a foreground job
+ * as well as at the prompt.  On expiry the worker sends SIGTERM, and
+ * SIGCONT in case the job is stopped, to the job's process group, and
+ * SIGKILL if it is still there 'kill_after' seconds later.
+ */
+
+#define JOBTIMEOUT_KILL_AFTER   5.0     /* default seconds from TERM to KILL */
+
+struct jobtimeout;
+
+/* Parse a duration such as "10", "1.5s", "2m", "1h" or "1d" into
+ * seconds.  Returns false if 's' is not a duration. */
+bool jobtimeout_parse(const char *s, double *secs);
+
+/* Start a deadline 'secs' from now for process group 'pgid'; a
+ * 'kill_after' of 0 sends no SIGKILL.  Returns NULL if no timer could
+ * be made. */
+struct jobtimeout *jobtimeout_start(pid_t pgid, double secs, double kill_after);
+
+/* Stop and free a deadline. */
+void jobtimeout_cancel(struct jobtimeout *t);
+
+/* Stop a deadline from sending any more signals, because the last
+ * process of its group was reaped and the id may be reused.  The
+ * deadline stays until it is cancelled.  Safe in a signal handler. */
+void jobtimeout_disarm(struct jobtimeout *t);
+
+/* Return true once SIGTERM was sent.  Safe in a signal handler. */
+bool jobtimeout_expired(const struct jobtimeout *t);
+
+/* Return the seconds until the next signal is sent, or a negative
+ * number if none will be */
+double jobtimeout_remaining(const struct jobtimeout *t);
+
+#endif /* __JOBTIMEOUT_H */
@@ -0,0 +1,54 @@
+#!/usr/bin/python
+#
+# limit_test: tests the ulimit and limit commands
+# 
+# Test that shell-wide and per-job resource limits are applied to
+# jobs and that a job killed by a limit is reported
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# set a shell-wide default and read it back
+sendline("ulimit -n 64")
+expect_prompt("Shell did not print expected prompt ")
+sendline("ulimit -n")
+expect("open files\s+\(-n\) 64", "ulimit did not record the limit")
+expect_prompt("Shell did not print expected prompt ")
+
+# jobs inherit the default
+sendline("sh -c \"ulimit -n\"")
+expect("64", "default limit was not applied to the job")
+expect_prompt("Shell did not print expected prompt ")
+
+# a per-job override only applies to that job
+sendline("limit -n 32 sh -c \"ulimit -n\"")
+expect("32", "per-job limit was not applied")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"ulimit -n\"")
+expect("64", "per-job limit leaked into the next job")
+expect_prompt("Shell did not print expected prompt ")
+
+# a job that runs out of cpu time is reported
+sendline("limit -t 1 sh -c \"while :; do :; done\"")
+expect("cpu time limit of 1s exceeded", "cpu time limit was not reported")
+expect_prompt("Shell did not print expected prompt ")
+
+# a job killed before it used its cpu time is not blamed on the limit
+sendline("limit -t 5 sleep 10 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("kill %1")
+expect("killed", "kill was not reported")
+assert "cpu time limit" not in testutil.console.before, "a kill was blamed on the cpu time limit"
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,102 @@
+#!/usr/bin/python
+#
+# loop_test: tests for, while and until loops and the read builtin
+#
+# Test that loops run their bodies in the shell, that a loop left open
+# continues on the next lines, that read splits lines into variables
+# and leaves stdin where it stopped for the commands in the loop, and
+# that break, continue and Ctrl-C end loops
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, os
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("for i in a b c; do echo item-$i; done")
+expect("item-a\r\nitem-b\r\nitem-c\r\n", "for loop did not run its body for each word")
+expect_prompt("Shell did not print expected prompt ")
+
+# the words are expanded once, wildcards and substitutions included
+sendline("for w in $(echo x y); do echo word-$w; done")
+expect("word-x\r\nword-y\r\n", "for loop did not expand its words")
+expect_prompt("Shell did not print expected prompt ")
+
+# a loop left open continues on the next lines
+sendline("n=0")
+expect_prompt("Shell did not print expected prompt ")
+sendline("until test $n = 3")
+expect("> ", "shell did not ask for the rest of the loop")
+sendline("do echo count-$n; n=$(expr $n + 1)")
+expect("> ", "shell did not ask for the rest of the loop")
+sendline("done")
+expect("count-0\r\ncount-1\r\ncount-2\r\n", "until loop did not run until its condition held")
+expect_prompt("Shell did not print expected prompt ")
+
+# read splits at blanks, the last name gets the rest of the line
+data = "/tmp/loop_test_%d" % os.getpid()
+f = open(data, "w")
+f.write("1 one\n2 two words\n3 three\n4 four\n")
+f.close()
+sendline("while read num rest; do echo \"[$num|$rest]\"; done < " + data)
+expect("\\[1\\|one\\]\r\n\\[2\\|two words\\]\r\n\\[3\\|three\\]\r\n\\[4\\|four\\]\r\n",
+       "while read loop did not read the lines")
+expect_prompt("Shell did not print expected prompt ")
+
+# a command in the loop reads on where read stopped
+sendline("while read l; do echo read-$l; head -n 1; done < " + data)
+expect("read-1 one\r\n2 two words\r\nread-3 three\r\n4 four\r\n",
+       "commands in the loop did not get the rest of stdin")
+expect_prompt("Shell did not print expected prompt ")
+
+# here-documents in a loop are read right after the line they start on
+sendline("for i in 1 2; do")
+expect("> ")
+sendline("cat <<END")
+expect("> ")
+sendline("in-here-$i")
+expect("> ")
+sendline("END")
+expect("> ")
+sendline("done")
+expect("in-here-1\r\nin-here-2\r\n", "here-document in a loop was not read")
+expect_prompt("Shell did not print expected prompt ")
+
+# break and continue, also of outer loops
+sendline("for i in 1 2 3; do for j in a b; do test $j = b && continue 2; echo $i$j; done; echo never; done")
+expect("1a\r\n2a\r\n3a\r\n", "continue 2 did not go on with the outer loop")
+expect_prompt("Shell did not print expected prompt ")
+assert "never" not in testutil.console.before, "continue 2 ran the rest of the outer body"
+sendline("while true; do echo once; break; done; echo after-$?")
+expect("once\r\nafter-0\r\n", "break did not leave the loop")
+expect_prompt("Shell did not print expected prompt ")
+
+# Ctrl-C ends a loop, whether the shell or a job gets it
+sendline("while true; do sleep 1; done")
+time.sleep(0.5)
+sendcontrol("c")
+expect_prompt("Ctrl-C did not stop a loop running a job")
+sendline("while x=1; do y=2; done")
+time.sleep(0.5)
+sendcontrol("c")
+expect_prompt("Ctrl-C did not stop a loop in the shell")
+sendline("echo status-$?")
+expect("status-130\r\n", "interrupted loop did not set the status")
+expect_prompt("Shell did not print expected prompt ")
+
+# loops take here-strings too, read fails at the end of the input
+sendline("while read a; do echo got-$a; done <<< last; echo loop-$?")
+expect("got-last\r\nloop-0\r\n", "loop did not read a here-string")
+expect_prompt("Shell did not print expected prompt ")
+
+os.remove(data)
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,44 @@
+#!/usr/bin/python
+#
+# notify_test: tests Done notifications of background jobs
+# 
+# Test that background jobs that finish are reported once, together,
+# whether they finish while the shell waits for input or while a
+# foreground job runs
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a job that finishes while the shell waits for input
+sendline("sleep 0.5 &")
+expect_prompt("Shell did not print expected prompt ")
+expect("\\[1\\]    Done\t\tsleep 0\\.5", "Done was not printed while waiting for input")
+expect_prompt("Shell did not redraw the prompt after Done")
+
+# two jobs that finish while a foreground job runs are reported together
+sendline("sleep 0.3 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sleep 0.3 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sleep 1")
+expect("\\[1\\]    Done\t\tsleep 0\\.3\r\n\\[2\\]    Done\t\tsleep 0\\.3\r\n", "Done notices were not coalesced")
+expect_prompt("Shell did not print expected prompt ")
+
+# finished jobs are gone from the job list
+sendline("jobs")
+expect_prompt("Shell did not print expected prompt ")
+assert "Done" not in testutil.console.before and "sleep" not in testutil.console.before, \
+    "finished jobs were still listed"
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,43 @@
+#!/usr/bin/python
+#
+# parallel_test: tests the parallel command
+# 
+# Test that parallel runs every task, groups the output of each task
+# and reports failures
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, testutil
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# run three tasks two at a time, each printing two lines
+sendline("parallel -j 2 sh -c \"echo start {}; sleep 0.2; echo end {}\" ::: a b c")
+
+# the two lines of each task must not be interleaved with other tasks
+for i in range(3):
+    task = expect_regex("start (\w)\r\n")[0]
+    expect("end " + task + "\r\n", "output of task " + task + " was not grouped")
+
+expect("parallel: 3 tasks, 0 failed", "summary not displayed")
+expect_prompt("Shell did not print expected prompt ")
+
+# a failing task is reported and counted
+sendline("parallel false ::: x")
+expect("parallel: 'x' failed with status 1", "failed task not reported")
+expect("parallel: 1 tasks, 1 failed", "failure not counted")
+expect_prompt("Shell did not print expected prompt ")
+
+# finished tasks do not remain in the jobs list
+run_builtin('jobs')
+expect_prompt("Shell did not print expected prompt ")
+assert not "Running" in testutil.console.before, "tasks remained in the jobs list"
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
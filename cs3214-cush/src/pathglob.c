@@ -0,0 +1,529 @@
+/*
+ * Pathname expansion of *, ? and [...] wildcards.
+ *
+ * Each path component that contains wildcards is compiled into a small
+ * array of match operations, which is run against the names of the
+ * directory with a single backtracking point per '*', so matching is
+ * never exponential.  Directories are read in bulk with getdents64 and
+ * their listings cached by device and inode number.  A cached listing
+ * is reused as long as the directory's mtime is unchanged, which makes
+ * repeated globs over large directories cost one stat() each.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "pathglob.h"
+
+/* ------------------------------------------------------------------ */
+/* growable word array */
+
+void
+pathglob_words_init(struct pathglob_words *w)
+{
+    w->capacity = 8;
+    w->count = 0;
+    w->words = malloc(w->capacity * sizeof *w->words);
+    w->words[0] = NULL;
+}
+
+void
+pathglob_words_push(struct pathglob_words *w, char *word)
+{
+    /* keep room for the terminating NULL */
+    if (w->count + 1 == w->capacity) {
+        w->capacity *= 2;
+        w->words = realloc(w->words, w->capacity * sizeof *w->words);
+    }
+    w->words[w->count++] = word;
+    w->words[w->count] = NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* compiled patterns */
+
+enum op_type { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS };
+
+struct pattern_op {
+    enum op_type type;
+    unsigned char c;            /* OP_CHAR */
+    uint8_t set[32];            /* OP_CLASS: bitmap of the accepted bytes */
+};
+
+struct pattern {
+    struct pattern_op *ops;
+    size_t n;
+    size_t min_len;             /* number of non-star ops */
+    bool leading_dot;           /* pattern explicitly starts with '.' */
+};
+
+/* Parse a bracket expression starting after '['.  Returns a pointer
+ * past the closing ']', or NULL if there is none. */
+static const char *
+compile_class(const char *p, const char *end, struct pattern_op *op)
+{
+    bool negate = false;
+    uint8_t set[32];
+
+    memset(set, 0, sizeof set);
+    if (p < end && (*p == '!' || *p == '^')) {
+        negate = true;
+        p++;
+    }
+    /* a ']' right at the start is a member */
+    bool first = true;
+    while (p < end && (*p != ']' || first)) {
+        unsigned char lo = *p++;
+        if (lo == '\\' && p < end)
+            lo = *p++;
+        unsigned char hi = lo;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            hi = p[1];
+            p += 2;
+            if (hi == '\\' && p < end)
+                hi = *p++;
+        }
+        for (unsigned c = lo; c <= hi; c++)
+            set[c >> 3] |= 1 << (c & 7);
+        first = false;
+    }
+    if (p == end)
+        return NULL;
+
+    op->type = OP_CLASS;
+    for (int i = 0; i < 32; i++)
+        op->set[i] = negate ? ~set[i] : set[i];
+    /* '/' never matches inside a component */
+    op->set['/' >> 3] &= ~(1 << ('/' & 7));
+    return p + 1;
+}
+
+/* Compile the component [p, end) of a glob pattern */
+static void
+compile(const char *p, const char *end, struct pattern *pat)
+{
+    pat->ops = malloc((end - p + 1) * sizeof *pat->ops);
+    pat->n = 0;
+    pat->min_len = 0;
+    pat->leading_dot = p < end && *p == '.';
+
+    while (p < end) {
+        struct pattern_op *op = &pat->ops[pat->n];
+        const char *next;
+
+        if (*p == '*') {
+            p++;
+            /* collapse runs of stars */
+            if (pat->n > 0 && op[-1].type == OP_STAR)
+                continue;
+            op->type = OP_STAR;
+            pat->n++;
+            continue;
+        }
+        if (*p == '?') {
+            op->type = OP_ANY;
+            p++;
+        } else if (*p == '[' && (next = compile_class(p + 1, end, op)) != NULL) {
+            p = next;
+        } else {
+            if (*p == '\\' && p + 1 < end)
+                p++;
+            op->type = OP_CHAR;
+            op->c = *p++;
+        }
+        pat->n++;
+        pat->min_len++;
+    }
+}
+
+static bool
+op_matches(const struct pattern_op *op, unsigned char c)
+{
+    switch (op->type) {
+    case OP_CHAR:
+        return op->c == c;
+    case OP_ANY:
+        return true;
+    case OP_CLASS:
+        return op->set[c >> 3] & (1 << (c & 7));
+    default:
+        return false;
+    }
+}
+
+/* Match 'name' against 'pat'.  On a mismatch the scan resumes after the
+ * most recent star with the name advanced by one character, which is
+ * sufficient because a later star can absorb anything an earlier one
+ * could. */
+static bool
+match(const struct pattern *pat, const char *name, size_t len)
+{
+    if (len < pat->min_len)
+        return false;
+    /* hidden files only match a pattern that starts with a dot */
+    if (name[0] == '.' && !pat->leading_dot)
+        return false;
+
+    size_t pi = 0, si = 0;
+    size_t star_pi = 0, star_si = 0;
+    bool have_star = false;
+
+    while (si < len) {
+        if (pi < pat->n) {
+            const struct pattern_op *op = &pat->ops[pi];
+            if (op->type == OP_STAR) {
+                have_star = true;
+                star_pi = ++pi;
+                star_si = si;
+                continue;
+            }
+            if (op_matches(op, name[si])) {
+                pi++;
+                si++;
+                continue;
+            }
+        }
+        if (!have_star)
+            return false;
+        pi = star_pi;
+        si = ++star_si;
+    }
+    while (pi < pat->n && pat->ops[pi].type == OP_STAR)
+        pi++;
+    return pi == pat->n;
+}
+
+/* ------------------------------------------------------------------ */
+/* directory listing cache */
+
+#define CACHE_DIRS 64
+
+struct dir_listing {
+    bool valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *names;                /* NUL separated names */
+    uint32_t *offsets;          /* offset of each name in 'names' */
+    unsigned char *types;       /* d_type of each entry */
+    size_t count;
+    unsigned long last_used;
+};
+
+static struct dir_listing cache[CACHE_DIRS];
+static unsigned long use_clock;
+static unsigned long cache_hits, cache_misses;
+
+/* see getdents64(2) */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static void
+listing_free(struct dir_listing *l)
+{
+    free(l->names);
+    free(l->offsets);
+    free(l->types);
+    memset(l, 0, sizeof *l);
+}
+
+/* Read all entries of the directory open at 'fd' into 'l' */
+static bool
+read_listing(int fd, struct dir_listing *l)
+{
+    size_t names_cap = 4096, names_len = 0, cap = 64;
+    char buf[64 * 1024];
+
+    l->names = malloc(names_cap);
+    l->offsets = malloc(cap * sizeof *l->offsets);
+    l->types = malloc(cap);
+    l->count = 0;
+
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof buf);
+        if (n < 0) {
+            listing_free(l);
+            return false;
+        }
+        if (n == 0)
+            break;
+
+        for (long pos = 0; pos < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (buf + pos);
+            pos += d->d_reclen;
+            if (d->d_name[0] == '.' && (d->d_name[1] == '\0'
+                || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+                continue;
+
+            size_t len = strlen(d->d_name) + 1;
+            if (names_len + len > names_cap) {
+                while (names_len + len > names_cap)
+                    names_cap *= 2;
+                l->names = realloc(l->names, names_cap);
+            }
+            if (l->count == cap) {
+                cap *= 2;
+                l->offsets = realloc(l->offsets, cap * sizeof *l->offsets);
+                l->types = realloc(l->types, cap);
+            }
+            memcpy(l->names + names_len, d->d_name, len);
+            l->offsets[l->count] = names_len;
+            l->types[l->count] = d->d_type;
+            l->count++;
+            names_len += len;
+        }
+    }
+    return true;
+}
+
+/* Return the listing of directory 'path', from the cache if it is
+ * still current, or NULL if it cannot be read. */
+static struct dir_listing *
+get_listing(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+        return NULL;
+
+    struct dir_listing *victim = &cache[0];
+    for (int i = 0; i < CACHE_DIRS; i++) {
+        struct dir_listing *l = &cache[i];
+        if (l->valid && l->dev == st.st_dev && l->ino == st.st_ino) {
+            if (l->mtime.tv_sec == st.st_mtim.tv_sec && l->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                l->last_used = ++use_clock;
+                cache_hits++;
+                return l;
+            }
+            /* the directory changed, reread it into the same slot */
+            victim = l;
+            break;
+        }
+        if (!l->valid || (victim->valid && l->last_used < victim->last_used))
+            victim = l;
+    }
+
+    cache_misses++;
+    if (victim->names)
+        listing_free(victim);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    bool ok = read_listing(fd, victim);
+    close(fd);
+    if (!ok)
+        return NULL;
+
+    victim->dev = st.st_dev;
+    victim->ino = st.st_ino;
+    victim->mtime = st.st_mtim;
+    victim->last_used = ++use_clock;
+
+    /* Timestamps are taken from a coarse clock, so a directory changed
+     * right after we read it may keep the same mtime.  Only listings
+     * that are older than that granularity can be trusted later. */
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    victim->valid = now.tv_sec > st.st_mtim.tv_sec + 1;
+    return victim;
+}
+
+void
+pathglob_cache_print(void)
+{
+    int dirs = 0;
+    size_t entries = 0;
+    for (int i = 0; i < CACHE_DIRS; i++) {
+        if (cache[i].valid) {
+            dirs++;
+            entries += cache[i].count;
+        }
+    }
+    printf("glob cache: %d directories, %zu entries, %lu hits, %lu misses\n",
+           dirs, entries, cache_hits, cache_misses);
+}
+
+void
+pathglob_cache_clear(void)
+{
+    for (int i = 0; i < CACHE_DIRS; i++)
+        if (cache[i].names)
+            listing_free(&cache[i]);
+}
+
+/* ------------------------------------------------------------------ */
+/* expansion */
+
+static bool
+is_wildcard(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+/* Return true if [p, end) contains an unescaped wildcard */
+static bool
+has_wildcards(const char *p, const char *end)
+{
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end)
+            p++;
+        else if (is_wildcard(*p))
+            return true;
+    }
+    return false;
+}
+
+bool
+pathglob_has_wildcards(const char *word)
+{
+    return has_wildcards(word, word + strlen(word));
+}
+
+/* Append [p, end) to 'path' with the backslashes before wildcards removed */
+static size_t
+append_literal(char *path, size_t len, const char *p, const char *end)
+{
+    for (; p < end && len < PATH_MAX - 1; p++) {
+        if (*p == '\\' && p + 1 < end && is_wildcard(p[1]))
+            p++;
+        path[len++] = *p;
+    }
+    path[len] = '\0';
+    return len;
+}
+
+/* Return a malloc'd copy of 'word' with the backslashes before
+ * wildcards removed */
+static char *
+unescape(const char *word)
+{
+    char *copy = malloc(strlen(word) + 1), *q = copy;
+    for (const char *p = word; *p; p++) {
+        if (*p == '\\' && is_wildcard(p[1]))
+            p++;
+        *q++ = *p;
+    }
+    *q = '\0';
+    return copy;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Expand the components in 'rest' below the directory prefix held in
+ * path[0..len) and append complete matches to 'out' */
+static size_t
+expand(char *path, size_t len, const char *rest, struct pathglob_words *out)
+{
+    /* copy components without wildcards as they are */
+    for (;;) {
+        const char *slash = strchr(rest, '/');
+        const char *end = slash ? slash : rest + strlen(rest);
+        if (has_wildcards(rest, end))
+            break;
+        len = append_literal(path, len, rest, end);
+        if (slash == NULL) {
+            /* the complete path has to exist to count as a match */
+            struct stat st;
+            if (lstat(path, &st) == -1)
+                return 0;
+            pathglob_words_push(out, strdup(path));
+            return 1;
+        }
+        if (len < PATH_MAX - 1)
+            path[len++] = '/';
+        path[len] = '\0';
+        rest = slash + 1;
+    }
+
+    const char *slash = strchr(rest, '/');
+    const char *end = slash ? slash : rest + strlen(rest);
+    struct dir_listing *l = get_listing(len ? path : ".");
+    if (l == NULL)
+        return 0;
+
+    struct pattern pat;
+    compile(rest, end, &pat);
+
+    /* Collect the matches first: recursing may evict this listing */
+    size_t nmatches = 0, cap = 16;
+    char **matches = malloc(cap * sizeof *matches);
+    for (size_t i = 0; i < l->count; i++) {
+        const char *name = l->names + l->offsets[i];
+        if (!match(&pat, name, strlen(name)))
+            continue;
+        /* only directories can have more components below them */
+        if (slash && l->types[i] != DT_DIR && l->types[i] != DT_LNK && l->types[i] != DT_UNKNOWN)
+            continue;
+        if (nmatches == cap) {
+            cap *= 2;
+            matches = realloc(matches, cap * sizeof *matches);
+        }
+        matches[nmatches++] = strdup(name);
+    }
+    free(pat.ops);
+    qsort(matches, nmatches, sizeof *matches, compare_names);
+
+    size_t found = 0;
+    for (size_t i = 0; i < nmatches; i++) {
+        size_t n = strlen(matches[i]);
+        if (len + n + 1 < PATH_MAX) {
+            memcpy(path + len, matches[i], n + 1);
+            if (slash == NULL) {
+                pathglob_words_push(out, strdup(path));
+                found++;
+            } else {
+                path[len + n] = '/';
+                path[len + n + 1] = '\0';
+                found += expand(path, len + n + 1, slash + 1, out);
+            }
+        }
+        free(matches[i]);
+    }
+    free(matches);
+    path[len] = '\0';
+    return found;
+}
+
+size_t
+pathglob_expand(const char *word, struct pathglob_words *out)
+{
+    char path[PATH_MAX];
+    size_t len = 0;
+
+    if (!pathglob_has_wildcards(word)) {
+        pathglob_words_push(out, unescape(word));
+        return 1;
+    }
+
+    const char *rest = word;
+    if (*rest == '/') {
+        path[len++] = '/';
+        rest++;
+    }
+    path[len] = '\0';
+
+    size_t found = expand(path, len, rest, out);
+    if (found == 0) {
+        /* like sh, a pattern without matches is passed on unchanged */
+        pathglob_words_push(out, strdup(word));
+        return 1;
+    }
+    return found;
+}
@@ -0,0 +1,35 @@
+#ifndef __PATHGLOB_H
+#define __PATHGLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A NULL terminated, growable array of malloc'd words, used to build
+ * the argv of a command as words are expanded. */
+struct pathglob_words {
+    char **words;
+    size_t count;
+    size_t capacity;
+};
+
+void pathglob_words_init(struct pathglob_words *w);
+
+/* Append 'word', which the array takes ownership of */
+void pathglob_words_push(struct pathglob_words *w, char *word);
+
+/* Return true if 'word' contains an unescaped *, ? or [ */
+bool pathglob_has_wildcards(const char *word);
+
+/* Expand the wildcards in 'word' and append the matching paths, in
+ * sorted order, to 'out'.  A word without wildcards, or one that does
+ * not match anything, is appended as is with the backslashes before
+ * wildcard characters removed.  Returns the number of words appended. */
+size_t pathglob_expand(const char *word, struct pathglob_words *out);
+
+/* Print the number of cached directories and hit/miss counters */
+void pathglob_cache_print(void);
+
+/* Drop all cached directory listings */
+void pathglob_cache_clear(void);
+
+#endif /* __PATHGLOB_H */
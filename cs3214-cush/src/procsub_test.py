@@ -0,0 +1,54 @@
+#!/usr/bin/python
+#
+# procsub_test: tests process substitution
+# 
+# Test that <(cmd) and >(cmd) are replaced by a /dev/fd path that is
+# connected to a pipeline running as part of the same job
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# read the output of a command as a file
+sendline("cat <(echo procsub-in)")
+expect("procsub-in", "output of <(...) was not read")
+expect_prompt("Shell did not print expected prompt ")
+
+# several substitutions in one command, each with its own pipeline
+sendline("paste <(echo a | tr a b) <(echo c)")
+expect("b\tc", "paste did not read both substitutions")
+expect_prompt("Shell did not print expected prompt ")
+
+# the argument names a /dev/fd path
+sendline("echo <(true)")
+expect("/dev/fd/[0-9]+", "<(...) was not replaced by a /dev/fd path")
+expect_prompt("Shell did not print expected prompt ")
+
+# write to a command through >(...)
+sendline("echo gout | tee >(tr g o) > /dev/null")
+expect("oout", "output written to >(...) did not reach the command")
+expect_prompt("Shell did not print expected prompt ")
+
+# the job lasts until its process substitution is reaped as well
+fd, killer = tempfile.mkstemp()
+os.write(fd, "kill -9 $$\n")
+os.close(fd)
+atexit.register(os.unlink, killer)
+sendline("sh " + killer + " <(sleep 0.5); echo status $?")
+expect("status 137\r\n", "killed command with a process substitution did not end")
+expect_prompt("Shell did not print expected prompt ")
+time.sleep(1)
+sendline("echo alive")
+expect("alive\r\n", "shell did not survive the process substitution")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,229 @@
+/*
+ * Prompt rendering with segments computed in the background.
+ *
+ * The main thread renders from cached values and posts the directory
+ * it is in; the worker thread finds the git branch for that directory
+ * and bumps a generation counter when the branch changed.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "prompt.h"
+#include "utils.h"
+
+#define DEFAULT_PROMPT "cush> "
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static char *request_dir;       /* directory the worker should look at */
+static char branch[256];        /* cached git branch, "" if none */
+static unsigned long generation, rendered_generation;
+static bool worker_running;
+
+static char *buffer;            /* the rendered prompt */
+static size_t buffer_size;
+
+/* Read the first line of 'path' into 'buf' without the newline */
+static bool
+read_line(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "re");
+    if (f == NULL)
+        return false;
+    bool ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    if (ok)
+        buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+/* Find the git branch of directory 'dir' by reading .git/HEAD in it
+ * or its closest ancestor that has one */
+static void
+find_branch(const char *dir, char *out, size_t size)
+{
+    char path[PATH_MAX], head[PATH_MAX + 16], line[PATH_MAX];
+    size_t len = strlen(dir);
+
+    out[0] = '\0';
+    if (len >= sizeof path)
+        return;
+    memcpy(path, dir, len + 1);
+
+    for (;;) {
+        struct stat st;
+        snprintf(head, sizeof head, "%s/.git", len ? path : "");
+        if (stat(head, &st) == 0) {
+            if (S_ISREG(st.st_mode)) {
+                /* a worktree or submodule: "gitdir: <path>" */
+                if (!read_line(head, line, sizeof line) || strncmp(line, "gitdir: ", 8) != 0)
+                    return;
+                if (line[8] == '/')
+                    snprintf(head, sizeof head, "%s/HEAD", line + 8);
+                else
+                    snprintf(head, sizeof head, "%s/%s/HEAD", len ? path : "", line + 8);
+            } else {
+                strncat(head, "/HEAD", sizeof head - strlen(head) - 1);
+            }
+            if (!read_line(head, line, sizeof line))
+                return;
+            const char *name = line;
+            size_t n = strlen(line);
+            if (strncmp(line, "ref: refs/heads/", 16) == 0) {
+                name += 16;
+                n -= 16;
+            } else if (n > 7) {
+                n = 7;      /* detached HEAD, show the abbreviated hash */
+            }
+            if (n >= size)
+                n = size - 1;
+            memcpy(out, name, n);
+            out[n] = '\0';
+            return;
+        }
+        if (len == 0)
+            return;
+        /* go up one directory */
+        char *slash = strrchr(path, '/');
+        len = slash ? (size_t) (slash - path) : 0;
+        path[len] = '\0';
+    }
+}
+
+/* Body of the worker thread */
+static void *
+worker(void *arg)
+{
+    (void) arg;
+    char found[sizeof branch];
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (request_dir == NULL)
+            pthread_cond_wait(&work, &lock);
+        char *dir = request_dir;
+        request_dir = NULL;
+        pthread_mutex_unlock(&lock);
+
+        find_branch(dir, found, sizeof found);
+        free(dir);
+
+        pthread_mutex_lock(&lock);
+        if (strcmp(found, branch) != 0) {
+            strcpy(branch, found);
+            generation++;
+        }
+    }
+    return NULL;
+}
+
+void
+prompt_start(void)
+{
+    if (utils_start_thread(worker, NULL) == 0)
+        worker_running = true;
+}
+
+/* Append 's' to the prompt buffer at 'len' */
+static void
+append(size_t *len, const char *s, size_t n)
+{
+    if (*len + n + 1 > buffer_size) {
+        while (*len + n + 1 > buffer_size)
+            buffer_size = buffer_size ? buffer_size * 2 : 64;
+        buffer = realloc(buffer, buffer_size);
+    }
+    memcpy(buffer + *len, s, n);
+    *len += n;
+    buffer[*len] = '\0';
+}
+
+const char *
+prompt_render(const char *template, int njobs, int status)
+{
+    size_t len = 0;
+    char cwd[PATH_MAX], num[16];
+
+    if (template == NULL)
+        template = DEFAULT_PROMPT;
+    if (strstr(template, "%w") || strstr(template, "%W") || strstr(template, "%b")) {
+        if (getcwd(cwd, sizeof cwd) == NULL)
+            strcpy(cwd, "?");
+    }
+
+    bool slow = false;
+    append(&len, "", 0);
+    for (const char *p = template; *p; p++) {
+        if (*p != '%' || p[1] == '\0') {
+            append(&len, p, 1);
+            continue;
+        }
+        switch (*++p) {
+        case 'w': {
+            const char *home = getenv("HOME");
+            size_t hlen = home ? strlen(home) : 0;
+            if (hlen > 1 && strncmp(cwd, home, hlen) == 0
+                && (cwd[hlen] == '/' || cwd[hlen] == '\0')) {
+                append(&len, "~", 1);
+                append(&len, cwd + hlen, strlen(cwd + hlen));
+            } else {
+                append(&len, cwd, strlen(cwd));
+            }
+            break;
+        }
+        case 'W': {
+            const char *base = strrchr(cwd, '/');
+            base = base && base[1] ? base + 1 : cwd;
+            append(&len, base, strlen(base));
+            break;
+        }
+        case 'b':
+            slow = true;
+            pthread_mutex_lock(&lock);
+            /* shown as it was last computed, maybe for another directory;
+             * the worker corrects it and the prompt is drawn again */
+            append(&len, branch, strlen(branch));
+            if (worker_running) {
+                free(request_dir);
+                request_dir = strdup(cwd);
+                pthread_cond_signal(&work);
+            }
+            rendered_generation = generation;
+            pthread_mutex_unlock(&lock);
+            break;
+        case 'j':
+            snprintf(num, sizeof num, "%d", njobs);
+            append(&len, num, strlen(num));
+            break;
+        case '?':
+            snprintf(num, sizeof num, "%d", status);
+            append(&len, num, strlen(num));
+            break;
+        default:            /* %% and unknown segments */
+            append(&len, p, 1);
+            break;
+        }
+    }
+    if (!slow) {
+        /* nothing shown can be stale */
+        pthread_mutex_lock(&lock);
+        rendered_generation = generation;
+        pthread_mutex_unlock(&lock);
+    }
+    return buffer;
+}
+
+bool
+prompt_changed(void)
+{
+    pthread_mutex_lock(&lock);
+    bool changed = generation != rendered_generation;
+    pthread_mutex_unlock(&lock);
+    return changed;
+}
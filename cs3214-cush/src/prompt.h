@@ -0,0 +1,32 @@
+#ifndef __PROMPT_H
+#define __PROMPT_H
+
+#include <stdbool.h>
+
+/* Prompt templates.
+ *
+ * A template is text with these segments:
+ *   %w  current directory, with the home directory shown as ~
+ *   %W  last component of the current directory
+ *   %b  git branch of the current directory, empty outside a repository
+ *   %j  number of jobs that have not finished
+ *   %?  exit status of the last foreground job
+ *   %%  a literal %
+ * The git branch is computed on a worker thread and cached, so rendering
+ * never waits for it; prompt_changed() tells when a fresher value is
+ * available and the prompt should be drawn again.
+ */
+
+/* Start the worker thread */
+void prompt_start(void);
+
+/* Render 'template', or the default prompt if it is NULL, with 'njobs'
+ * and 'status' for %j and %?.  Slow segments use their cached value and
+ * are refreshed in the background.  Returns a buffer owned by this
+ * module that stays valid until the next call. */
+const char *prompt_render(const char *template, int njobs, int status);
+
+/* Return true if a slow segment changed since the last prompt_render */
+bool prompt_changed(void);
+
+#endif /* __PROMPT_H */
@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# prompt_test: tests prompt templates
+# 
+# Test that the segments of the PS1 template are filled in, including
+# the git branch, which is computed in the background and redrawn
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutil import *
+
+# a directory that looks like a git repository
+repo = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, repo)
+os.makedirs(os.path.join(repo, ".git"))
+f = open(os.path.join(repo, ".git", "HEAD"), "w")
+f.write("ref: refs/heads/prompt-branch\n")
+f.close()
+os.makedirs(os.path.join(repo, "sub"))
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("cd " + repo + "/sub")
+expect_prompt("Shell did not print expected prompt ")
+
+# job count, status, directory and branch
+sendline("\"PS1=%j:%?:%W:%b> \"")
+expect("0:0:sub:prompt-branch> ", "prompt segments were not filled in")
+sendline("false")
+expect("0:1:sub:prompt-branch> ", "exit status was not shown")
+sendline("sleep 30 &")
+expect("1:0:sub:prompt-branch> ", "job count was not shown")
+
+# switching branches is picked up
+f = open(os.path.join(repo, ".git", "HEAD"), "w")
+f.write("ref: refs/heads/other-branch\n")
+f.close()
+sendline("")
+expect(":other-branch> ", "changed branch was not shown")
+
+# back to the default prompt
+sendline("unset PS1")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Times a "while read" loop over a file of a million lines, read from a
+# regular file and from a pipe, in cush and, for comparison, in bash.
+#
+# Usage: ./read_bench.sh [cush binary] [lines]
+#
+CUSH=$(realpath "${1:-./cush}")
+LINES=${2:-1000000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+export CUSH_CACHE_DIR="$DIR/cache"
+
+seq "$LINES" | sed 's/$/ some words after the number/' > "$DIR/input.txt"
+mkfifo "$DIR/fifo"
+
+# the loop leaves the last number in n
+cat > "$DIR/file.sh" <<SCRIPT
+while read n rest; do last=\$n; done < $DIR/input.txt
+echo \$last
+SCRIPT
+cat > "$DIR/pipe.sh" <<SCRIPT
+cat $DIR/input.txt > $DIR/fifo &
+while read n rest; do last=\$n; done < $DIR/fifo
+echo \$last
+SCRIPT
+
+# seconds for one run of 'shell script', checking the result
+measure() {
+    local start end out
+    start=$(date +%s%N)
+    out=$("$1" "$2" | tail -n 1)
+    end=$(date +%s%N)
+    [ "$out" = "$LINES" ] || { echo "$1 $2: wrong result '$out'" >&2; exit 1; }
+    awk "BEGIN { printf \"%.2f\", ($end - $start) / 1000000000 }"
+}
+
+printf "%-6s %10s %10s\n" "input" "cush s" "bash s"
+for input in file pipe; do
+    printf "%-6s %10s %10s\n" $input "$(measure "$CUSH" "$DIR/$input.sh")" \
+        "$(measure bash "$DIR/$input.sh")"
+done
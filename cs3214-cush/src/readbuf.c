@@ -0,0 +1,208 @@
+/*
+ * Line input with per-file descriptor lookahead, see readbuf.h.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "readbuf.h"
+
+#define READBUF_BLOCK   (64 * 1024)     /* size of a block read ahead */
+#define READBUF_MAXFD   256             /* higher descriptors are not read */
+
+enum readbuf_mode {
+    MODE_NONE,                  /* not known yet, or released */
+    MODE_SEEK,                  /* read ahead, seek back on release */
+    MODE_PEEK,                  /* peek, consume what was used */
+    MODE_BYTE,                  /* read one byte at a time */
+};
+
+struct readbuf {
+    enum readbuf_mode mode;
+    bool socket;                /* MODE_PEEK: peek with recv, not tee */
+    char *data;                 /* READBUF_BLOCK bytes */
+    size_t start, end;          /* the bytes of 'data' not returned yet */
+    size_t taken;               /* MODE_PEEK: bytes returned that are
+                                   still in the file */
+    int peek[2];                /* MODE_PEEK on a pipe: tee copies into
+                                   this pipe, since it cannot copy to memory */
+};
+
+static struct readbuf *buffers[READBUF_MAXFD];
+static int highest = -1;        /* the highest fd with a buffer */
+
+static struct readbuf *
+get_buffer(int fd)
+{
+    if (fd < 0 || fd >= READBUF_MAXFD) {
+        errno = EBADF;
+        return NULL;
+    }
+    if (buffers[fd] == NULL) {
+        struct readbuf *rb = calloc(1, sizeof *rb);
+        rb->data = malloc(READBUF_BLOCK);
+        rb->peek[0] = rb->peek[1] = -1;
+        buffers[fd] = rb;
+        if (fd > highest)
+            highest = fd;
+    }
+    return buffers[fd];
+}
+
+/* Decide how 'fd' is read from */
+static void
+classify(int fd, struct readbuf *rb)
+{
+    struct stat st;
+
+    rb->mode = MODE_BYTE;
+    if (fstat(fd, &st) < 0)
+        return;
+
+    if (S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) >= 0) {
+        rb->mode = MODE_SEEK;
+    } else if (S_ISFIFO(st.st_mode)) {
+        if (rb->peek[0] == -1 && pipe2(rb->peek, O_CLOEXEC) < 0) {
+            rb->peek[0] = rb->peek[1] = -1;
+            return;
+        }
+        rb->mode = MODE_PEEK;
+        rb->socket = false;
+    } else if (S_ISSOCK(st.st_mode)) {
+        rb->mode = MODE_PEEK;
+        rb->socket = true;
+    }
+}
+
+/* Remove the bytes that were returned from the front of a pipe or socket.
+ * They are there, so this does not block. */
+static void
+consume_taken(int fd, struct readbuf *rb)
+{
+    while (rb->taken > 0) {
+        ssize_t n = read(fd, rb->data, rb->taken);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        rb->taken -= n;
+    }
+    rb->taken = 0;
+}
+
+/* Copy the front of a pipe or socket into 'data' without consuming it.
+ * Blocks until there is some input. */
+static ssize_t
+peek_block(int fd, struct readbuf *rb)
+{
+    if (rb->socket)
+        return recv(fd, rb->data, READBUF_BLOCK, MSG_PEEK);
+
+    ssize_t n = tee(fd, rb->peek[1], READBUF_BLOCK, 0);
+    for (ssize_t got = 0; got < n;) {
+        ssize_t m = read(rb->peek[0], rb->data + got, n - got);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0)
+            return -1;
+        got += m;
+    }
+    return n;
+}
+
+/* Read the next block of 'fd' into an empty buffer.  Returns the number
+ * of bytes, 0 at the end of input or -1 on an error, including EINTR */
+static ssize_t
+fill(int fd, struct readbuf *rb)
+{
+    ssize_t n = -1;
+
+    rb->start = rb->end = 0;
+    if (rb->mode == MODE_PEEK) {
+        consume_taken(fd, rb);
+        n = peek_block(fd, rb);
+        /* some files, such as pipes opened non-blocking, cannot be teed */
+        if (n < 0 && errno == EINVAL)
+            rb->mode = MODE_BYTE;
+    }
+    if (rb->mode == MODE_SEEK)
+        n = read(fd, rb->data, READBUF_BLOCK);
+    else if (rb->mode == MODE_BYTE)
+        n = read(fd, rb->data, 1);
+
+    if (n > 0)
+        rb->end = n;
+    return n;
+}
+
+char *
+readbuf_getline(int fd, bool *complete)
+{
+    struct readbuf *rb = get_buffer(fd);
+
+    *complete = false;
+    if (rb == NULL)
+        return NULL;
+    if (rb->mode == MODE_NONE)
+        classify(fd, rb);
+
+    size_t len = 0, cap = 128;
+    char *line = malloc(cap);
+    while (!*complete) {
+        if (rb->start == rb->end && fill(fd, rb) <= 0)
+            break;
+
+        char *p = rb->data + rb->start;
+        char *nl = memchr(p, '\n', rb->end - rb->start);
+        size_t n = nl ? (size_t) (nl - p) : rb->end - rb->start;
+        if (len + n + 1 > cap) {
+            cap = 2 * (len + n + 1);
+            line = realloc(line, cap);
+        }
+        memcpy(line + len, p, n);
+        len += n;
+
+        /* the newline is used up too */
+        n += nl != NULL;
+        rb->start += n;
+        if (rb->mode == MODE_PEEK)
+            rb->taken += n;
+        *complete = nl != NULL;
+    }
+
+    if (!*complete && len == 0) {
+        free(line);
+        return NULL;
+    }
+    line[len] = '\0';
+    return line;
+}
+
+void
+readbuf_release(int fd)
+{
+    if (fd < 0 || fd > highest || buffers[fd] == NULL)
+        return;
+
+    struct readbuf *rb = buffers[fd];
+    if (rb->mode == MODE_SEEK && rb->end > rb->start)
+        lseek(fd, -(off_t) (rb->end - rb->start), SEEK_CUR);
+    else if (rb->mode == MODE_PEEK)
+        consume_taken(fd, rb);
+
+    /* the descriptor may refer to another file next time */
+    rb->start = rb->end = rb->taken = 0;
+    rb->mode = MODE_NONE;
+}
+
+void
+readbuf_release_all(void)
+{
+    for (int fd = 0; fd <= highest; fd++)
+        readbuf_release(fd);
+}
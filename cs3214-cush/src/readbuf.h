@@ -0,0 +1,36 @@
+#ifndef __READBUF_H
+#define __READBUF_H
+
+#include <stdbool.h>
+
+/* Line input for the read builtin.
+ *
+ * Each file descriptor read from gets a lookahead buffer that is filled
+ * a block at a time, so reading a line costs a memchr rather than a
+ * system call per byte.  The bytes the shell has read ahead must not be
+ * lost to the commands it starts, so how a block is read depends on
+ * the file:
+ *
+ *   regular files  are read ahead, and readbuf_release seeks back over
+ *                  the bytes that were not used
+ *   pipes, sockets are only peeked at (tee(2), MSG_PEEK); the bytes that
+ *                  were used are consumed when the next block is read
+ *                  or by readbuf_release, the rest stay in the pipe
+ *   anything else  such as terminals is read one byte at a time
+ */
+
+/* Read a line from 'fd'.  Returns it as a malloc'd string without the
+ * newline, or NULL at the end of input or on an error if nothing was
+ * read.  '*complete' is set to false if the input ended before a
+ * newline was seen. */
+char *readbuf_getline(int fd, bool *complete);
+
+/* Hand what was read ahead on 'fd' back to the file, so that its offset
+ * is where the last line ended.  Must be called before 'fd' is pointed
+ * elsewhere with dup2 or closed. */
+void readbuf_release(int fd);
+
+/* readbuf_release every file descriptor, as before a fork */
+void readbuf_release_all(void);
+
+#endif /* __READBUF_H */
@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# sched_test: tests the sched command
+# 
+# Test that sched sets the nice value of a job at launch, changes it
+# for a running job and applies the background policy
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# start a job with a nice value given as a prefix
+sendline("sched -n 5 sleep 30 &")
+bg = parse_bg_status()
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("sched %" + bg.job_id)
+expect("nice 5", "prefix nice value was not applied")
+expect_prompt("Shell did not print expected prompt ")
+
+# change the nice value of the running job
+sendline("sched -n 7 %" + bg.job_id)
+expect_prompt("Shell did not print expected prompt ")
+sendline("sched %" + bg.job_id)
+expect("nice 7", "nice value of running job was not changed")
+expect_prompt("Shell did not print expected prompt ")
+
+# with the background policy, background jobs are lowered automatically
+sendline("sched -b 12")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sleep 30 &")
+bg2 = parse_bg_status()
+expect_prompt("Shell did not print expected prompt ")
+sendline("sched %" + bg2.job_id)
+expect("nice 12", "background policy was not applied")
+expect_prompt("Shell did not print expected prompt ")
+
+# invalid options are rejected
+sendline("sched -n 99 sleep 1")
+expect("invalid nice value", "invalid nice value was accepted")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
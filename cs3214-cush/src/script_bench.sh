@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Compares the startup of cush on a 5000-line script with a cold and with
+# a warm compiled script cache.  Cold runs parse the script and write the
+# cache entry, warm runs only map it.  cush -n is used so that only the
+# startup is measured, not the commands.
+#
+# Usage: ./script_bench.sh [cush binary] [runs]
+#
+CUSH=$(realpath "${1:-./cush}")
+RUNS=${2:-20}
+LINES=5000
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+export CUSH_CACHE_DIR="$DIR/cache"
+
+# a mix of the constructs the parser handles
+for ((i = 0; i < LINES / 5; i++)); do
+    echo "# step $i"
+    echo "echo \"line $i\" | tr a-z A-Z >> $DIR/out.txt"
+    echo "test -d /tmp && x$i=\$(basename /tmp/dir$i) || echo missing"
+    echo "sort <(ls /tmp) >(wc -l) >& /dev/null; cat < /etc/hostname &"
+    echo "grep -c x <<< \"\$x$i\" |& tail -n 1"
+done > "$DIR/script.sh"
+
+# average milliseconds per run of "cush -n script"
+measure() {
+    local start end
+    start=$(date +%s%N)
+    for ((r = 0; r < RUNS; r++)); do
+        [ "$1" = cold ] && rm -rf "$CUSH_CACHE_DIR"
+        "$CUSH" -n "$DIR/script.sh" || exit 1
+    done
+    end=$(date +%s%N)
+    awk "BEGIN { printf \"%.2f\", ($end - $start) / $RUNS / 1000000 }"
+}
+
+"$CUSH" -n "$DIR/script.sh" || exit 1
+printf "%-6s %10s\n" "cache" "ms/run"
+printf "%-6s %10s\n" "cold" "$(measure cold)"
+printf "%-6s %10s\n" "warm" "$(measure warm)"
+printf "cache entry: %s bytes for %d lines\n" "$(stat -c %s "$CUSH_CACHE_DIR"/*.ast)" $LINES
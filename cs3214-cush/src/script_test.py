@@ -0,0 +1,82 @@
+#!/usr/bin/python
+#
+# script_test: tests running scripts and the compiled script cache
+# 
+# Test that a script given on the command line runs with its arguments,
+# comments, here-documents and functions, that its parsed form is cached and used
+# while the script is unchanged, and that -n only checks the syntax
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutil import *
+import testutil
+
+tmp = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmp)
+script = os.path.join(tmp, "s.sh")
+cache = os.path.join(tmp, "cache")
+
+def write_script(last):
+    f = open(script, "w")
+    f.write("#!/usr/bin/env cush\n"
+            "# greet the arguments\n"
+            "echo hello $1 $2 # comment\n"
+            "cat <<END\n"
+            "body $1\n"
+            "END\n"
+            "false && echo wrong || echo " + last + "\n"
+            "f() { echo in f $1; }\n"
+            "f X\n"
+            "echo after f $1 $# \"$@\"\n"
+            "exit 3\n"
+            "echo not reached\n")
+    f.close()
+
+write_script("first")
+
+console = setup_tests()
+shell = os.path.abspath(testutil.settings_module.shell)
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("export CUSH_CACHE_DIR=" + cache)
+expect_prompt("Shell did not print expected prompt ")
+
+# cold start parses the script and caches it
+sendline(shell + " " + script + " A B; echo status $?")
+expect("hello A B\r\nbody A\r\nfirst\r\nin f X\r\nafter f A 2 A B\r\nstatus 3\r\n", "script did not run")
+expect_prompt("Shell did not print expected prompt ")
+assert len(os.listdir(cache)) == 1, "script was not cached"
+
+# warm start uses the cache and gives the same result
+sendline(shell + " " + script + " C D; echo status $?")
+expect("hello C D\r\nbody C\r\nfirst\r\nin f X\r\nafter f C 2 C D\r\nstatus 3\r\n", "cached script did not run")
+expect_prompt("Shell did not print expected prompt ")
+
+# a changed script is parsed again
+time.sleep(0.01)
+write_script("second")
+sendline(shell + " " + script + " E; echo status $?")
+expect("hello E \r\nbody E\r\nsecond\r\nin f X\r\nafter f E 1 E\r\nstatus 3\r\n", "changed script was not parsed again")
+expect_prompt("Shell did not print expected prompt ")
+
+# -n checks the syntax without running anything
+sendline(shell + " -n " + script + "; echo status $?")
+expect("status 0\r\n", "-n did not check the script")
+expect_prompt("Shell did not print expected prompt ")
+assert "hello" not in testutil.console.before, "-n ran the script"
+
+f = open(script, "w")
+f.write("echo one\nls |\n")
+f.close()
+sendline(shell + " -n " + script + "; echo status $?")
+expect("line 2: syntax error", "syntax error was not reported")
+expect("status 2\r\n", "syntax error did not fail")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
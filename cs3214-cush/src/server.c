@@ -0,0 +1,264 @@
+/*
+ * The command server protocol, see server.h.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/* Fill in the address of 'path'.  Returns false if it is too long. */
+static bool
+make_address(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+int
+server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    if (!make_address(&addr, path)) {
+        perror(path);
+        return -1;
+    }
+
+    /* only a socket is replaced, never a file that happens to be there */
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    /* connecting takes write permission, so bind creates it as 0600;
+     * fchmod does not reach the file of a socket */
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t mask = umask(0177);
+    bool bound = sock >= 0 && bind(sock, (struct sockaddr *) &addr, sizeof addr) == 0;
+    umask(mask);
+    if (!bound || listen(sock, SOMAXCONN) < 0) {
+        perror(path);
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int
+server_accept(int sock)
+{
+    int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0)
+        return -1;
+
+    /* in case the mode of the socket was changed after it was made */
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0
+        || cred.uid != geteuid()) {
+        close(conn);
+        errno = EACCES;
+        return -1;
+    }
+
+    /* the server only reads once poll saw data, so this bounds how long a
+     * partial request holds up the others */
+    struct timeval timeout = { .tv_sec = SERVER_TIMEOUT };
+    if (setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0) {
+        int saved = errno;
+        close(conn);
+        errno = saved;
+        return -1;
+    }
+    return conn;
+}
+
+int
+server_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    if (!make_address(&addr, path))
+        return -1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+    return sock;
+}
+
+/* Send all of 'len' bytes.  MSG_NOSIGNAL: a peer that went away is an
+ * error, not a SIGPIPE. */
+static bool
+send_all(int sock, const void *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Receive all of 'len' bytes.  Returns false at the end of input, or
+ * when the receive timeout of the socket expired. */
+static bool
+recv_all(int sock, void *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(sock, buf, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf = (char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+bool
+server_send_request(int sock, const char *text, const int fds[SERVER_NFDS])
+{
+    uint32_t len = strlen(text);
+    if (len > SERVER_MAXREQUEST) {
+        errno = E2BIG;
+        return false;
+    }
+
+    /* the descriptors travel with the length, the text follows */
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(SERVER_NFDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof control);
+    struct iovec iov = { .iov_base = &len, .iov_len = sizeof len };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf,
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(SERVER_NFDS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, SERVER_NFDS * sizeof(int));
+
+    ssize_t n;
+    do
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return false;
+    return send_all(sock, (char *) &len + n, sizeof len - n)
+           && send_all(sock, text, len);
+}
+
+/* Close the descriptors of a request that is not run */
+static void
+close_fds(int fds[SERVER_NFDS])
+{
+    for (int i = 0; i < SERVER_NFDS; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+char *
+server_recv_request(int conn, int fds[SERVER_NFDS])
+{
+    for (int i = 0; i < SERVER_NFDS; i++)
+        fds[i] = -1;
+
+    uint32_t len;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(SERVER_NFDS * sizeof(int))];
+    } control;
+    struct iovec iov = { .iov_base = &len, .iov_len = sizeof len };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf,
+    };
+
+    ssize_t n;
+    do
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return NULL;
+
+    /* take whatever descriptors came, so that none leak on an error */
+    bool complete = false;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *received = (int *) CMSG_DATA(cmsg);
+        for (size_t i = 0; i < nfds; i++) {
+            if (i < SERVER_NFDS && fds[i] == -1)
+                fds[i] = received[i];
+            else
+                close(received[i]);
+        }
+        complete = nfds == SERVER_NFDS;
+    }
+
+    char *text = NULL;
+    if (!complete || (msg.msg_flags & MSG_CTRUNC)
+        || !recv_all(conn, (char *) &len + n, sizeof len - n)
+        || len > SERVER_MAXREQUEST
+        || (text = malloc(len + 1)) == NULL
+        || !recv_all(conn, text, len)) {
+        free(text);
+        close_fds(fds);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+bool
+server_send_status(int conn, int status)
+{
+    int32_t s = status;
+    return send_all(conn, &s, sizeof s);
+}
+
+bool
+server_recv_status(int sock, int *status)
+{
+    int32_t s;
+    if (!recv_all(sock, &s, sizeof s))
+        return false;
+    *status = s;
+    return true;
+}
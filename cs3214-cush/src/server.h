@@ -0,0 +1,53 @@
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include <stdbool.h>
+
+/* The protocol of the command server, cush --server.
+ *
+ * Clients connect to a Unix domain stream socket.  A request is a 4-byte
+ * length followed by that many bytes of command lines, and carries as
+ * SCM_RIGHTS the client's stdin, stdout, stderr and working directory,
+ * in that order.  The server answers each request with the 4-byte exit
+ * status of its last command line.  A connection may carry any number
+ * of requests, which the server runs one after the other.
+ */
+
+#define SERVER_NFDS         4           /* stdin, stdout, stderr, cwd */
+#define SERVER_MAXREQUEST   (1 << 20)   /* longest request text */
+#define SERVER_TIMEOUT      5           /* seconds a started request may stall */
+
+/* Create a socket listening at 'path', replacing a socket left there by
+ * an earlier server.  Only its owner may connect to it.  Returns it, or
+ * -1 after printing an error. */
+int server_listen(const char *path);
+
+/* Accept a connection on 'sock'.  Peers running as another user are
+ * turned away, and a request that stops arriving midway times out after
+ * SERVER_TIMEOUT seconds.  Returns the connection, or -1 with errno set,
+ * EACCES for a peer that was turned away. */
+int server_accept(int sock);
+
+/* Connect to the server listening at 'path'.  Returns the socket, or -1
+ * with errno set. */
+int server_connect(const char *path);
+
+/* Send the request 'text' with the file descriptors 'fds'.  Returns
+ * false with errno set if the server went away. */
+bool server_send_request(int sock, const char *text, const int fds[SERVER_NFDS]);
+
+/* Receive a request.  Returns its text as a malloc'd string and stores
+ * the file descriptors that came with it, marked close-on-exec, in
+ * 'fds'.  Returns NULL when the client closed the connection or sent a
+ * malformed request, and then holds no descriptors. */
+char *server_recv_request(int conn, int fds[SERVER_NFDS]);
+
+/* Answer a request with 'status'.  Returns false if the client went
+ * away. */
+bool server_send_status(int conn, int status);
+
+/* Receive the answer to a request.  Returns false if the server went
+ * away before it answered. */
+bool server_recv_status(int sock, int *status);
+
+#endif /* __SERVER_H */
@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# Compares running short command lines with "sh -c" and "bash -c" against
+# running them in a cush command server with cushc.  Each run starts one
+# process per command line, as tools that shell out do.
+#
+# Usage: ./server_bench.sh [cush binary] [cushc binary] [runs]
+#
+CUSH=$(realpath "${1:-./cush}")
+CUSHC=$(realpath "${2:-./cushc}")
+RUNS=${3:-1000}
+
+DIR=$(mktemp -d)
+SOCK="$DIR/cush.sock"
+"$CUSH" --server "$SOCK" > /dev/null 2>&1 &
+SERVER=$!
+trap 'kill $SERVER; rm -rf "$DIR"' EXIT
+while [ ! -S "$SOCK" ]; do sleep 0.01; done
+
+# average microseconds per run of 'command line' with "$@" in front
+measure() {
+    local cmdline=$1 start end
+    shift
+    start=$(date +%s%N)
+    for ((r = 0; r < RUNS; r++)); do
+        "$@" "$cmdline" > /dev/null || exit 1
+    done
+    end=$(date +%s%N)
+    awk "BEGIN { printf \"%.1f\", ($end - $start) / $RUNS / 1000 }"
+}
+
+printf "%-28s %10s %10s %10s\n" "command line" "sh -c" "bash -c" "cushc"
+for cmdline in "x=1" "echo hello" "/bin/true" "echo a b | tr a-z A-Z"; do
+    printf "%-28s %10s %10s %10s\n" "$cmdline" \
+        "$(measure "$cmdline" sh -c)" "$(measure "$cmdline" bash -c)" \
+        "$(measure "$cmdline" "$CUSHC" -s "$SOCK" -c)"
+done
+echo "(microseconds per command line)"
@@ -0,0 +1,112 @@
+#!/usr/bin/python
+#
+# server_test: tests the command server, cush --server, and its client cushc
+#
+# Test that command lines sent with cushc run with the client's stdin,
+# stdout and working directory, that their exit status comes back, that
+# what one request defines stays for the next, that exit and syntax
+# errors end a request but not the server, that only the owner may
+# connect and that a stalled request does not hold up the others
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil, socket, stat, struct, ctypes
+from testutil import *
+import testutil
+
+# sends the first 'data' bytes of a request with its 4 descriptors, which
+# python 2 cannot do without sendmsg from libc
+class iovec(ctypes.Structure):
+    _fields_ = [("base", ctypes.c_char_p), ("len", ctypes.c_size_t)]
+class msghdr(ctypes.Structure):
+    _fields_ = [("name", ctypes.c_void_p), ("namelen", ctypes.c_uint),
+                ("iov", ctypes.POINTER(iovec)), ("iovlen", ctypes.c_size_t),
+                ("control", ctypes.c_char_p), ("controllen", ctypes.c_size_t),
+                ("flags", ctypes.c_int)]
+def send_partial(s, data):
+    fd = os.open("/dev/null", os.O_RDWR)
+    control = struct.pack("Lii4i", struct.calcsize("Lii4i"), socket.SOL_SOCKET, 1, fd, fd, fd, fd)
+    iov = iovec(data, len(data))
+    msg = msghdr(None, 0, ctypes.pointer(iov), 1, control, len(control), 0)
+    assert ctypes.CDLL(None).sendmsg(s.fileno(), ctypes.byref(msg), 0) == len(data)
+    os.close(fd)
+
+tmp = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmp)
+sock = os.path.join(tmp, "cush.sock")
+
+console = setup_tests()
+shell = os.path.abspath(testutil.settings_module.shell)
+client = os.path.join(os.path.dirname(shell), "cushc") + " -s " + sock + " -c "
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# start the server as a background job
+sendline(shell + " --server " + sock + " > /dev/null &")
+expect_prompt("Shell did not print expected prompt ")
+for i in range(100):
+    if os.path.exists(sock):
+        break
+    time.sleep(0.05)
+assert os.path.exists(sock), "server did not create its socket"
+assert stat.S_IMODE(os.stat(sock).st_mode) == 0600, "socket is not private to its owner"
+
+# output goes to the client's stdout, the status comes back
+sendline(client + "\"echo hello from server; false\"; echo status $?")
+expect("hello from server\r\nstatus 1\r\n", "request did not run in the server")
+expect_prompt("Shell did not print expected prompt ")
+
+# the request runs in the client's working directory
+sendline("cd " + tmp)
+expect_prompt("Shell did not print expected prompt ")
+sendline(client + "pwd")
+expect(tmp + "\r\n", "request did not run in the client's directory")
+expect_prompt("Shell did not print expected prompt ")
+
+# stdin is the client's, redirections work
+sendline("echo abc | " + client + "\"tr a-z A-Z > up.txt\"; cat up.txt")
+expect("ABC\r\n", "request did not read the client's stdin")
+expect_prompt("Shell did not print expected prompt ")
+
+# variables and functions stay for the next request
+sendline(client + "\"export GREETING=hi; greet() { printenv GREETING; }\"")
+expect_prompt("Shell did not print expected prompt ")
+sendline(client + "greet")
+expect("hi\r\n", "definitions did not stay in the server")
+expect_prompt("Shell did not print expected prompt ")
+
+# exit ends the request with its status, not the server
+sendline(client + "\"exit 7; echo not-run\"; echo status $?")
+expect("status 7\r\n", "exit did not set the status of the request")
+assert "not-run\r\n" not in testutil.console.before, "exit did not end the request"
+expect_prompt("Shell did not print expected prompt ")
+
+# a syntax error fails with status 2
+sendline(client + "\"ls |\"; echo status $?")
+expect("status 2\r\n", "syntax error did not fail the request")
+expect_prompt("Shell did not print expected prompt ")
+
+# the server is still there
+sendline(client + "\"echo still; greet\"")
+expect("still\r\nhi\r\n", "server did not survive exit or an error")
+expect_prompt("Shell did not print expected prompt ")
+
+# a client that sends half a request is dropped after the timeout
+stalled = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+stalled.connect(sock)
+send_partial(stalled, "\x01\x00")
+time.sleep(0.2)
+sendline(client + "\"echo after stall\"")
+assert testutil.console.expect("after stall\r\n", timeout=10) == 0, "a stalled request held up the server"
+expect_prompt("Shell did not print expected prompt ")
+assert stalled.recv(4) == "", "stalled connection was not closed"
+stalled.close()
+
+sendline("kill %1")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -10,8 +10,10 @@
 #include <sys/types.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "shell-ast.h"
+#include "arith.h"
 
 /* Create new command structure.  Takes ownership of argv. */
 struct ast_command * 
@@ -21,9 +23,24 @@ ast_command_create(char ** argv, bool dup_stderr_to_stdout)
 
     cmd->argv = argv;
     cmd->dup_stderr_to_stdout = dup_stderr_to_stdout;
+    list_init(&cmd->procsubs);
+    cmd->arith = NULL;
+    cmd->subst = NULL;
     return cmd;
 }
 
+/* Create a process substitution.  Takes ownership of pipe. */
+struct ast_procsub *
+ast_procsub_create(struct ast_pipeline *pipe, bool is_output)
+{
+    struct ast_procsub *ps = malloc(sizeof *ps);
+
+    ps->pipe = pipe;
+    ps->is_output = is_output;
+    ps->argidx = -1;
+    return ps;
+}
+
 /* Create a new pipeline */
 struct ast_pipeline * ast_pipeline_create(char *iored_input, 
                                           char *iored_output, 
@@ -35,10 +52,70 @@ struct ast_pipeline * ast_pipeline_create(char *iored_input,
     pipe->iored_output = iored_output;
     pipe->iored_input = iored_input;
     pipe->append_to_output = append_to_output;
+    pipe->here_delim = NULL;
+    pipe->here_body = NULL;
     pipe->bg_job = false;
+    pipe->connector = AST_SEQUENCE;
+    pipe->loop = NULL;
+    pipe->func = NULL;
     return pipe;
 }
 
+/* Return a malloc'd copy of a NULL terminated array of words */
+static char **
+copy_words(char **words)
+{
+    int n = 0;
+    while (words[n])
+        n++;
+
+    char **copy = malloc((n + 1) * sizeof *copy);
+    for (int i = 0; i < n; i++)
+        copy[i] = strdup(words[i]);
+    copy[n] = NULL;
+    return copy;
+}
+
+static char *
+copy_string(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+/* Return a deep copy of a pipeline of commands */
+struct ast_pipeline *
+ast_pipeline_copy(struct ast_pipeline *pipe)
+{
+    struct ast_pipeline *copy = ast_pipeline_create(copy_string(pipe->iored_input),
+                                                    copy_string(pipe->iored_output),
+                                                    pipe->append_to_output);
+    copy->here_delim = copy_string(pipe->here_delim);
+    copy->here_body = copy_string(pipe->here_body);
+    copy->bg_job = pipe->bg_job;
+    copy->connector = pipe->connector;
+
+    for (struct list_elem * e = list_begin(&pipe->commands); 
+         e != list_end(&pipe->commands); 
+         e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        struct ast_command *c = ast_command_create(copy_words(cmd->argv),
+                                                   cmd->dup_stderr_to_stdout);
+        c->arith = arith_cache_share(&cmd->arith);
+        c->subst = ast_subst_cache_share(&cmd->subst);
+        for (struct list_elem * f = list_begin(&cmd->procsubs); 
+             f != list_end(&cmd->procsubs); 
+             f = list_next(f)) {
+            struct ast_procsub *ps = list_entry(f, struct ast_procsub, elem);
+            struct ast_procsub *p = ast_procsub_create(ast_pipeline_copy(ps->pipe),
+                                                       ps->is_output);
+            p->argidx = ps->argidx;
+            list_push_back(&c->procsubs, &p->elem);
+        }
+        ast_pipeline_add_command(copy, c);
+    }
+    return copy;
+}
+
 /* Add a new command to this pipeline */
 void
 ast_pipeline_add_command(struct ast_pipeline *pipe, struct ast_command *cmd)
@@ -53,6 +130,7 @@ ast_command_line_create_empty(void)
     struct ast_command_line *cmdline = malloc(sizeof *cmdline);
 
     list_init(&cmdline->pipes);
+    list_init(&cmdline->here_docs);
     return cmdline;
 }
 
@@ -66,6 +144,70 @@ ast_command_line_create(struct ast_pipeline *pipe)
     return cmdline;
 }
 
+/* Create a loop.  Takes ownership of var, words, cond and body. */
+struct ast_loop *
+ast_loop_create(enum ast_loop_kind kind, char *var, char **words,
+                struct ast_command_line *cond, struct ast_command_line *body)
+{
+    struct ast_loop *loop = malloc(sizeof *loop);
+
+    loop->kind = kind;
+    loop->var = var;
+    loop->words = words;
+    loop->cond = cond;
+    loop->body = body;
+    return loop;
+}
+
+/* Create a function definition.  Takes ownership of name and body. */
+struct ast_function *
+ast_function_create(char *name, struct ast_command_line *body)
+{
+    struct ast_function *func = malloc(sizeof *func);
+
+    func->name = name;
+    func->body = body;
+    func->refs = 1;
+    return func;
+}
+
+struct ast_function *
+ast_function_ref(struct ast_function *func)
+{
+    func->refs++;
+    return func;
+}
+
+/* Print the pipelines of a command line that is part of a loop or function */
+static void
+ast_loop_part_print(const char *what, struct ast_command_line *cmdline)
+{
+    printf("  %s:\n", what);
+    for (struct list_elem * e = list_begin (&cmdline->pipes); 
+         e != list_end (&cmdline->pipes); 
+         e = list_next (e)) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+
+        ast_pipeline_print(pipe);
+    }
+}
+
+/* Print ast_loop structure to stdout */
+static void
+ast_loop_print(struct ast_loop *loop)
+{
+    if (loop->kind == AST_FOR) {
+        printf(" Loop over %s in", loop->var);
+        for (char **p = loop->words; *p; p++)
+            printf(" %s", *p);
+        printf("\n");
+    } else {
+        printf(" Loop %s\n", loop->kind == AST_WHILE ? "while" : "until");
+        ast_loop_part_print("condition", loop->cond);
+    }
+    ast_loop_part_print("body", loop->body);
+}
+
 /* Print ast_command structure to stdout */
 void
 ast_command_print(struct ast_command *cmd)
@@ -80,6 +222,16 @@ ast_command_print(struct ast_command *cmd)
 
     if (cmd->dup_stderr_to_stdout)
         printf("  stderr shall also be redirected\n");
+
+    for (struct list_elem * e = list_begin(&cmd->procsubs); 
+         e != list_end(&cmd->procsubs); 
+         e = list_next(e)) {
+        struct ast_procsub *ps = list_entry(e, struct ast_procsub, elem);
+
+        printf("  word %d is the %s of a process substitution\n",
+                ps->argidx, ps->is_output ? "input" : "output");
+        ast_pipeline_print(ps->pipe);
+    }
 }
   
 /* Print ast_pipeline structure to stdout */
@@ -88,7 +240,12 @@ ast_pipeline_print(struct ast_pipeline *pipe)
 {
     int i = 1;
 
-    printf(" Pipeline consists of %ld commands\n", list_size(&pipe->commands));
+    if (pipe->loop)
+        ast_loop_print(pipe->loop);
+    else if (pipe->func)
+        ast_loop_part_print(pipe->func->name, pipe->func->body);
+    else
+        printf(" Pipeline consists of %ld commands\n", list_size(&pipe->commands));
     for (struct list_elem * e = list_begin(&pipe->commands); 
          e != list_end(&pipe->commands); 
          e = list_next(e)) {
@@ -106,6 +263,16 @@ ast_pipeline_print(struct ast_pipeline *pipe)
     if (pipe->iored_input)
         printf("  stdin of the first command reads from %s\n", pipe->iored_input);
 
+    if (pipe->here_delim)
+        printf("  stdin of the first command reads a here-document up to %s\n", pipe->here_delim);
+    else if (pipe->here_body)
+        printf("  stdin of the first command reads a here-string\n");
+
+    if (pipe->connector == AST_AND)
+        printf("  - runs only if the previous pipeline succeeded\n");
+    else if (pipe->connector == AST_OR)
+        printf("  - runs only if the previous pipeline failed\n");
+
     if (pipe->bg_job)
         printf("  - is a background job\n");
     else
@@ -148,9 +315,40 @@ ast_pipeline_free(struct ast_pipeline *pipe)
         e = list_remove(e);
         ast_command_free(cmd);
     }
+    if (pipe->loop)
+        ast_loop_free(pipe->loop);
+    if (pipe->func)
+        ast_function_free(pipe->func);
+    free(pipe->here_delim);
+    free(pipe->here_body);
     free(pipe);
 }
 
+void 
+ast_loop_free(struct ast_loop * loop)
+{
+    free(loop->var);
+    if (loop->words) {
+        for (char **p = loop->words; *p; p++)
+            free(*p);
+        free(loop->words);
+    }
+    if (loop->cond)
+        ast_command_line_free(loop->cond);
+    ast_command_line_free(loop->body);
+    free(loop);
+}
+
+void 
+ast_function_free(struct ast_function * func)
+{
+    if (--func->refs > 0)
+        return;
+    free(func->name);
+    ast_command_line_free(func->body);
+    free(func);
+}
+
 void 
 ast_command_free(struct ast_command * cmd)
 {
@@ -159,5 +357,86 @@ ast_command_free(struct ast_command * cmd)
         free(*p++);
     }
     free(cmd->argv);
+    for (struct list_elem * e = list_begin(&cmd->procsubs); e != list_end(&cmd->procsubs); ) {
+        struct ast_procsub *ps = list_entry(e, struct ast_procsub, elem);
+        e = list_remove(e);
+        ast_procsub_free(ps);
+    }
+    arith_cache_release(cmd->arith);
+    ast_subst_cache_release(cmd->subst);
     free(cmd);
 }
+
+/* The parsed $(...) command lines of a command, looked up by their text.
+ * A command has few of them, so the lookup is a linear scan. */
+struct ast_subst_cache {
+    struct subst_entry {
+        char *text;
+        size_t len;
+        struct ast_command_line *cline;
+    } *entries;
+    size_t n, cap;
+    int refs;
+};
+
+/* '*cache', created with one reference if it does not exist yet */
+static struct ast_subst_cache *
+subst_cache_get(struct ast_subst_cache **cache)
+{
+    if (*cache == NULL) {
+        *cache = calloc(1, sizeof **cache);
+        (*cache)->refs = 1;
+    }
+    return *cache;
+}
+
+struct ast_command_line *
+ast_subst_cache_get(struct ast_subst_cache **cache, const char *text, size_t len)
+{
+    struct ast_subst_cache *c = subst_cache_get(cache);
+    for (size_t i = 0; i < c->n; i++) {
+        struct subst_entry *se = &c->entries[i];
+        if (se->len == len && memcmp(se->text, text, len) == 0)
+            return se->cline;
+    }
+
+    char *copy = strndup(text, len);
+    struct ast_command_line *cline = ast_parse_command_line(copy);
+    if (cline == NULL) {
+        free(copy);
+        return NULL;
+    }
+    if (c->n == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 4;
+        c->entries = realloc(c->entries, c->cap * sizeof *c->entries);
+    }
+    c->entries[c->n++] = (struct subst_entry) { copy, len, cline };
+    return cline;
+}
+
+struct ast_subst_cache *
+ast_subst_cache_share(struct ast_subst_cache **cache)
+{
+    subst_cache_get(cache)->refs++;
+    return *cache;
+}
+
+void
+ast_subst_cache_release(struct ast_subst_cache *cache)
+{
+    if (cache == NULL || --cache->refs > 0)
+        return;
+    for (size_t i = 0; i < cache->n; i++) {
+        free(cache->entries[i].text);
+        ast_command_line_free(cache->entries[i].cline);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+void 
+ast_procsub_free(struct ast_procsub * ps)
+{
+    ast_pipeline_free(ps->pipe);
+    free(ps);
+}
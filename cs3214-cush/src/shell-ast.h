@@ -7,14 +7,29 @@
 struct ast_command;
 struct ast_pipeline;
 struct ast_command_line;
+struct ast_procsub;
+struct ast_loop;
+struct ast_function;
+struct arith_cache;
+struct ast_subst_cache;
 
 /* A command line may contain multiple pipelines. */
 struct ast_command_line {
     struct list/* <ast_pipeline> */ pipes;        /* List of pipelines */
+    struct list/* <ast_pipeline> */ here_docs;    /* Pipelines, including those
+                                in process substitutions, whose here-document
+                                body must be read, in the order they appear */
 
     /* Add additional fields here if needed. */
 };
 
+/* How a pipeline is joined to the one before it on the command line. */
+enum ast_connector {
+    AST_SEQUENCE,            /* ';', '&' or first pipeline: always runs */
+    AST_AND,                 /* '&&': runs if the previous status is 0 */
+    AST_OR,                  /* '||': runs if the previous status is not 0 */
+};
+
 /* A pipeline is a list of one or more commands. 
  * For the purposes of job control, a pipeline forms one job.
  */
@@ -25,8 +40,19 @@ struct ast_pipeline {
     char *iored_output;      /* If non-NULL, last command should write to
                                 file 'iored_output' */
     bool append_to_output;   /* True if user typed >> to append */
+    char *here_delim;        /* If non-NULL, the first command reads a
+                                here-document ending at this line */
+    char *here_body;         /* If non-NULL, text the first command reads
+                                from stdin (here-document or here-string) */
     bool bg_job;             /* True if user entered & */
+    enum ast_connector connector; /* Whether this pipeline depends on the
+                                exit status of the previous one */
+    struct ast_loop *loop;   /* If non-NULL, this pipeline has no commands
+                                but is a loop, which the redirections apply to */
+    struct ast_function *func; /* If non-NULL, this pipeline has no commands
+                                but defines a function */
     struct list_elem elem;   /* Link element. */
+    struct list_elem here_elem; /* Link element for ast_command_line.here_docs */
 };
 
 /* A command is part of a pipeline. */
@@ -34,13 +60,59 @@ struct ast_command {
     char **argv;             /* NULL terminated array of pointers to words
                                 making up this command. */
     bool dup_stderr_to_stdout; /* True if stderr should be redirected as well */
+    struct list/* <ast_procsub> */ procsubs;   /* Process substitutions used
+                                as words of this command */
+    struct arith_cache *arith; /* The compiled $((...)) expressions of the
+                                words, shared with copies (see arith.h) */
+    struct ast_subst_cache *subst; /* The parsed $(...) command lines of the
+                                words, shared with copies likewise */
     struct list_elem elem;   /* Link element to link commands in pipeline. */
 };
 
+/* A process substitution <(pipeline) or >(pipeline).
+ * The word at argv[argidx] of the command it belongs to is a placeholder
+ * that is replaced by /dev/fd/N when the command is started. */
+struct ast_procsub {
+    struct ast_pipeline *pipe;  /* The pipeline to run */
+    bool is_output;          /* True for >(...), which the command writes to */
+    int argidx;              /* Index of the placeholder word in argv */
+    struct list_elem elem;   /* Link element for ast_command.procsubs */
+};
+
+/* The kinds of loops. */
+enum ast_loop_kind {
+    AST_FOR,                 /* for var in words; do body; done */
+    AST_WHILE,               /* while cond; do body; done */
+    AST_UNTIL,               /* until cond; do body; done */
+};
+
+/* A loop is run by the shell itself, walking the same tree each time
+ * around.  Its body and condition are command lines of their own. */
+struct ast_loop {
+    enum ast_loop_kind kind;
+    char *var;               /* AST_FOR: the name of the loop variable */
+    char **words;            /* AST_FOR: NULL terminated array of the words
+                                the variable takes, before expansion */
+    struct ast_command_line *cond;  /* AST_WHILE, AST_UNTIL: the condition */
+    struct ast_command_line *body;  /* The commands between do and done */
+};
+
+/* A function definition, name() { body }.  It is shared by the tree it
+ * was parsed in, the function table and the calls that are running it,
+ * and freed when the last of them lets go. */
+struct ast_function {
+    char *name;
+    struct ast_command_line *body;
+    int refs;
+};
+
 /* Create new command structure and initialize it */
 struct ast_command * ast_command_create(char ** argv,
                                         bool dup_stderr_to_stdout);
 
+/* Create a process substitution for 'pipe' */
+struct ast_procsub * ast_procsub_create(struct ast_pipeline *pipe, bool is_output);
+
 /* Create a new pipeline containing only one command */
 struct ast_pipeline * ast_pipeline_create(char *iored_input, 
                                           char *iored_output, 
@@ -55,10 +127,42 @@ struct ast_command_line * ast_command_line_create_empty(void);
 /* Create a command line with a single pipeline */
 struct ast_command_line * ast_command_line_create(struct ast_pipeline *pipe);
 
+/* Create a loop */
+struct ast_loop * ast_loop_create(enum ast_loop_kind kind, char *var, char **words,
+                                  struct ast_command_line *cond,
+                                  struct ast_command_line *body);
+
+/* Create a function definition with one reference */
+struct ast_function * ast_function_create(char *name, struct ast_command_line *body);
+
+/* Take another reference to a function definition */
+struct ast_function * ast_function_ref(struct ast_function *func);
+
+/* Return a deep copy of a pipeline of commands, not a loop.  The copy
+ * shares the compiled expressions of the original. */
+struct ast_pipeline * ast_pipeline_copy(struct ast_pipeline *pipe);
+
+/* Return the command line parsed from the 'len' bytes of 'text', the
+ * inside of a $(...) in a word of a command, taking it from '*cache' or
+ * parsing it and adding it there.  The cache is created on first use and
+ * keeps the command line, which must not be changed or freed.  Returns
+ * NULL if the text does not parse; it is then not cached. */
+struct ast_command_line * ast_subst_cache_get(struct ast_subst_cache **cache,
+                                              const char *text, size_t len);
+
+/* Return '*cache', creating it if needed, with one more reference, for a
+ * copy of the command to share it.  The cache and its command lines are
+ * freed when the last reference is released. */
+struct ast_subst_cache * ast_subst_cache_share(struct ast_subst_cache **cache);
+void ast_subst_cache_release(struct ast_subst_cache *cache);
+
 /* Deallocation functions */
 void ast_command_line_free(struct ast_command_line *);
 void ast_pipeline_free(struct ast_pipeline *);
 void ast_command_free(struct ast_command *);
+void ast_procsub_free(struct ast_procsub *);
+void ast_loop_free(struct ast_loop *);
+void ast_function_free(struct ast_function *);   /* drops a reference */
 
 /* Print functions */
 void ast_command_print(struct ast_command *cmd);
@@ -68,5 +172,15 @@ void ast_command_line_print(struct ast_command_line *line);
 /* Parse a command line.  Implemented in shell-grammar.y */
 struct ast_command_line * ast_parse_command_line(char * line);
 
+/* True if the last ast_parse_command_line failed only because the line
+ * ended inside a loop or function body, so that it may be continued on
+ * the next line. */
+bool ast_parse_incomplete(void);
+
+/* After an incomplete parse, the delimiter of the i-th here-document in
+ * the text so far, or NULL if there are not that many.  Their bodies
+ * must be read before the line is continued. */
+const char * ast_parse_here_delim(size_t i);
+
 /** ----------------------------------------------------------- */
 #endif /* __SHELL_AST_H */
@@ -14,6 +14,7 @@
 %{
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #define YYDEBUG	1
 int yydebug;
 void yyerror(const char *msg);
@@ -26,6 +27,8 @@ int yylex(void);
 #define INVNUL  "Invalid null command."
 #define AMBINP  "Ambiguous input redirect."
 #define AMBOUT  "Ambiguous output redirect."
+#define BADSUB  "Badly formed process substitution."
+#define BGCHAIN "Cannot run a && or || chain in the background."
 
 #include "shell-ast.h"
 #include <obstack.h>
@@ -37,9 +40,12 @@ int yylex(void);
 struct cmd_helper {
     struct obstack words;   /* an obstack of char * to collect argv */
     char *iored_input;
+    char *here_delim;       /* delimiter of a here-document */
+    char *here_body;        /* text of a here-string */
     char *iored_output;
     bool append_to_output;
     bool redirect_stderr;
+    struct list procsubs;   /* process substitutions among the words */
     struct list_elem elem;
 };
 
@@ -68,19 +74,57 @@ init_cmd(char *firstcmd,
 
     cmd->iored_output = iored_output;
     cmd->iored_input = iored_input;
+    cmd->here_delim = NULL;
+    cmd->here_body = NULL;
     cmd->append_to_output = append_to_output;
     cmd->redirect_stderr = include_stderr;
+    list_init(&cmd->procsubs);
     return cmd;
 }
 
+/* Build the placeholder word for a process substitution, e.g. "<(sort a)".
+ * It is what jobs shows; the shell replaces it with /dev/fd/N when
+ * the command is started. */
+static char *
+procsub_word(struct ast_procsub *ps)
+{
+    struct obstack text;
+    obstack_init(&text);
+    obstack_grow(&text, ps->is_output ? ">(" : "<(", 2);
+    for (struct list_elem * e = list_begin(&ps->pipe->commands);
+                            e != list_end(&ps->pipe->commands);
+                            e = list_next(e)) {
+        struct ast_command * cmd = list_entry(e, struct ast_command, elem);
+        if (e != list_begin(&ps->pipe->commands))
+            obstack_grow(&text, " | ", 3);
+        for (char **p = cmd->argv; *p; p++) {
+            if (p != cmd->argv)
+                obstack_1grow(&text, ' ');
+            obstack_grow(&text, *p, strlen(*p));
+        }
+    }
+    obstack_grow0(&text, ")", 1);
+    char *word = strdup(obstack_finish(&text));
+    obstack_free(&text, NULL);
+    return word;
+}
+
 /* print error message */
 static void p_error(char *msg);
 
-/* Convert cmd_helper to ast_command.
- * Ensures NULL-terminated argv[] array
- */
-static struct ast_command * 
-make_ast_command(struct cmd_helper *cmd)
+/* Pipelines with here-documents, in the order they were parsed */
+static struct list here_docs;
+
+/* True if 'cmd' already has some input redirection */
+static bool
+has_input(struct cmd_helper *cmd)
+{
+    return cmd->iored_input || cmd->here_delim || cmd->here_body;
+}
+
+/* Take the words collected in cmd_helper as a NULL-terminated array */
+static char **
+take_words(struct cmd_helper *cmd)
 {
     obstack_ptr_grow(&cmd->words, NULL);
 
@@ -88,13 +132,30 @@ make_ast_command(struct cmd_helper *cmd)
     char **argv = malloc(sz);
     memcpy(argv, obstack_finish(&cmd->words), sz);
     obstack_free(&cmd->words, NULL);
+    return argv;
+}
+
+/* Convert cmd_helper to ast_command.
+ * Ensures NULL-terminated argv[] array
+ */
+static struct ast_command * 
+make_ast_command(struct cmd_helper *cmd)
+{
+    char **argv = take_words(cmd);
 
     if (*argv == NULL) {
         free(argv);
         return NULL; 
     }
 
-    return ast_command_create(argv, cmd->redirect_stderr);
+    struct ast_command * astcmd = ast_command_create(argv, cmd->redirect_stderr);
+    for (struct list_elem * e = list_begin(&cmd->procsubs);
+                            e != list_end(&cmd->procsubs);) {
+        struct ast_procsub * ps = list_entry(e, struct ast_procsub, elem);
+        e = list_remove(e);
+        list_push_back(&astcmd->procsubs, &ps->elem);
+    }
+    return astcmd;
 }
 
 static bool
@@ -111,7 +172,7 @@ add_to_pipeline(struct pipe_helper *pipe,
         last->redirect_stderr = redirect_stderr;
 
         /* Error: 'ls | <x wc' */
-        if (cmd->iored_input) { p_error(AMBINP); return false; }
+        if (has_input(cmd)) { p_error(AMBINP); return false; }
     }
 
     int sz = obstack_object_size(&cmd->words);
@@ -121,6 +182,49 @@ add_to_pipeline(struct pipe_helper *pipe,
     return true;
 }
 
+/* Mark the last pipeline of 'cmdline' as a background job.  A chain
+ * would need a shell process of its own to run in the background, so
+ * 'a && b &' is refused rather than backgrounding b alone. */
+static bool
+background_last(struct ast_command_line *cmdline)
+{
+    /* Error: '&' */
+    if (list_empty(&cmdline->pipes)) { p_error(INVNUL); return false; }
+
+    struct ast_pipeline * last;
+    last = list_entry(list_back(&cmdline->pipes), 
+                      struct ast_pipeline, elem);
+    /* Error: 'a && b &' */
+    if (last->connector != AST_SEQUENCE) { p_error(BGCHAIN); return false; }
+    last->bg_job = true;
+    return true;
+}
+
+/* Check that 'cmdline' can be followed by '&&' or '||' */
+static bool
+can_chain(struct ast_command_line *cmdline)
+{
+    /* Error: '&& ls' */
+    if (list_empty(&cmdline->pipes)) { p_error(INVNUL); return false; }
+
+    struct ast_pipeline * last;
+    last = list_entry(list_back(&cmdline->pipes), 
+                      struct ast_pipeline, elem);
+    /* Error: 'a & && b' */
+    if (last->bg_job) { p_error(BGCHAIN); return false; }
+    return true;
+}
+
+/* Create the pipeline that runs a loop */
+static struct ast_pipeline *
+make_loop(enum ast_loop_kind kind, char *var, char **words,
+          struct ast_command_line *cond, struct ast_command_line *body)
+{
+    struct ast_pipeline * pipe = ast_pipeline_create(NULL, NULL, false);
+    pipe->loop = ast_loop_create(kind, var, words, cond, body);
+    return pipe;
+}
+
 /* Called by parser when command line is complete */
 static void cmdline_complete(struct ast_command_line *);
 
@@ -135,6 +239,7 @@ static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
   struct pipe_helper *pipe;
   struct ast_pipeline *ast_pipe;
   struct ast_command_line *cmdline;
+  struct ast_procsub *procsub;
   char *word;
 }
 
@@ -142,12 +247,18 @@ static void yyunput (int c,char *buf_ptr  ) __attribute__((unused));
 %type <command> input output
 %type <command> command
 %type <pipe> pipeline
-%type <ast_pipe> ast_pipeline
+%type <ast_pipe> ast_pipeline cmd_pipeline loop function
 %type <cmdline> cmd_list
+%type <procsub> procsub
+%type <command> for_words
 
 /* Terminals */
 %token <word> WORD
 %token GREATER_GREATER GREATER_AMPERSAND PIPE_AMPERSAND
+%token LESS_PAREN GREATER_PAREN
+%token LESS_LESS LESS_LESS_LESS
+%token AND_AND OR_OR
+%token FOR WHILE UNTIL DO DONE IN LBRACE RBRACE
 
 %%
 cmd_line: cmd_list { cmdline_complete($1); }
@@ -157,28 +268,49 @@ cmd_list:	/* Null Command */ { $$ = ast_command_line_create_empty(); }
             $$ = ast_command_line_create($1);
         } 
 |		cmd_list ';'
+|		cmd_list '\n'
 |		cmd_list '&' {
+            if (!background_last($1))
+                YYABORT;
             $$ = $1;
-            struct ast_pipeline * last;
-            last = list_entry(list_back(&$1->pipes), 
-                              struct ast_pipeline, elem);
-            last->bg_job = true;
         }
 |		cmd_list ';' ast_pipeline	{ 
             $$ = $1;
             list_push_back(&$$->pipes, &$3->elem);
         }
+|		cmd_list '\n' ast_pipeline	{ 
+            $$ = $1;
+            list_push_back(&$$->pipes, &$3->elem);
+        }
 |		cmd_list '&' ast_pipeline	{ 
-            struct ast_pipeline * last;
-            last = list_entry(list_back(&$1->pipes), 
-                              struct ast_pipeline, elem);
-            last->bg_job = true;
+            if (!background_last($1))
+                YYABORT;
 
             $$ = $1;
             list_push_back(&$$->pipes, &$3->elem);
         }
+|		cmd_list AND_AND ast_pipeline	{ 
+            if (!can_chain($1))
+                YYABORT;
+            $3->connector = AST_AND;
+            $$ = $1;
+            list_push_back(&$$->pipes, &$3->elem);
+        }
+|		cmd_list OR_OR ast_pipeline	{ 
+            if (!can_chain($1))
+                YYABORT;
+            $3->connector = AST_OR;
+            $$ = $1;
+            list_push_back(&$$->pipes, &$3->elem);
+        }
+|		cmd_list AND_AND error	{ p_error(INVNUL); YYABORT; }
+|		cmd_list OR_OR error	{ p_error(INVNUL); YYABORT; }
+
+ast_pipeline: cmd_pipeline
+|		loop
+|		function
 
-ast_pipeline: pipeline {
+cmd_pipeline: pipeline {
             struct pipe_helper * pipe = $1;
             assert (!list_empty(&pipe->commands));
             struct cmd_helper * first;
@@ -191,6 +323,10 @@ ast_pipeline: pipeline {
                 last->iored_output,
                 last->append_to_output
             );
+            $$->here_delim = first->here_delim;
+            $$->here_body = first->here_body;
+            if ($$->here_delim)
+                list_push_back(&here_docs, &$$->here_elem);
             for (struct list_elem * e = list_begin(&pipe->commands);
                                     e != list_end(&pipe->commands);) {
                 struct cmd_helper * cmd = list_entry(e, struct cmd_helper, elem);
@@ -201,6 +337,64 @@ ast_pipeline: pipeline {
             free(pipe);
         }
 
+loop:	FOR WORD IN for_words separator DO cmd_list DONE {
+            /* Error: 'for x in a; do done' */
+            if (list_empty(&$7->pipes)) { p_error(INVNUL); YYABORT; }
+            $$ = make_loop(AST_FOR, $2, take_words($4), NULL, $7);
+            free($4);
+        }
+|		WHILE cmd_list DO cmd_list DONE {
+            /* Error: 'while; do ls; done' */
+            if (list_empty(&$2->pipes) || list_empty(&$4->pipes)) { p_error(INVNUL); YYABORT; }
+            $$ = make_loop(AST_WHILE, NULL, NULL, $2, $4);
+        }
+|		UNTIL cmd_list DO cmd_list DONE {
+            if (list_empty(&$2->pipes) || list_empty(&$4->pipes)) { p_error(INVNUL); YYABORT; }
+            $$ = make_loop(AST_UNTIL, NULL, NULL, $2, $4);
+        }
+|		loop input {
+            obstack_free(&$2->words, NULL);
+            /* Error: ambiguous redirect 'while ...; done <a <b' */
+            if ($1->iored_input || $1->here_delim || $1->here_body) { p_error(AMBINP); YYABORT; }
+            $$ = $1;
+            $$->iored_input = $2->iored_input;
+            $$->here_delim = $2->here_delim;
+            $$->here_body = $2->here_body;
+            /* its body follows those of the here-documents in the loop */
+            if ($$->here_delim)
+                list_push_back(&here_docs, &$$->here_elem);
+            free($2);
+        }
+|		loop '>' WORD {
+            if ($1->iored_output) { p_error(AMBOUT); YYABORT; }
+            $$ = $1;
+            $$->iored_output = $3;
+        }
+|		loop GREATER_GREATER WORD {
+            if ($1->iored_output) { p_error(AMBOUT); YYABORT; }
+            $$ = $1;
+            $$->iored_output = $3;
+            $$->append_to_output = true;
+        }
+
+function: WORD '(' ')' LBRACE cmd_list RBRACE {
+            /* Error: 'f() { }' */
+            if (list_empty(&$5->pipes)) { p_error(INVNUL); YYABORT; }
+            $$ = ast_pipeline_create(NULL, NULL, false);
+            $$->func = ast_function_create($1, $5);
+        }
+
+for_words: /* no words */ {
+            $$ = init_cmd(NULL, NULL, NULL, false, false);
+        }
+|		for_words WORD {
+            $$ = $1;
+            obstack_ptr_grow(&$$->words, $2);
+        }
+
+separator: ';'
+|		'\n'
+
 pipeline: command {
             $$ = init_pipe();
             if (!add_to_pipeline($$, $1, false))
@@ -228,12 +422,20 @@ command:   WORD {
             $$ = $1;
             obstack_ptr_grow(&$$->words, $2);
 		}
+|		command procsub {
+            $$ = $1;
+            $2->argidx = obstack_object_size(&$$->words) / sizeof(char *);
+            obstack_ptr_grow(&$$->words, procsub_word($2));
+            list_push_back(&$$->procsubs, &$2->elem);
+		}
 |		command input {
             obstack_free(&$2->words, NULL);
             /* Error: ambiguous redirect 'a <b <c' */
-            if ($1->iored_input)   { p_error(AMBINP); YYABORT; }
+            if (has_input($1))   { p_error(AMBINP); YYABORT; }
             $$ = $1; 
             $$->iored_input = $2->iored_input;
+            $$->here_delim = $2->here_delim;
+            $$->here_body = $2->here_body;
 		}
 |		command output {
             obstack_free(&$2->words, NULL);
@@ -245,10 +447,32 @@ command:   WORD {
             $$->redirect_stderr = $2->redirect_stderr;
 		}
 
+procsub: LESS_PAREN cmd_pipeline ')' {
+            $$ = ast_procsub_create($2, false);
+        }
+|		GREATER_PAREN cmd_pipeline ')' {
+            $$ = ast_procsub_create($2, true);
+        }
+|		LESS_PAREN error    { p_error(BADSUB); YYABORT; }
+|		GREATER_PAREN error { p_error(BADSUB); YYABORT; }
+
 input:	'<' WORD { 
             $$ = init_cmd(NULL, $2, NULL, false, false);
         }
+|		LESS_LESS WORD {
+            $$ = init_cmd(NULL, NULL, NULL, false, false);
+            $$->here_delim = $2;
+        }
+|		LESS_LESS_LESS WORD {
+            $$ = init_cmd(NULL, NULL, NULL, false, false);
+            /* a here-string is the word followed by a newline */
+            $$->here_body = malloc(strlen($2) + 2);
+            strcpy(stpcpy($$->here_body, $2), "\n");
+            free($2);
+        }
 |		'<' error	  { p_error(MISRED); YYABORT; }
+|		LESS_LESS error	  { p_error(MISRED); YYABORT; }
+|		LESS_LESS_LESS error	  { p_error(MISRED); YYABORT; }
 
 output:	'>' WORD { 
             $$ = init_cmd(NULL, NULL, $2, false, false);
@@ -276,6 +500,10 @@ static char * inputline;    /* currently processed input line */
 static void
 p_error(char *msg) 
 { 
+    /* a line that ends inside a loop or function is not wrong yet */
+    if (yychar == YYEOF && block_depth > 0)
+        return;
+
     /* print error */
     fprintf(stderr, "%s\n", msg); 
 }
@@ -287,9 +515,15 @@ void
 yyerror(const char *msg) { }
 
 static struct ast_command_line * commandline;
+static bool incomplete;     /* see ast_parse_incomplete */
 static void cmdline_complete(struct ast_command_line *cline)
 {
     commandline = cline;
+    for (struct list_elem * e = list_begin(&here_docs); e != list_end(&here_docs);) {
+        struct ast_pipeline * pipe = list_entry(e, struct ast_pipeline, here_elem);
+        e = list_remove(e);
+        list_push_back(&cline->here_docs, &pipe->here_elem);
+    }
 }
 
 /* 
@@ -300,8 +534,36 @@ ast_parse_command_line(char * line)
 {
     inputline = line;
     commandline = NULL;
+    list_init(&here_docs);
+    cmd_start = true;
+    for_words = 0;
+    block_depth = 0;
+    last_token = '\n';
+    func_paren = false;
 
     int error = yyparse();
 
+    incomplete = error && yychar == YYEOF && block_depth > 0;
     return error ? NULL : commandline;
 }
+
+bool
+ast_parse_incomplete(void)
+{
+    return incomplete;
+}
+
+/* 
+ * After a parse that was incomplete, return the delimiter of the i-th
+ * here-document seen so far, or NULL if there are not that many.
+ */
+const char *
+ast_parse_here_delim(size_t i)
+{
+    for (struct list_elem * e = list_begin(&here_docs); e != list_end(&here_docs);
+                            e = list_next(e)) {
+        if (i-- == 0)
+            return list_entry(e, struct ast_pipeline, here_elem)->here_delim;
+    }
+    return NULL;
+}
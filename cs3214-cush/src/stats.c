@@ -0,0 +1,197 @@
+/*
+ * Always-on latency histograms for the phases of the shell's main loop.
+ *
+ * Each phase owns a fixed log-bucketed histogram in the style of
+ * HdrHistogram: values are grouped by the position of their most
+ * significant bit, and every such power-of-two range is split into
+ * STATS_SUB_BUCKETS linear sub-buckets.  This keeps the relative error
+ * of any reported percentile below 1/STATS_SUB_BUCKETS while making
+ * an update a handful of arithmetic instructions and one increment.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define STATS_SUB_BITS      5
+#define STATS_SUB_BUCKETS   (1 << STATS_SUB_BITS)
+/* values below STATS_SUB_BUCKETS are exact; each of the remaining
+ * 64 - STATS_SUB_BITS magnitudes gets STATS_SUB_BUCKETS buckets. */
+#define STATS_NBUCKETS      ((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+struct histogram {
+    uint64_t buckets[STATS_NBUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+static struct histogram histograms[STATS_NPHASES];
+static char *export_path;       /* written to by stats_export at exit */
+static pid_t export_pid;        /* the shell that asked for the export */
+
+static const char *phase_names[STATS_NPHASES] = {
+    [STATS_READLINE] = "readline",
+    [STATS_PARSE]    = "parse",
+    [STATS_BUILTIN]  = "builtin",
+    [STATS_FORK]     = "fork",
+    [STATS_WALL]     = "wall",
+    [STATS_REAP]     = "reap",
+};
+
+/* Return a monotonic timestamp in nanoseconds */
+uint64_t
+stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Map a value to its bucket */
+static inline int
+bucket_index(uint64_t v)
+{
+    if (v < STATS_SUB_BUCKETS)
+        return v;
+
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - STATS_SUB_BITS;
+    return (shift + 1) * STATS_SUB_BUCKETS + (int) (v >> shift) - STATS_SUB_BUCKETS;
+}
+
+/* Return the largest value that maps to bucket 'idx' */
+static uint64_t
+bucket_upper_bound(int idx)
+{
+    if (idx < STATS_SUB_BUCKETS)
+        return idx;
+
+    int shift = idx / STATS_SUB_BUCKETS - 1;
+    uint64_t mantissa = idx % STATS_SUB_BUCKETS + STATS_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/* Record one sample of 'ns' nanoseconds for 'phase'. */
+void
+stats_record(enum stats_phase phase, uint64_t ns)
+{
+    struct histogram *h = &histograms[phase];
+
+    h->buckets[bucket_index(ns)]++;
+    if (h->count == 0 || ns < h->min)
+        h->min = ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->count++;
+    h->sum += ns;
+}
+
+/* Record the time elapsed since 'start' */
+void
+stats_record_since(enum stats_phase phase, uint64_t start)
+{
+    stats_record(phase, stats_now() - start);
+}
+
+/* Return an upper bound on the 'pct' percentile of 'phase', in ns */
+uint64_t
+stats_percentile(enum stats_phase phase, double pct)
+{
+    struct histogram *h = &histograms[phase];
+    if (h->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (pct / 100.0 * h->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_NBUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_upper_bound(i);
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+/* Format a duration given in ns with a sensible unit */
+static char *
+format_duration(char *buf, size_t len, uint64_t ns)
+{
+    if (ns < 1000)
+        snprintf(buf, len, "%luns", (unsigned long) ns);
+    else if (ns < 1000000)
+        snprintf(buf, len, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, len, "%.2fms", ns / 1e6);
+    else
+        snprintf(buf, len, "%.3fs", ns / 1e9);
+    return buf;
+}
+
+/* Print a summary table of all phases to 'out' */
+void
+stats_print(FILE *out)
+{
+    char p50[32], p99[32], max[32], mean[32];
+
+    fprintf(out, "%-10s %8s %10s %10s %10s %10s\n",
+            "phase", "count", "mean", "p50", "p99", "max");
+    for (int i = 0; i < STATS_NPHASES; i++) {
+        struct histogram *h = &histograms[i];
+        fprintf(out, "%-10s %8lu %10s %10s %10s %10s\n",
+                phase_names[i], (unsigned long) h->count,
+                format_duration(mean, sizeof mean, h->count ? h->sum / h->count : 0),
+                format_duration(p50, sizeof p50, stats_percentile(i, 50.0)),
+                format_duration(p99, sizeof p99, stats_percentile(i, 99.0)),
+                format_duration(max, sizeof max, h->max));
+    }
+}
+
+/* Discard all samples recorded so far */
+void
+stats_reset(void)
+{
+    memset(histograms, 0, sizeof histograms);
+}
+
+/* atexit handler that writes the summary if an export was requested.
+ * Forked children inherit the handler; one that exits, e.g. after a
+ * failed exec, must not overwrite the shell's summary with its own. */
+static void
+stats_export(void)
+{
+    if (export_path == NULL || getpid() != export_pid)
+        return;
+
+    FILE *out = fopen(export_path, "w");
+    if (out == NULL) {
+        perror(export_path);
+        return;
+    }
+    stats_print(out);
+    fclose(out);
+}
+
+/* Write the summary to 'path' when the shell exits. */
+void
+stats_set_export(const char *path)
+{
+    static bool registered;
+
+    free(export_path);
+    export_path = path ? strdup(path) : NULL;
+    export_pid = getpid();
+    if (!registered) {
+        atexit(stats_export);
+        registered = true;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Phases of the shell's main loop for which latency is tracked. */
+enum stats_phase {
+    STATS_READLINE,     /* time spent waiting in readline() for a line */
+    STATS_PARSE,        /* time spent parsing a command line */
+    STATS_BUILTIN,      /* time spent running a builtin command */
+    STATS_FORK,         /* fork() until the child is placed in its job */
+    STATS_WALL,         /* job start until its last process is reaped */
+    STATS_REAP,         /* bookkeeping for one reaped child status */
+    STATS_NPHASES
+};
+
+/* Return a monotonic timestamp in nanoseconds */
+uint64_t stats_now(void);
+
+/* Record one sample of 'ns' nanoseconds for 'phase'.
+ * O(1), does not allocate, and may be called from a signal handler. */
+void stats_record(enum stats_phase phase, uint64_t ns);
+
+/* Record the time elapsed since 'start' (obtained from stats_now()) */
+void stats_record_since(enum stats_phase phase, uint64_t start);
+
+/* Return an upper bound on the 'pct' percentile of 'phase', in ns */
+uint64_t stats_percentile(enum stats_phase phase, double pct);
+
+/* Print a summary table of all phases to 'out' */
+void stats_print(FILE *out);
+
+/* Discard all samples recorded so far */
+void stats_reset(void);
+
+/* Write the summary to 'path' when the shell exits.
+ * Passing NULL cancels a previously requested export. */
+void stats_set_export(const char *path);
+
+#endif /* __STATS_H */
@@ -0,0 +1,55 @@
+#!/usr/bin/python
+#
+# stats_test: tests the stats command
+# 
+# Test that the stats command prints a latency summary
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# run a short pipeline so that every phase has samples
+sendline("echo hello | cat")
+expect("hello", "pipeline did not run")
+expect_prompt("Shell did not print expected prompt ")
+
+# run builtin command
+sendline("stats")
+
+# expect the table header and a row for each phase
+expect("phase\s+count\s+mean\s+p50\s+p99\s+max", "stats header not displayed")
+expect("fork\s+2\s", "fork samples not counted")
+expect("wall\s+1\s", "wall time not counted")
+expect_prompt("Shell did not print expected prompt ")
+
+# reset and make sure the counters are cleared
+sendline("stats -r")
+expect_prompt("Shell did not print expected prompt ")
+sendline("stats")
+expect("fork\s+0\s", "stats -r did not reset the counters")
+expect_prompt("Shell did not print expected prompt ")
+
+# a child that fails to exec or to redirect exits on its own; it must
+# not write the summary, only the shell does when it exits
+export = os.path.join(tempfile.mkdtemp(), "stats.txt")
+sendline("stats -o " + export)
+expect_prompt("Shell did not print expected prompt ")
+sendline("no-such-command-xyz")
+expect_prompt("Shell did not print expected prompt ")
+sendline("cat < /no/such/file")
+expect_prompt("Shell did not print expected prompt ")
+assert not os.path.exists(export), "a child wrote the stats export"
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+testutil.console.expect(pexpect.EOF)
+assert os.path.exists(export), "the shell did not write the stats export"
+
+test_success()
@@ -0,0 +1,87 @@
+#!/usr/bin/python
+#
+# subst_test: tests command substitution
+# 
+# Test that $(...) is replaced by the output of the command line inside,
+# split into words, that it nests, and that builtins and assignments in
+# a substitution run inside the shell
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# output replaces the substitution, trailing newlines are dropped
+sendline("echo [$(echo hello)]")
+expect("\\[hello\\]\r\n", "output was not substituted")
+expect_prompt("Shell did not print expected prompt ")
+
+# the output is split into words and joined to the text around it
+sendline("printf \"[%s]\" a$(echo x   y)b; echo")
+expect("\\[ax\\]\\[yb\\]\r\n", "output was not split into words")
+expect_prompt("Shell did not print expected prompt ")
+
+# pipelines, sequences, && and nesting
+sendline("echo $(seq 1 5 | tail -n 2; false || echo or) $(echo $(echo nested))")
+expect("4 5 or nested\r\n", "pipelines or nested substitutions failed")
+expect_prompt("Shell did not print expected prompt ")
+
+# large output is captured completely
+sendline("echo $(seq 1 200000 | wc -c)")
+expect("1288895\r\n", "large output was not captured")
+expect_prompt("Shell did not print expected prompt ")
+
+# builtins and assignments run in the shell, but like in a subshell
+sendline("sleep 30 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo [$(jobs)]")
+expect("\\[\\[1\\] Running \\(sleep 30\\)\\]\r\n", "builtin output was not captured")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $(V=inside) $(exit) [$V]")
+expect("\\[\\]\r\n", "assignment in a substitution reached the shell")
+expect_prompt("Shell did not print expected prompt after exit in a substitution")
+sendline("X=$(cd /; export A=1; f() { echo; }; /bin/pwd)")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo [$X] [$A] $(/bin/pwd)")
+expect("/\\] \\[\\] /\\S", "cd or export in a substitution reached the shell")
+expect_prompt("Shell did not print expected prompt ")
+sendline("f")
+expect("no such file or directory", "function defined in a substitution reached the shell")
+expect_prompt("Shell did not print expected prompt ")
+
+# Ctrl-Z in a substitution kills it instead of leaving the shell hanging
+sendline("echo [$(sleep 100)]")
+time.sleep(0.5)
+sendcontrol("z")
+expect("\\[\\]\r\n", "stopped substitution did not end")
+expect_prompt("Shell did not print expected prompt after Ctrl-Z in a substitution")
+
+# substitutions in assignments
+sendline("W=$(echo assigned)")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $W")
+expect("assigned\r\n", "substitution in an assignment failed")
+expect_prompt("Shell did not print expected prompt ")
+
+# a loop parses its substitutions once but runs them every time around
+sendline("for i in 1 2 3; do echo [$(echo $i; timeout 5 echo t$i)] $((i + $(echo 10))); done")
+expect("\\[1 t1\\] 11\r\n\\[2 t2\\] 12\r\n\\[3 t3\\] 13\r\n", "substitution in a loop was not run again")
+expect_prompt("Shell did not print expected prompt ")
+
+# substitutions nest to any depth, and other parentheses stay in the word
+sendline("echo $(echo $(echo $(echo deep))) a(b) $((1 + $(echo $((2 * 3)))))")
+expect("deep a\\(b\\) 7\r\n", "nested parentheses in a word were not kept")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("kill %1")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
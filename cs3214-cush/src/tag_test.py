@@ -0,0 +1,48 @@
+#!/usr/bin/python
+#
+# tag_test: tests the tag mode of the joblog command
+#
+# Test that the output of concurrent background jobs reaches the
+# terminal a whole line at a time, each line tagged with its job id
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("joblog tag")
+expect_prompt("Shell did not print expected prompt ")
+
+# the first job writes half a line, then the second job a whole one,
+# then the first job the rest of its line
+sendline("sh -c \"printf first-; sleep 1; echo half\" &")
+first = parse_bg_status()[0]
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"sleep 0.5; echo second\" &")
+second = parse_bg_status()[0]
+expect_prompt("Shell did not print expected prompt ")
+
+expect_exact("[" + second + "] second\r\n", "line of the second job was not tagged")
+expect_exact("[" + first + "] first-half\r\n", "line of the first job was split")
+
+# a last line without a newline is ended by the shell
+sendline("printf no-newline &")
+jid = parse_bg_status()[0]
+expect_exact("[" + jid + "] no-newline\r\n", "last line was not written")
+expect_prompt("Shell did not print expected prompt ")
+
+# many lines all arrive, each with its tag
+sendline("seq 1 3000 &")
+jid = parse_bg_status()[0]
+for i in [1, 1000, 2999, 3000]:
+    expect_exact("[" + jid + "] " + str(i) + "\r\n", "lines of the job were lost")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
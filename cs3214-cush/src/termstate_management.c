@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdbool.h>
 
 #include "termstate_management.h"
 #include "utils.h"
@@ -21,6 +22,7 @@ static int terminal_fd = -1;           /* The controlling terminal */
 static struct termios saved_tty_state; /* The state of the terminal when shell
                                            was started. */
 static int shell_pgrp;          /* The pgrp of the shell when it started */
+static bool without_terminal;   /* Running a script without owning a terminal */
 
 /* Initialize tty support. */
 void
@@ -40,11 +42,46 @@ termstate_init(void)
     shell_pgrp = getpgrp();
 }
 
+/* Initialize tty support if the shell is in the foreground of a
+ * controlling terminal.  Otherwise, as for a script started in the
+ * background or without a terminal, jobs do not get the terminal and
+ * the functions below do nothing. */
+bool
+termstate_init_optional(void)
+{
+    assert(terminal_fd == -1 || !!!"termstate_init already called");
+
+    shell_pgrp = getpgrp();
+    int fd = open(ctermid(NULL), O_RDWR | O_CLOEXEC);
+    if (fd == -1 || tcgetpgrp(fd) != shell_pgrp) {
+        if (fd != -1)
+            close(fd);
+        without_terminal = true;
+        return false;
+    }
+    terminal_fd = fd;
+    termstate_save(&saved_tty_state);
+    return true;
+}
+
+/* Do without tty support, see termstate_init_optional. */
+void
+termstate_init_none(void)
+{
+    assert(terminal_fd == -1 || !!!"termstate_init already called");
+
+    shell_pgrp = getpgrp();
+    without_terminal = true;
+}
+
 /* Save current terminal settings.
  * This function is used when a job is suspended.*/
 void 
 termstate_save(struct termios *saved_tty_state)
 {
+    if (without_terminal)
+        return;
+
     int rc = tcgetattr(terminal_fd, saved_tty_state);
     if (rc == -1)
         utils_fatal_error("tcgetattr failed: ");
@@ -90,6 +127,9 @@ termstate_get_tty_fd(void)
 void
 termstate_give_terminal_to(struct termios *pg_tty_state, pid_t pgrp)
 {
+    if (without_terminal)
+        return;
+
     signal_block(SIGTTOU);
     int rc = tcsetpgrp(termstate_get_tty_fd(), pgrp);
     if (rc == -1)
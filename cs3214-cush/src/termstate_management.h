@@ -2,10 +2,20 @@
 #define __TERMSTATE_MANAGEMENT_H
 
 #include <sys/types.h>
+#include <stdbool.h>
 
 /* Initialize tty support. */
 void termstate_init(void);
 
+/* Initialize tty support if the shell is the foreground process group
+ * of a controlling terminal, as used for scripts.  Returns false, and
+ * turns the functions below into no-ops, if it is not. */
+bool termstate_init_optional(void);
+
+/* Run without a terminal, as the command server does: jobs never get
+ * the terminal, even if the shell was started in its foreground. */
+void termstate_init_none(void);
+
 /* Save current terminal settings.
  * This function should be called when a job is suspended.*/
 void termstate_save(struct termios *saved_tty_state);
@@ -0,0 +1,80 @@
+#!/usr/bin/python
+#
+# timeout_test: tests the timeout prefix
+# 
+# Test that a job is terminated once its timeout is up and fails with
+# status 124, that jobs shows the time left, and that a job which
+# ignores SIGTERM, or has a process that does, is killed after the -k
+# grace period
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a foreground job that outlives its timeout
+sendline("timeout 1 sleep 10")
+expect("timed out", "timeout was not reported")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $?")
+expect("124", "timed out job did not fail with 124")
+expect_prompt("Shell did not print expected prompt ")
+
+# a job that finishes in time keeps its status
+sendline("timeout 10 sh -c \"exit 3\"")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $?")
+expect("3", "job that finished in time lost its status")
+expect_prompt("Shell did not print expected prompt ")
+
+# jobs shows the time left of a background job
+sendline("timeout 1m sleep 120 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("jobs")
+expect("sleep 120\)\s+timeout in 5\d\.\ds", "jobs did not show the time left")
+expect_prompt("Shell did not print expected prompt ")
+sendline("kill %1")
+expect_prompt("Shell did not print expected prompt ")
+
+# a job that survives SIGTERM is killed after -k; the trap keeps sh
+# alive when its first sleep is terminated, and it starts another
+sendline("timeout -k 1 0.5 sh -c \"trap : TERM; sleep 10; sleep 10\"")
+expect("timed out", "job ignoring SIGTERM was not killed")
+expect_prompt("Shell did not print expected prompt ")
+
+# the deadline stays armed while a process of a pipeline ignores SIGTERM
+sendline("timeout -k 1 0.5 sh -c \"trap : TERM; sleep 3; sleep 3\" | sleep 10; echo status $?")
+expect("timed out\r\nstatus 124\r\n", "pipeline member ignoring SIGTERM was not killed")
+expect_prompt("Shell did not print expected prompt ")
+time.sleep(3)
+sendline("echo alive")
+expect("alive\r\n", "shell did not survive the pipeline")
+expect_prompt("Shell did not print expected prompt ")
+
+# bad durations and a missing command are usage errors
+sendline("timeout 1x sleep 1")
+expect("invalid duration", "bad duration was accepted")
+expect_prompt("Shell did not print expected prompt ")
+sendline("timeout 5")
+expect("Usage: timeout", "timeout without a command did not print usage")
+expect_prompt("Shell did not print expected prompt ")
+
+# builtins and functions run in the shell, where no deadline applies
+sendline("f() { sleep 1; }")
+expect_prompt("Shell did not print expected prompt ")
+sendline("timeout 5 f; echo status $?")
+expect("timeout: cannot apply to 'f', which runs inside the shell\r\nstatus 1\r\n", "timeout was applied to a function")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sched -n 5 jobs; echo status $?")
+expect("sched: cannot apply to 'jobs', which runs inside the shell\r\nstatus 1\r\n", "sched was applied to a builtin")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,143 @@
+/*
+ * Timing wheel, see timerwheel.h.
+ *
+ * 'current' is the last tick the wheel was advanced to; every timer is
+ * due after it, including those added by a callback, which therefore
+ * fire in a later advance.  Advancing to tick 'now' visits the slots of
+ * the ticks in between, at most one turn of them, and fires the timers
+ * in those slots whose tick has come.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "timerwheel.h"
+
+struct timer {
+    struct timer *next;         /* in its slot */
+    int id;
+    uint64_t due;               /* tick */
+    uint64_t interval;          /* ticks */
+    timerwheel_fn *fn;
+    void *arg;
+};
+
+static struct timer *slots[TIMERWHEEL_SLOTS];
+static uint64_t current;
+static int next_id = 1;
+
+/* Return the current tick */
+static uint64_t
+now_tick(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / TIMERWHEEL_TICK_MS;
+}
+
+/* Convert seconds to ticks, rounding up */
+static uint64_t
+to_ticks(double secs)
+{
+    double ticks = secs * 1000 / TIMERWHEEL_TICK_MS;
+    uint64_t n = (uint64_t) ticks;
+    return n < ticks ? n + 1 : n;
+}
+
+static void
+insert(struct timer *t)
+{
+    struct timer **slot = &slots[t->due % TIMERWHEEL_SLOTS];
+    t->next = *slot;
+    *slot = t;
+}
+
+int
+timerwheel_add(double first, double interval, timerwheel_fn *fn, void *arg)
+{
+    if (current == 0)
+        current = now_tick();
+
+    struct timer *t = malloc(sizeof *t);
+    t->id = next_id++;
+    t->interval = to_ticks(interval);
+    if (t->interval == 0)
+        t->interval = 1;
+    t->due = now_tick() + to_ticks(first);
+    if (t->due <= current)
+        t->due = current + 1;
+    t->fn = fn;
+    t->arg = arg;
+    insert(t);
+    return t->id;
+}
+
+void *
+timerwheel_remove(int id)
+{
+    for (int i = 0; i < TIMERWHEEL_SLOTS; i++) {
+        for (struct timer **p = &slots[i]; *p; p = &(*p)->next) {
+            struct timer *t = *p;
+            if (t->id == id) {
+                *p = t->next;
+                void *arg = t->arg;
+                free(t);
+                return arg;
+            }
+        }
+    }
+    return NULL;
+}
+
+void
+timerwheel_advance(void)
+{
+    uint64_t now = now_tick();
+    if (current == 0 || now <= current)
+        return;
+
+    uint64_t first = current + 1;
+    uint64_t last = now - current > TIMERWHEEL_SLOTS ? current + TIMERWHEEL_SLOTS : now;
+    current = now;
+    for (uint64_t tick = first; tick <= last; tick++) {
+        struct timer **p = &slots[tick % TIMERWHEEL_SLOTS];
+        while (*p != NULL) {
+            struct timer *t = *p;
+            if (t->due > now) {
+                p = &t->next;
+                continue;
+            }
+            /* the next due tick in phase with the last one, after now */
+            *p = t->next;
+            t->due += ((now - t->due) / t->interval + 1) * t->interval;
+            insert(t);
+
+            /* the callback may remove any timer, this one included, so
+             * the slot is walked again from its head; the timers that
+             * fired are no longer due */
+            int id = t->id;
+            timerwheel_fn *fn = t->fn;
+            void *arg = t->arg;
+            fn(id, arg);
+            p = &slots[tick % TIMERWHEEL_SLOTS];
+        }
+    }
+}
+
+int
+timerwheel_next_ms(void)
+{
+    uint64_t next = 0;
+    for (int i = 0; i < TIMERWHEEL_SLOTS; i++)
+        for (struct timer *t = slots[i]; t; t = t->next)
+            if (next == 0 || t->due < next)
+                next = t->due;
+    if (next == 0)
+        return -1;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ms = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    uint64_t due_ms = next * TIMERWHEEL_TICK_MS;
+    return due_ms > ms ? (int) (due_ms - ms) : 0;
+}
@@ -0,0 +1,41 @@
+#ifndef __TIMERWHEEL_H
+#define __TIMERWHEEL_H
+
+#include <stdbool.h>
+
+/* A hashed timing wheel for the commands the shell runs on a schedule.
+ *
+ * Time is cut into ticks of TIMERWHEEL_TICK_MS.  A timer due at tick t
+ * sits in slot t % TIMERWHEEL_SLOTS, so adding a timer costs O(1) and
+ * advancing the wheel by a tick only looks at the timers of one slot.
+ * A timer more than a turn of the wheel away stays in its slot until
+ * the turn in which it is due.
+ *
+ * The wheel has no thread: the shell advances it from its main loop,
+ * and callbacks run there.  A periodic timer that was not advanced for
+ * several of its periods fires once and then keeps its phase, so missed
+ * runs are skipped rather than made up in a burst.
+ */
+
+#define TIMERWHEEL_TICK_MS  100     /* resolution of the wheel */
+#define TIMERWHEEL_SLOTS    256     /* ticks per turn of the wheel */
+
+typedef void timerwheel_fn(int id, void *arg);
+
+/* Add a timer that first calls 'fn' with 'arg' 'first' seconds from now
+ * and then every 'interval' seconds, at least once per tick.  Returns
+ * its id, which is greater than 0. */
+int timerwheel_add(double first, double interval, timerwheel_fn *fn, void *arg);
+
+/* Remove timer 'id', also from within a callback.  Returns its 'arg',
+ * or NULL if there is no such timer. */
+void *timerwheel_remove(int id);
+
+/* Call the callbacks of the timers that came due since the last call */
+void timerwheel_advance(void);
+
+/* Return the milliseconds until the next timer is due, 0 if one is due
+ * already, or -1 if there are no timers */
+int timerwheel_next_ms(void);
+
+#endif /* __TIMERWHEEL_H */
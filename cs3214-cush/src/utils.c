@@ -10,6 +10,8 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "utils.h"
 
@@ -57,3 +59,21 @@ utils_set_cloexec(int fd)
     return fcntl(fd, F_SETFD, oldflags | FD_CLOEXEC);
 }
 
+/* Start a detached thread running fn(arg) with every signal blocked,
+ * return 0 on success or an error number */
+int
+utils_start_thread(void *(*fn)(void *), void *arg)
+{
+    /* the thread inherits the mask; it must not receive the signals
+     * the shell handles */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_t tid;
+    int rc = pthread_create(&tid, NULL, fn, arg);
+    if (rc == 0)
+        pthread_detach(tid);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return rc;
+}
+
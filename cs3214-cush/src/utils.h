@@ -1,6 +1,10 @@
 /* Set the 'close-on-exec' flag on fd, return error indicator */
 int utils_set_cloexec(int fd);
 
+/* Start a detached thread running fn(arg) with every signal blocked,
+ * return 0 on success or an error number */
+int utils_start_thread(void *(*fn)(void *), void *arg);
+
 /* Print information about the last syscall error */
 void utils_error(char *fmt, ...);
 
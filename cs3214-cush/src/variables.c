@@ -0,0 +1,407 @@
+/*
+ * Shell variables and the exported environment.
+ *
+ * The table uses open addressing with linear probing.  Removed entries
+ * leave a tombstone behind so that probe sequences stay intact; the
+ * table is rehashed when live entries plus tombstones exceed 3/4 of
+ * its capacity.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "variables.h"
+
+struct var {
+    char *name;         /* NULL if the slot is empty */
+    char *value;
+    uint32_t hash;
+    bool exported;
+};
+
+/* marks a slot whose variable was removed */
+static char tombstone[] = "";
+
+static struct var *table;
+static size_t capacity;     /* always a power of 2 */
+static size_t used;         /* live entries and tombstones */
+
+/* Incremented whenever the exported environment changes */
+static unsigned long env_version = 1;
+static unsigned long envp_version;
+static char **envp;
+
+/* $? as a number, so && and || need not parse it */
+static int last_status;
+
+/* FNV-1a */
+static uint32_t
+hash_name(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+
+/* Return the slot holding 'name', or NULL */
+static struct var *
+lookup(const char *name, size_t len)
+{
+    if (capacity == 0)
+        return NULL;
+
+    uint32_t h = hash_name(name, len);
+    for (size_t i = h & (capacity - 1); table[i].name != NULL; i = (i + 1) & (capacity - 1)) {
+        struct var *v = &table[i];
+        if (v->name != tombstone && v->hash == h
+            && strncmp(v->name, name, len) == 0 && v->name[len] == '\0')
+            return v;
+    }
+    return NULL;
+}
+
+/* Return an empty slot for a new entry with hash 'h' */
+static struct var *
+free_slot(uint32_t h)
+{
+    size_t i = h & (capacity - 1);
+    while (table[i].name != NULL && table[i].name != tombstone)
+        i = (i + 1) & (capacity - 1);
+    if (table[i].name == NULL)
+        used++;
+    return &table[i];
+}
+
+/* Grow the table, or just drop the tombstones, so a new entry fits */
+static void
+make_room(void)
+{
+    if (capacity != 0 && (used + 1) * 4 <= capacity * 3)
+        return;
+
+    struct var *old = table;
+    size_t oldcap = capacity;
+    size_t live = 0;
+    for (size_t i = 0; i < oldcap; i++)
+        if (old[i].name != NULL && old[i].name != tombstone)
+            live++;
+
+    capacity = oldcap ? oldcap : 64;
+    while ((live + 1) * 2 > capacity)
+        capacity *= 2;
+    table = calloc(capacity, sizeof *table);
+    used = 0;
+    for (size_t i = 0; i < oldcap; i++)
+        if (old[i].name != NULL && old[i].name != tombstone)
+            *free_slot(old[i].hash) = old[i];
+    free(old);
+}
+
+void
+var_init(char **env)
+{
+    for (char **e = env; *e; e++) {
+        char *eq = strchr(*e, '=');
+        if (eq == NULL || !var_valid_name(*e, eq - *e))
+            continue;
+        char *name = strndup(*e, eq - *e);
+        var_set(name, eq + 1, true);
+        free(name);
+    }
+    var_set_status(0);
+
+    /* $$ is the pid of the shell, also when expanded in a child */
+    char pid[16];
+    snprintf(pid, sizeof pid, "%d", (int) getpid());
+    var_set("$", pid, false);
+}
+
+const char *
+var_get(const char *name)
+{
+    struct var *v = lookup(name, strlen(name));
+    return v ? v->value : NULL;
+}
+
+void
+var_set(const char *name, const char *value, bool export)
+{
+    size_t len = strlen(name);
+    struct var *v = lookup(name, len);
+    if (v == NULL) {
+        make_room();
+        uint32_t h = hash_name(name, len);
+        v = free_slot(h);
+        v->name = strdup(name);
+        v->hash = h;
+        v->value = NULL;
+        v->exported = false;
+    }
+
+    if (v->exported || export) {
+        if (!v->exported || v->value == NULL || strcmp(v->value, value) != 0)
+            env_version++;
+        v->exported = true;
+    }
+    free(v->value);
+    v->value = strdup(value);
+}
+
+void
+var_export(const char *name)
+{
+    struct var *v = lookup(name, strlen(name));
+    if (v == NULL)
+        var_set(name, "", true);
+    else if (!v->exported) {
+        v->exported = true;
+        env_version++;
+    }
+}
+
+void
+var_unset(const char *name)
+{
+    struct var *v = lookup(name, strlen(name));
+    if (v == NULL)
+        return;
+    if (v->exported)
+        env_version++;
+    free(v->name);
+    free(v->value);
+    v->name = tombstone;
+    v->value = NULL;
+}
+
+struct var_snapshot {
+    struct var *table;
+    size_t capacity;
+    size_t used;
+};
+
+struct var_snapshot *
+var_save(void)
+{
+    struct var_snapshot *s = malloc(sizeof *s);
+    s->capacity = capacity;
+    s->used = used;
+    s->table = calloc(capacity ? capacity : 1, sizeof *s->table);
+    for (size_t i = 0; i < capacity; i++) {
+        s->table[i] = table[i];
+        if (table[i].name != NULL && table[i].name != tombstone) {
+            s->table[i].name = strdup(table[i].name);
+            s->table[i].value = strdup(table[i].value);
+        }
+    }
+    return s;
+}
+
+void
+var_restore(struct var_snapshot *s)
+{
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].name != NULL && table[i].name != tombstone) {
+            free(table[i].name);
+            free(table[i].value);
+        }
+    }
+    free(table);
+    table = s->table;
+    capacity = s->capacity;
+    used = s->used;
+    free(s);
+
+    /* the exported ones may differ, and $? is not restored */
+    env_version++;
+    var_set_status(last_status);
+}
+
+bool
+var_valid_name(const char *name, size_t len)
+{
+    if (len == 0 || !(isalpha((unsigned char) name[0]) || name[0] == '_'))
+        return false;
+    for (size_t i = 1; i < len; i++)
+        if (!(isalnum((unsigned char) name[i]) || name[i] == '_'))
+            return false;
+    return true;
+}
+
+void
+var_set_status(int status)
+{
+    char buf[16];
+    snprintf(buf, sizeof buf, "%d", status);
+    var_set("?", buf, false);
+    last_status = status;
+}
+
+int
+var_status(void)
+{
+    return last_status;
+}
+
+char **
+var_environ(void)
+{
+    if (envp_version == env_version)
+        return envp;
+
+    if (envp) {
+        for (char **e = envp; *e; e++)
+            free(*e);
+        free(envp);
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < capacity; i++)
+        if (table[i].name != NULL && table[i].name != tombstone && table[i].exported)
+            n++;
+
+    envp = malloc((n + 1) * sizeof *envp);
+    n = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        struct var *v = &table[i];
+        if (v->name == NULL || v->name == tombstone || !v->exported)
+            continue;
+        size_t nlen = strlen(v->name), vlen = strlen(v->value);
+        char *entry = malloc(nlen + vlen + 2);
+        memcpy(entry, v->name, nlen);
+        entry[nlen] = '=';
+        memcpy(entry + nlen + 1, v->value, vlen + 1);
+        envp[n++] = entry;
+    }
+    envp[n] = NULL;
+    envp_version = env_version;
+    return envp;
+}
+
+/* Compare two "NAME=value" strings by name */
+static int
+compare_entries(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+void
+var_print_exported(void)
+{
+    char **env = var_environ();
+    size_t n = 0;
+    while (env[n])
+        n++;
+
+    /* print in a stable order without disturbing the cached array */
+    char **sorted = malloc(n * sizeof *sorted);
+    memcpy(sorted, env, n * sizeof *sorted);
+    qsort(sorted, n, sizeof *sorted, compare_entries);
+    for (size_t i = 0; i < n; i++) {
+        char *eq = strchr(sorted[i], '=');
+        printf("export %.*s=\"%s\"\n", (int) (eq - sorted[i]), sorted[i], eq + 1);
+    }
+    free(sorted);
+}
+
+/* Append 'n' bytes of 's' to the growing string 'buf' */
+static void
+append(char **buf, size_t *len, size_t *cap, const char *s, size_t n)
+{
+    if (*len + n + 1 > *cap) {
+        while (*len + n + 1 > *cap)
+            *cap *= 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+}
+
+char *
+var_expand(const char *word)
+{
+    /* most words contain nothing to expand */
+    if (strchr(word, '$') == NULL)
+        return strdup(word);
+
+    size_t len = 0, cap = strlen(word) + 16;
+    char *buf = malloc(cap);
+    buf[0] = '\0';
+
+    const char *p = word;
+    while (*p) {
+        const char *dollar = strchr(p, '$');
+        if (dollar == NULL) {
+            append(&buf, &len, &cap, p, strlen(p));
+            break;
+        }
+
+        /* \$ is a literal dollar sign */
+        if (dollar > p && dollar[-1] == '\\') {
+            append(&buf, &len, &cap, p, dollar - p - 1);
+            append(&buf, &len, &cap, "$", 1);
+            p = dollar + 1;
+            continue;
+        }
+        append(&buf, &len, &cap, p, dollar - p);
+
+        const char *name = dollar + 1, *end;
+        size_t nlen;
+        if (*name == '{') {
+            name++;
+            end = strchr(name, '}');
+            if (end == NULL) {      /* unterminated, keep as is */
+                append(&buf, &len, &cap, dollar, strlen(dollar));
+                break;
+            }
+            nlen = end - name;
+            end++;
+        } else if (*name != '\0' && strchr("?$#@*", *name) != NULL) {
+            nlen = 1;
+            end = name + 1;
+        } else {
+            end = name;
+            while (isalnum((unsigned char) *end) || *end == '_')
+                end++;
+            nlen = end - name;
+        }
+
+        if (nlen == 0) {            /* a lone $ */
+            append(&buf, &len, &cap, "$", 1);
+            p = dollar + 1;
+            continue;
+        }
+
+        struct var *v = lookup(name, nlen);
+        if (v)
+            append(&buf, &len, &cap, v->value, strlen(v->value));
+        p = end;
+    }
+    return buf;
+}
+
+char **
+var_expand_argv(char **argv)
+{
+    size_t n = 0;
+    while (argv[n])
+        n++;
+
+    char **expanded = malloc((n + 1) * sizeof *expanded);
+    for (size_t i = 0; i < n; i++)
+        expanded[i] = var_expand(argv[i]);
+    expanded[n] = NULL;
+    return expanded;
+}
+
+void
+var_free_argv(char **argv)
+{
+    for (char **p = argv; *p; p++)
+        free(*p);
+    free(argv);
+}
@@ -0,0 +1,67 @@
+#ifndef __VARIABLES_H
+#define __VARIABLES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shell variables.
+ *
+ * Variables live in an open-addressing hash table.  Exported variables
+ * are also kept as an envp array for exec that is only rebuilt when an
+ * exported variable changes, so starting a job does not serialize the
+ * environment again.
+ */
+
+/* Import 'envp' (usually environ) as exported variables */
+void var_init(char **envp);
+
+/* Return the value of variable 'name', or NULL if it is not set */
+const char *var_get(const char *name);
+
+/* Set variable 'name' to 'value'.  The variable is exported if 'export'
+ * is true or if it was exported before. */
+void var_set(const char *name, const char *value, bool export);
+
+/* Mark variable 'name' as exported, creating it with an empty value
+ * if it does not exist */
+void var_export(const char *name);
+
+/* Remove variable 'name' */
+void var_unset(const char *name);
+
+/* Return true if 'name' is a valid variable name */
+bool var_valid_name(const char *name, size_t len);
+
+/* Set the special variable $? to 'status' */
+void var_set_status(int status);
+
+/* Return the value of $? as a number */
+int var_status(void);
+
+/* Return a copy of all variables, to be put back with var_restore */
+struct var_snapshot *var_save(void);
+
+/* Replace all variables with those of 'snapshot', which is freed.  $?
+ * keeps its current value. */
+void var_restore(struct var_snapshot *snapshot);
+
+/* Return the environment of exported variables as a NULL terminated
+ * array of "NAME=value" strings.  The array is cached and rebuilt only
+ * if an exported variable changed since the last call; it must not be
+ * modified or freed by the caller. */
+char **var_environ(void);
+
+/* Print all exported variables in a form that can be read back */
+void var_print_exported(void);
+
+/* Return a malloc'd copy of 'word' with $NAME, ${NAME}, $?, $$ and the
+ * function arguments $#, $@ and $* replaced by their values.  \$ stands
+ * for a literal $. */
+char *var_expand(const char *word);
+
+/* Expand every word of the NULL terminated array 'argv' into a new
+ * malloc'd array; free it with var_free_argv */
+char **var_expand_argv(char **argv);
+void var_free_argv(char **argv);
+
+#endif /* __VARIABLES_H */
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+#
+# variables_test: tests shell variables, export and unset
+# 
+# Test that $VAR is expanded in commands and builtins, that only
+# exported variables reach the environment of jobs, and that $?
+# holds the exit status of the last foreground job
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a shell variable is expanded but not passed to jobs
+sendline("GREETING=hello")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo ${GREETING}-$GREETING")
+expect("hello-hello", "variable was not expanded")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"echo env:[\\$GREETING]\"")
+expect("env:\[\]", "unexported variable reached the environment")
+expect_prompt("Shell did not print expected prompt ")
+
+# once exported it is
+sendline("export GREETING")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"echo env:[\\$GREETING]\"")
+expect("env:\[hello\]", "exported variable did not reach the environment")
+expect_prompt("Shell did not print expected prompt ")
+
+# changing an exported variable updates the environment
+sendline("export GREETING=bye")
+expect_prompt("Shell did not print expected prompt ")
+sendline("env")
+expect("GREETING=bye", "changed variable did not reach the environment")
+expect_prompt("Shell did not print expected prompt ")
+
+# unset removes it
+sendline("unset GREETING")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"echo env:[\\$GREETING]\"")
+expect("env:\[\]", "unset variable is still in the environment")
+expect_prompt("Shell did not print expected prompt ")
+
+# $? holds the exit status of the last job
+sendline("false")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo status:$?")
+expect("status:1", "$? did not hold the exit status")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
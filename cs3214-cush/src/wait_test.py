@@ -0,0 +1,84 @@
+#!/usr/bin/python
+#
+# wait_test: tests the wait builtin
+# 
+# Test that wait blocks until all background jobs, the given jobs or,
+# with -n, the first of them have finished, that $? is set from the
+# job waited for, and that Ctrl-C interrupts a wait
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading
+from testutil import *
+import testutil
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# wait for all background jobs
+sendline("sleep 0.5 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sleep 1 &")
+expect_prompt("Shell did not print expected prompt ")
+start = time.time()
+sendline("wait")
+expect_prompt("Shell did not print expected prompt ")
+assert time.time() - start >= 0.8, "wait returned before the jobs finished"
+sendline("jobs")
+expect_prompt("Shell did not print expected prompt ")
+
+# wait for one job sets $? to its exit status
+sendline("sh -c \"sleep 0.3; exit 3\" &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("wait %1")
+expect_prompt("Shell did not print expected prompt ")
+sendline("echo $?")
+expect("[^0-9]3\r\n", "wait did not set the exit status of the job")
+expect_prompt("Shell did not print expected prompt ")
+
+# wait -n returns when the first job finishes
+sendline("sleep 30 &")
+expect_prompt("Shell did not print expected prompt ")
+sendline("sh -c \"sleep 0.3; exit 4\" &")
+expect_prompt("Shell did not print expected prompt ")
+start = time.time()
+sendline("wait -n")
+expect_prompt("Shell did not print expected prompt ")
+assert time.time() - start < 5, "wait -n waited for all jobs"
+sendline("echo $?")
+expect("[^0-9]4\r\n", "wait -n did not set the exit status of the first job")
+expect_prompt("Shell did not print expected prompt ")
+
+# Ctrl-C interrupts wait, the job keeps running
+sendline("wait")
+time.sleep(0.5)
+sendcontrol("c")
+expect_prompt("Shell did not print expected prompt after Ctrl-C")
+sendline("echo $?")
+expect("[^0-9]130\r\n", "interrupted wait did not set $? to 130")
+expect_prompt("Shell did not print expected prompt ")
+sendline("jobs")
+expect("sleep 30", "job was lost after an interrupted wait")
+expect_prompt("Shell did not print expected prompt ")
+
+# Ctrl-C during a wait in a loop stops the loop as well
+sendline("for i in 1 2; do wait; echo after-$i; done")
+time.sleep(0.5)
+sendcontrol("c")
+expect_prompt("Ctrl-C during wait did not stop the loop")
+assert "after-1" not in testutil.console.before, "the loop went on after an interrupted wait"
+
+# unknown jobs are reported
+sendline("wait %99")
+expect("no such job", "unknown job was not reported")
+expect_prompt("Shell did not print expected prompt ")
+
+sendline("kill %1")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,332 @@
+/*
+ * The zygote, see zygote.h.
+ *
+ * The shell and the zygote talk over a stream socketpair.  A request is
+ * a struct request, carrying stdin, stdout, stderr and the shell's
+ * working directory as SCM_RIGHTS, followed by the argument and
+ * environment strings, each with its NUL.
+ * The answer is the pid of the new process, or -1.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "zygote.h"
+
+#define NFDS    4               /* stdin, stdout, stderr, cwd */
+
+struct request {
+    pid_t pgid;                 /* 0 for a new process group */
+    uint32_t argc, envc;        /* number of strings of each kind */
+    uint32_t len;               /* bytes of strings after the request */
+    struct jobsched sched;
+    struct joblimits limits;
+};
+
+static int zygote_sock = -1;    /* the shell's end of the socketpair */
+static pid_t zygote_pid = -1;
+static sigset_t startup_mask;   /* the signal mask the shell started with */
+
+/* Send all of 'len' bytes, without SIGPIPE if the peer went away */
+static bool
+send_all(int sock, const void *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(sock, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf = (const char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Receive all of 'len' bytes.  Returns false at the end of input. */
+static bool
+recv_all(int sock, void *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(sock, buf, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf = (char *) buf + n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Receive a request and its descriptors.  Returns false when the shell
+ * has gone away. */
+static bool
+recv_request(int sock, struct request *req, int fds[NFDS])
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(NFDS * sizeof(int))];
+    } control;
+    struct iovec iov = { .iov_base = req, .iov_len = sizeof *req };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf,
+    };
+
+    ssize_t n;
+    do
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return false;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(NFDS * sizeof(int)))
+        return false;
+    memcpy(fds, CMSG_DATA(cmsg), NFDS * sizeof(int));
+    return recv_all(sock, (char *) req + n, sizeof *req - n);
+}
+
+/* In the new process: become what a forked child of the shell is right
+ * before it execs.  The process was made with a raw clone, behind the
+ * back of the C library, so nothing here may depend on its thread id
+ * (as raise() or thread functions would). */
+static void
+exec_child(const struct request *req, char **argv, char **envp, const int fds[NFDS])
+{
+    setpgid(0, req->pgid);
+    for (int i = 0; i < 3; i++)
+        dup2(fds[i], i);
+    if (fchdir(fds[3]) < 0) {
+        perror("cd");
+        _exit(EXIT_FAILURE);
+    }
+    sigprocmask(SIG_SETMASK, &startup_mask, NULL);
+
+    jobsched_apply_self(&req->sched);
+    joblimits_apply_self(&req->limits);
+
+    environ = envp;
+    execvp(argv[0], argv);
+    /* a raw clone shares the zygote's stdio buffers and atexit
+     * handlers; report on stderr and leave without running them */
+    perror(argv[0]);
+    _exit(127);
+}
+
+/* Split 'len' bytes of strings into 'argv' and 'envp'.  Returns false
+ * if they do not hold the number of strings the request says. */
+static bool
+split_strings(char *strings, size_t len, char **argv, uint32_t argc,
+              char **envp, uint32_t envc)
+{
+    char *p = strings, *end = strings + len;
+    for (uint32_t i = 0; i < argc + envc; i++) {
+        char *nul = memchr(p, '\0', end - p);
+        if (nul == NULL)
+            return false;
+        if (i < argc)
+            argv[i] = p;
+        else
+            envp[i - argc] = p;
+        p = nul + 1;
+    }
+    argv[argc] = NULL;
+    envp[envc] = NULL;
+    return p == end;
+}
+
+/* The zygote's loop, which ends when the shell closes its end */
+static void
+zygote_main(int sock)
+{
+    /* Keyboard and job control signals are for the shell and its jobs.
+     * They are blocked rather than ignored: the processes the zygote
+     * starts inherit its dispositions, which are those the shell started
+     * with, as forked children inherit the shell's. */
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGTSTP);
+    sigaddset(&set, SIGTTIN);
+    sigaddset(&set, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &set, &startup_mask);
+
+    char *strings = NULL;
+    char **words = NULL;
+    size_t strings_size = 0, words_size = 0;
+    for (;;) {
+        struct request req;
+        int fds[NFDS];
+        if (!recv_request(sock, &req, fds))
+            _exit(0);
+
+        if (req.len > strings_size) {
+            strings_size = req.len;
+            strings = realloc(strings, strings_size);
+        }
+        size_t nwords = (size_t) req.argc + req.envc + 2;
+        if (nwords > words_size) {
+            words_size = nwords;
+            words = realloc(words, words_size * sizeof *words);
+        }
+        if (!recv_all(sock, strings, req.len))
+            _exit(0);
+
+        char **argv = words, **envp = words + req.argc + 1;
+        pid_t pid = -1;
+        if (req.argc > 0
+            && split_strings(strings, req.len, argv, req.argc, envp, req.envc)) {
+            /* CLONE_PARENT: the new process is the shell's child */
+            pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+            if (pid == 0)
+                exec_child(&req, argv, envp, fds);
+        }
+        for (int i = 0; i < NFDS; i++)
+            close(fds[i]);
+
+        int32_t answer = pid;
+        if (!send_all(sock, &answer, sizeof answer))
+            _exit(0);
+    }
+}
+
+bool
+zygote_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    zygote_sock = sv[0];
+    zygote_pid = pid;
+    return true;
+}
+
+bool
+zygote_running(void)
+{
+    return zygote_sock >= 0;
+}
+
+/* Stop using the zygote.  It exits when it sees its socket closed. */
+static void
+zygote_stop(void)
+{
+    close(zygote_sock);
+    zygote_sock = -1;
+}
+
+/* Append the strings of 'words' to 'buf' at '*len', and count them */
+static uint32_t
+pack_strings(char **words, char *buf, size_t *len)
+{
+    uint32_t n = 0;
+    for (; words[n] != NULL; n++) {
+        size_t size = strlen(words[n]) + 1;
+        memcpy(buf + *len, words[n], size);
+        *len += size;
+    }
+    return n;
+}
+
+pid_t
+zygote_spawn(char **argv, char **envp, const int fds[3], pid_t pgid,
+             const struct jobsched *sched, const struct joblimits *limits)
+{
+    if (zygote_sock < 0)
+        return -1;
+    /* the zygote's own directory is where the shell started */
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0)
+        return -1;
+    int all_fds[NFDS] = { fds[0], fds[1], fds[2], cwd };
+
+    size_t size = 0;
+    for (char **p = argv; *p; p++)
+        size += strlen(*p) + 1;
+    for (char **p = envp; *p; p++)
+        size += strlen(*p) + 1;
+    char *strings = malloc(size);
+
+    struct request req = {
+        .pgid = pgid,
+        .sched = *sched,
+        .limits = *limits,
+    };
+    size_t len = 0;
+    req.argc = pack_strings(argv, strings, &len);
+    req.envc = pack_strings(envp, strings, &len);
+    req.len = len;
+
+    /* the descriptors travel with the request, the strings follow */
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(NFDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof control);
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof req };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf,
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(NFDS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), all_fds, NFDS * sizeof(int));
+
+    ssize_t n;
+    do
+        n = sendmsg(zygote_sock, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+
+    int32_t answer = -1;
+    bool ok = n > 0
+              && send_all(zygote_sock, (char *) &req + n, sizeof req - n)
+              && send_all(zygote_sock, strings, len)
+              && recv_all(zygote_sock, &answer, sizeof answer);
+    free(strings);
+    close(cwd);
+    if (!ok)
+        zygote_stop();
+    return answer;
+}
+
+bool
+zygote_reap(pid_t pid)
+{
+    if (zygote_pid == -1 || pid != zygote_pid)
+        return false;
+    if (zygote_sock >= 0)
+        zygote_stop();
+    zygote_pid = -1;
+    return true;
+}
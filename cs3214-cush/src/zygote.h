@@ -0,0 +1,42 @@
+#ifndef __ZYGOTE_H
+#define __ZYGOTE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "jobsched.h"
+#include "joblimits.h"
+
+/* The zygote, an optional helper that starts the shell's commands.
+ *
+ * fork() copies the page tables of the shell, which grow with its
+ * history, variables and caches.  The zygote is forked when the shell
+ * starts, while it is still small, and stays small: it only receives
+ * spawn requests over a socket and clones a process for each one.  The
+ * clone is made with CLONE_PARENT, so the new process is a child of the
+ * shell, which waits for it and puts it in its job as if it had forked
+ * it.
+ */
+
+/* Start the zygote.  Must be called before the shell starts threads or
+ * installs signal handlers.  Returns false if it could not be started,
+ * in which case the shell forks as usual. */
+bool zygote_start(void);
+
+/* Returns true while the zygote is running */
+bool zygote_running(void);
+
+/* Start 'argv' with environment 'envp' and 'fds' as its stdin, stdout
+ * and stderr, in the shell's working directory and in process group
+ * 'pgid' (a new one if 0), with 'sched' and 'limits' applied.  If the
+ * command cannot be executed, the process fails as a forked child of
+ * the shell does.  Returns the pid, or -1 if the zygote is not running
+ * or went away, in which case the caller forks instead. */
+pid_t zygote_spawn(char **argv, char **envp, const int fds[3], pid_t pgid,
+                   const struct jobsched *sched, const struct joblimits *limits);
+
+/* Returns true if 'pid' is the zygote, which has then exited and is not
+ * used again.  Called for every child the shell reaps. */
+bool zygote_reap(pid_t pid);
+
+#endif /* __ZYGOTE_H */
@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Compares starting commands by forking the shell with starting them from
+# the zygote (cush -z) as the shell grows.  The shell is grown by storing
+# a large string in a variable, then runs /bin/true a number of times;
+# its stats show how long the start of each command took ("fork") and
+# how long each command took from start to reaping ("wall").
+#
+# Usage: ./zygote_bench.sh [cush binary] [runs]
+#
+CUSH=$(realpath "${1:-./cush}")
+RUNS=${2:-300}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# prints the shell's RSS and the mean fork and wall times
+measure() {
+    local mb=$1
+    shift
+    cat > "$DIR/script.sh" <<END
+big=\$(head -c ${mb}M /dev/zero | tr "\\0" x)
+grep VmRSS /proc/\$\$/status
+stats -r
+for i in \$(seq $RUNS); do /bin/true; done
+stats
+END
+    "$CUSH" "$@" "$DIR/script.sh" | awk '
+        /VmRSS/ { rss = $2 / 1024 }
+        $1 == "fork" { fork = $3 }
+        $1 == "wall" { wall = $3 }
+        END { printf "%8.0f %10s %10s", rss, fork, wall }'
+}
+
+printf "%8s %10s %10s %10s %10s\n" "RSS(MB)" "fork" "wall" "zygote" "wall"
+for mb in 0 64 256 1024; do
+    printf "%s %s\n" "$(measure $mb)" "$(measure $mb -z | cut -c10-)"
+done
+echo "(mean per command of $RUNS runs of /bin/true)"
@@ -0,0 +1,80 @@
+#!/usr/bin/python
+#
+# zygote_test: tests starting commands from the zygote, cush -z
+#
+# Test that commands started by the zygote are children of the shell,
+# that they run in its directory, that pipes and redirections reach them,
+# and that job control works on them as it does on forked jobs
+#
+
+import sys, imp, atexit, pexpect, proc_check, signal, time, threading, tempfile, os, shutil
+from testutil import *
+import testutil
+
+tmp = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmp)
+out = os.path.join(tmp, "out.txt")
+
+console = setup_tests()
+shell = os.path.abspath(testutil.settings_module.shell)
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# run a shell with a zygote in the foreground
+sendline(shell + " -z")
+expect_prompt("Shell with a zygote did not print expected prompt ")
+
+# commands are children of the shell, not of the zygote
+sendline("echo shell-$$")
+pid = expect_regex("shell-(\d+)\r\n")[0]
+expect_prompt("Shell did not print expected prompt ")
+sendline("grep PPid /proc/self/status")
+expect("PPid:\t" + pid + "\r\n", "command was not a child of the shell")
+expect_prompt("Shell did not print expected prompt ")
+
+# commands run in the shell's directory, not in the zygote's
+sendline("cd " + tmp + "; /bin/pwd")
+expect(tmp + "\r\n", "command did not run in the shell's directory")
+expect_prompt("Shell did not print expected prompt ")
+
+# pipes, redirections and the environment
+sendline("export ZYGOTE_VAR=zv; printenv ZYGOTE_VAR | tr a-z A-Z > " + out + "; cat < " + out)
+expect("ZV\r\n", "pipeline with redirections did not run")
+expect_prompt("Shell did not print expected prompt ")
+sendline("no_such_command_here; echo status $?")
+expect("no_such_command_here: No such file or directory\r\nstatus 127\r\n",
+       "missing command did not fail")
+expect_prompt("Shell did not print expected prompt ")
+
+# a job can be stopped, continued and killed
+sendline("sleep 10 | sleep 9")
+time.sleep(0.5)
+sendcontrol('z')
+expect_prompt("Shell did not print expected prompt after ^Z")
+run_builtin('jobs')
+job = parse_job_line()
+assert job.status == 'stopped', "job started by the zygote was not stopped"
+expect_prompt()
+run_builtin('bg', str(job.id))
+expect_prompt()
+run_builtin('jobs')
+job = parse_job_line()
+assert job.status == 'running', "job started by the zygote was not continued"
+expect_prompt()
+run_builtin('kill', str(job.id))
+expect_prompt()
+sendline("sleep 0.2; jobs; echo jobs-done")
+expect("jobs-done\r\n", "jobs did not run")
+assert "Running" not in testutil.console.before, "job was not killed"
+expect_prompt()
+
+# leave the shell with the zygote
+sendline("exit")
+expect_prompt("Shell did not print expected prompt ")
+
+#exit
+sendline("exit");
+expect("exit\r\n", "Shell output extraneous characters")
+
+test_success()